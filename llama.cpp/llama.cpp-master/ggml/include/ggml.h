@@ -2170,7 +2170,7 @@ extern "C" {
         bool                cpumask[GGML_MAX_N_THREADS]; // mask of cpu cores (all-zeros means use default affinity settings)
         int                 n_threads;                   // number of threads
         enum ggml_sched_priority prio;                   // thread priority
-        uint32_t            poll;                        // polling level (0 - no polling, 100 - aggressive polling)
+        uint32_t            poll;                        // polling level (0 - no polling, 100 - aggressive polling, barriers never park)
         bool                strict_cpu;                  // strict cpu placement
         bool                paused;                      // start in paused state
     };
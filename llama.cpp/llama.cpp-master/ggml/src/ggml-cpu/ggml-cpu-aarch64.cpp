@@ -9,6 +9,7 @@
 #include "ggml-cpu-impl.h"
 #include "ggml-cpu-traits.h"
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <cassert>
@@ -1311,9 +1312,6 @@ static void ggml_gemv_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, c
     UNUSED(blocklen);
 
 #if defined(__AVX2__)
-    // Lookup table to convert signed nibbles to signed bytes
-    __m256i signextendlut = _mm256_castsi128_si256(_mm_set_epi8(-1, -2, -3, -4, -5, -6, -7, -8, 7, 6, 5, 4, 3, 2, 1, 0));
-    signextendlut = _mm256_permute2f128_si256(signextendlut, signextendlut, 0);
     // Shuffle masks to rearrange delta and scale values to multiply with appropriate scales
     __m128i deltamask = _mm_set_epi8(15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0);
     __m128i scalemask = _mm_set_epi8(7, 7, 3, 3, 6, 6, 2, 2, 5, 5, 1, 1, 4, 4, 0, 0);
@@ -1328,11 +1326,16 @@ static void ggml_gemv_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, c
     const block_q4_Kx8 * b_ptr_start = (const block_q4_Kx8 *)vx;
     const block_q8_K * a_ptr_start = (const block_q8_K *)vy;
 
-    // Process Q8_K blocks one by one
-    for (int64_t y = 0; y < nr; y++) {
+    // Up to four rows of block_q8_K share each pass over the weights: every group of eight
+    // interleaved block_q4_K structures is loaded and unpacked once for all of them, which
+    // matters for small-batch decoding where the weights dominate memory traffic
+    constexpr int max_rows = 4;
+
+    for (int64_t y0 = 0; y0 < nr; y0 += max_rows) {
+        const int rows = (int) std::min<int64_t>(nr - y0, max_rows);
 
         // Pointers to LHS blocks of block_q8_K format
-        const block_q8_K * a_ptr = a_ptr_start + (y * nb);
+        const block_q8_K * a_ptr = a_ptr_start + (y0 * nb);
 
         // Take group of eight interleaved block_q4_K structures at each pass of the loop and perform dot product operation
         for (int64_t x = 0; x < nc / 8; x++) {
@@ -1341,29 +1344,45 @@ static void ggml_gemv_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, c
             const block_q4_Kx8 * b_ptr = b_ptr_start + (x * b_nb);
 
             // Master FP accumulators
-            __m256 acc_row = _mm256_setzero_ps();
-            __m256 acc_min_rows = _mm256_setzero_ps();
+            __m256 acc_row[max_rows];
+            __m256 acc_min_rows[max_rows];
+            for (int y = 0; y < rows; y++) {
+                acc_row[y] = _mm256_setzero_ps();
+                acc_min_rows[y] = _mm256_setzero_ps();
+            }
 
             for (int64_t b = 0; b < nb; b++) {
 
-                // Load and convert to FP32 scale from block_q8_K
-                const __m256 row_scale_f32 = _mm256_set1_ps((a_ptr[b].d));
+                // The next super block follows in memory, also across groups of columns
+                const char * b_next = (const char *)(b_ptr + b + 1);
+                _mm_prefetch(b_next, _MM_HINT_T0);
+                _mm_prefetch(b_next + 64, _MM_HINT_T0);
 
                 // Load the scale values for the 8 blocks interleaved in block_q4_Kx8
                 // col_scale_f32 rearranged so as to multiply with appropriate quants
                 const __m256 col_scale_f32 = GGML_F32Cx8_REARRANGE_LOAD(b_ptr[b].d, deltamask);
                 const __m256 col_dmin_f32 = GGML_F32Cx8_LOAD(b_ptr[b].dmin);
 
-                __m256i iacc_b = _mm256_setzero_si256();
-                __m256i iacc_min_b = _mm256_setzero_si256();
+                __m256i iacc_b[max_rows];
+                __m256i iacc_min_b[max_rows];
+                __m256i q8s[max_rows];
+                for (int y = 0; y < rows; y++) {
+                    iacc_b[y] = _mm256_setzero_si256();
+                    iacc_min_b[y] = _mm256_setzero_si256();
 
-                const __m256i q8sums = _mm256_loadu_si256((const __m256i * )(a_ptr[b].bsums));
-                __m256i q8s = _mm256_castsi128_si256(_mm_hadd_epi16(_mm256_castsi256_si128(q8sums), _mm256_extracti128_si256(q8sums, 1)));
-                q8s = _mm256_permute2f128_si256(q8s, q8s, 0);
+                    const __m256i q8sums = _mm256_loadu_si256((const __m256i * )(a_ptr[y * nb + b].bsums));
+                    q8s[y] = _mm256_castsi128_si256(_mm_hadd_epi16(_mm256_castsi256_si128(q8sums), _mm256_extracti128_si256(q8sums, 1)));
+                    q8s[y] = _mm256_permute2f128_si256(q8s[y], q8s[y], 0);
+                }
 
                 // Processes two sub blocks from each Q4_K in each iteration
                 for (int sb = 0; sb < QK_K / 64; sb++) {
 
+                    _mm_prefetch(b_next + 128 + sb * 256, _MM_HINT_T0);
+                    _mm_prefetch(b_next + 192 + sb * 256, _MM_HINT_T0);
+                    _mm_prefetch(b_next + 256 + sb * 256, _MM_HINT_T0);
+                    _mm_prefetch(b_next + 320 + sb * 256, _MM_HINT_T0);
+
                     // Load the eight block_q4_K for two sub blocks quantized values interleaved with each other in chunks of eight - B0,B1 ....B6,B7
                     const __m256i rhs_raw_vec_0123_0 = _mm256_loadu_si256((const __m256i * )(b_ptr[b].qs + sb * 256));
                     const __m256i rhs_raw_vec_4567_0 = _mm256_loadu_si256((const __m256i * )(b_ptr[b].qs + 32 + sb * 256));
@@ -1395,6 +1414,30 @@ static void ggml_gemv_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, c
                     const __m256i rhs_vec_0123_13 = _mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_0123_3, 4), m4b);
                     const __m256i rhs_vec_4567_13 = _mm256_and_si256(_mm256_srli_epi16(rhs_raw_vec_4567_3, 4), m4b);
 
+                    // Rearranged so that each 32 bit lane holds four values of one column, in the order
+                    // B0 B4 B1 B5 B2 B6 B3 B7 for the even and B4 B0 B5 B1 B6 B2 B7 B3 for the odd vectors;
+                    // shared by all the rows below
+                    const __m256i rhs_0[8] = {
+                        _mm256_blend_epi32(rhs_vec_0123_00, _mm256_shuffle_epi32(rhs_vec_4567_00, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_00, 177), rhs_vec_4567_00, 170),
+                        _mm256_blend_epi32(rhs_vec_0123_01, _mm256_shuffle_epi32(rhs_vec_4567_01, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_01, 177), rhs_vec_4567_01, 170),
+                        _mm256_blend_epi32(rhs_vec_0123_02, _mm256_shuffle_epi32(rhs_vec_4567_02, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_02, 177), rhs_vec_4567_02, 170),
+                        _mm256_blend_epi32(rhs_vec_0123_03, _mm256_shuffle_epi32(rhs_vec_4567_03, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_03, 177), rhs_vec_4567_03, 170),
+                    };
+                    const __m256i rhs_1[8] = {
+                        _mm256_blend_epi32(rhs_vec_0123_10, _mm256_shuffle_epi32(rhs_vec_4567_10, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_10, 177), rhs_vec_4567_10, 170),
+                        _mm256_blend_epi32(rhs_vec_0123_11, _mm256_shuffle_epi32(rhs_vec_4567_11, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_11, 177), rhs_vec_4567_11, 170),
+                        _mm256_blend_epi32(rhs_vec_0123_12, _mm256_shuffle_epi32(rhs_vec_4567_12, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_12, 177), rhs_vec_4567_12, 170),
+                        _mm256_blend_epi32(rhs_vec_0123_13, _mm256_shuffle_epi32(rhs_vec_4567_13, 177), 170),
+                        _mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_13, 177), rhs_vec_4567_13, 170),
+                    };
+
                     uint32_t utmp_0[4], utmp_1[4];
 
                     // Scales and Mins of corresponding sub blocks from different Q8_K structures are stored together
@@ -1427,79 +1470,129 @@ static void ggml_gemv_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, c
                     // Mins of first and second sub block of Q4_K block are arranged side by side
                     __m256i mins_01 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(_mm_shuffle_epi32(mins_and_scales_0, 78), _mm_shuffle_epi32(mins_and_scales_1, 78)));
 
-                    // Load the two sub block values corresponding to sb in block_q8_K in batches of 16 bytes and replicate the same across 256 bit vector
-                    __m256i lhs_vec_00 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(a_ptr[b].qs + sb * 64)));
-                    __m256i lhs_vec_01 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(a_ptr[b].qs + 16 + sb * 64)));
-                    __m256i lhs_vec_10 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(a_ptr[b].qs + 32 + sb * 64)));
-                    __m256i lhs_vec_11 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(a_ptr[b].qs + 48 + sb * 64)));
-
-                    lhs_vec_00 = _mm256_permute2f128_si256(lhs_vec_00, lhs_vec_00, 0);
-                    lhs_vec_01 = _mm256_permute2f128_si256(lhs_vec_01, lhs_vec_01, 0);
-                    lhs_vec_10 = _mm256_permute2f128_si256(lhs_vec_10, lhs_vec_10, 0);
-                    lhs_vec_11 = _mm256_permute2f128_si256(lhs_vec_11, lhs_vec_11, 0);
-
-                    // Dot product done within 32 bit lanes and accumulated in the same vector
-                    // First done for first sub block and thenn for second sub block in each sb
-                    // B0(0-3) B4(0-3) B1(0-3) B5(0-3) B2(0-3) B6(0-3) B3(0-3) B7(0-3) with A0(0-3)
-                    // B0(4-7) B4(4-7) B1(4-7) B5(4-7) B2(4-7) B6(4-7) B3(4-7) B7(4-7) with A0(4-7)
-                    // ...........................................................................
-                    // B0(28-31) B4(28-31) B1(28-31) B5(28-31) B2(28-31) B6(28-31) B3(28-31) B7(28-31) with A0(28-31)
-
-
-                    __m256i iacc_0 = _mm256_setzero_si256();
-                    __m256i iacc_1 = _mm256_setzero_si256();
-
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_00 ,_mm256_shuffle_epi32(rhs_vec_4567_00, 177), 170), _mm256_shuffle_epi32(lhs_vec_00, 0)));
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_00, 177) ,rhs_vec_4567_00, 170), _mm256_shuffle_epi32(lhs_vec_00, 85)));
-
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_01 ,_mm256_shuffle_epi32(rhs_vec_4567_01, 177), 170), _mm256_shuffle_epi32(lhs_vec_00, 170)));
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_01, 177) ,rhs_vec_4567_01, 170), _mm256_shuffle_epi32(lhs_vec_00, 255)));
-
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_02 ,_mm256_shuffle_epi32(rhs_vec_4567_02, 177), 170), _mm256_shuffle_epi32(lhs_vec_01, 0)));
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_02, 177) ,rhs_vec_4567_02, 170), _mm256_shuffle_epi32(lhs_vec_01, 85)));
-
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_03 ,_mm256_shuffle_epi32(rhs_vec_4567_03, 177), 170), _mm256_shuffle_epi32(lhs_vec_01, 170)));
-                    iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_03, 177) ,rhs_vec_4567_03, 170), _mm256_shuffle_epi32(lhs_vec_01, 255)));
-
-                    iacc_0 = _mm256_madd_epi16(iacc_0, scales_0);
-
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_10 ,_mm256_shuffle_epi32(rhs_vec_4567_10, 177), 170), _mm256_shuffle_epi32(lhs_vec_10, 0)));
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_10, 177) ,rhs_vec_4567_10, 170), _mm256_shuffle_epi32(lhs_vec_10, 85)));
-
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_11 ,_mm256_shuffle_epi32(rhs_vec_4567_11, 177), 170), _mm256_shuffle_epi32(lhs_vec_10, 170)));
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_11, 177) ,rhs_vec_4567_11, 170), _mm256_shuffle_epi32(lhs_vec_10, 255)));
-
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_12 ,_mm256_shuffle_epi32(rhs_vec_4567_12, 177), 170), _mm256_shuffle_epi32(lhs_vec_11, 0)));
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_12, 177) ,rhs_vec_4567_12, 170), _mm256_shuffle_epi32(lhs_vec_11, 85)));
-
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(rhs_vec_0123_13 ,_mm256_shuffle_epi32(rhs_vec_4567_13, 177), 170), _mm256_shuffle_epi32(lhs_vec_11, 170)));
-                    iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(_mm256_blend_epi32(_mm256_shuffle_epi32(rhs_vec_0123_13, 177) ,rhs_vec_4567_13, 170), _mm256_shuffle_epi32(lhs_vec_11, 255)));
-
-                    iacc_1 = _mm256_madd_epi16(iacc_1, scales_1);
-
-                    // Accumulate the iacc value for one sb
-                    __m256i iacc_sb = _mm256_add_epi32(iacc_0, iacc_1);
+                    int y = 0;
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+                    // Two rows per 512 bit vector: the low half for row y and the high half for row y + 1
+                    if (rows > 1) {
+                        __m512i rhs_0_x2[8], rhs_1_x2[8];
+                        for (int k = 0; k < 8; k++) {
+                            rhs_0_x2[k] = _mm512_inserti64x4(_mm512_castsi256_si512(rhs_0[k]), rhs_0[k], 1);
+                            rhs_1_x2[k] = _mm512_inserti64x4(_mm512_castsi256_si512(rhs_1[k]), rhs_1[k], 1);
+                        }
+                        const __m512i scales_0_x2 = _mm512_inserti64x4(_mm512_castsi256_si512(scales_0), scales_0, 1);
+                        const __m512i scales_1_x2 = _mm512_inserti64x4(_mm512_castsi256_si512(scales_1), scales_1, 1);
+
+                        for (; y + 1 < rows; y += 2) {
+                            const int8_t * qs_a = a_ptr[y * nb + b].qs + sb * 64;
+                            const int8_t * qs_b = a_ptr[(y + 1) * nb + b].qs + sb * 64;
+
+                            // Sixteen bytes of each row, replicated across the two 128 bit lanes of its half
+                            const __m512i lhs_vec_00 = _mm512_inserti64x4(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(qs_a))),      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs_b))), 1);
+                            const __m512i lhs_vec_01 = _mm512_inserti64x4(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(qs_a + 16))), _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs_b + 16))), 1);
+                            const __m512i lhs_vec_10 = _mm512_inserti64x4(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(qs_a + 32))), _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs_b + 32))), 1);
+                            const __m512i lhs_vec_11 = _mm512_inserti64x4(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(qs_a + 48))), _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs_b + 48))), 1);
+
+                            __m512i iacc_0 = _mm512_setzero_si512();
+                            __m512i iacc_1 = _mm512_setzero_si512();
+
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[0], _mm512_shuffle_epi32(lhs_vec_00, (_MM_PERM_ENUM)0)));
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[1], _mm512_shuffle_epi32(lhs_vec_00, (_MM_PERM_ENUM)85)));
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[2], _mm512_shuffle_epi32(lhs_vec_00, (_MM_PERM_ENUM)170)));
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[3], _mm512_shuffle_epi32(lhs_vec_00, (_MM_PERM_ENUM)255)));
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[4], _mm512_shuffle_epi32(lhs_vec_01, (_MM_PERM_ENUM)0)));
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[5], _mm512_shuffle_epi32(lhs_vec_01, (_MM_PERM_ENUM)85)));
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[6], _mm512_shuffle_epi32(lhs_vec_01, (_MM_PERM_ENUM)170)));
+                            iacc_0 = _mm512_add_epi16(iacc_0, _mm512_maddubs_epi16(rhs_0_x2[7], _mm512_shuffle_epi32(lhs_vec_01, (_MM_PERM_ENUM)255)));
+
+                            iacc_0 = _mm512_madd_epi16(iacc_0, scales_0_x2);
+
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[0], _mm512_shuffle_epi32(lhs_vec_10, (_MM_PERM_ENUM)0)));
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[1], _mm512_shuffle_epi32(lhs_vec_10, (_MM_PERM_ENUM)85)));
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[2], _mm512_shuffle_epi32(lhs_vec_10, (_MM_PERM_ENUM)170)));
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[3], _mm512_shuffle_epi32(lhs_vec_10, (_MM_PERM_ENUM)255)));
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[4], _mm512_shuffle_epi32(lhs_vec_11, (_MM_PERM_ENUM)0)));
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[5], _mm512_shuffle_epi32(lhs_vec_11, (_MM_PERM_ENUM)85)));
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[6], _mm512_shuffle_epi32(lhs_vec_11, (_MM_PERM_ENUM)170)));
+                            iacc_1 = _mm512_add_epi16(iacc_1, _mm512_maddubs_epi16(rhs_1_x2[7], _mm512_shuffle_epi32(lhs_vec_11, (_MM_PERM_ENUM)255)));
+
+                            iacc_1 = _mm512_madd_epi16(iacc_1, scales_1_x2);
+
+                            // Accumulate the iacc value for one sb
+                            const __m512i iacc_sb = _mm512_add_epi32(iacc_0, iacc_1);
+                            iacc_b[y]     = _mm256_add_epi32(iacc_b[y],     _mm512_castsi512_si256(iacc_sb));
+                            iacc_b[y + 1] = _mm256_add_epi32(iacc_b[y + 1], _mm512_extracti64x4_epi64(iacc_sb, 1));
+                        }
+                    }
+#endif
+                    for (; y < rows; y++) {
+                        const int8_t * qs = a_ptr[y * nb + b].qs + sb * 64;
+
+                        // Load the two sub block values corresponding to sb in block_q8_K in batches of 16 bytes and replicate the same across 256 bit vector
+                        const __m256i lhs_vec_00 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs)));
+                        const __m256i lhs_vec_01 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs + 16)));
+                        const __m256i lhs_vec_10 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs + 32)));
+                        const __m256i lhs_vec_11 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(qs + 48)));
+
+                        // Dot product done within 32 bit lanes and accumulated in the same vector
+                        // First done for first sub block and thenn for second sub block in each sb
+                        // B0(0-3) B4(0-3) B1(0-3) B5(0-3) B2(0-3) B6(0-3) B3(0-3) B7(0-3) with A0(0-3)
+                        // B0(4-7) B4(4-7) B1(4-7) B5(4-7) B2(4-7) B6(4-7) B3(4-7) B7(4-7) with A0(4-7)
+                        // ...........................................................................
+                        // B0(28-31) B4(28-31) B1(28-31) B5(28-31) B2(28-31) B6(28-31) B3(28-31) B7(28-31) with A0(28-31)
+
+                        __m256i iacc_0 = _mm256_setzero_si256();
+                        __m256i iacc_1 = _mm256_setzero_si256();
+
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[0], _mm256_shuffle_epi32(lhs_vec_00, 0)));
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[1], _mm256_shuffle_epi32(lhs_vec_00, 85)));
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[2], _mm256_shuffle_epi32(lhs_vec_00, 170)));
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[3], _mm256_shuffle_epi32(lhs_vec_00, 255)));
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[4], _mm256_shuffle_epi32(lhs_vec_01, 0)));
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[5], _mm256_shuffle_epi32(lhs_vec_01, 85)));
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[6], _mm256_shuffle_epi32(lhs_vec_01, 170)));
+                        iacc_0 = _mm256_add_epi16(iacc_0, _mm256_maddubs_epi16(rhs_0[7], _mm256_shuffle_epi32(lhs_vec_01, 255)));
+
+                        iacc_0 = _mm256_madd_epi16(iacc_0, scales_0);
+
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[0], _mm256_shuffle_epi32(lhs_vec_10, 0)));
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[1], _mm256_shuffle_epi32(lhs_vec_10, 85)));
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[2], _mm256_shuffle_epi32(lhs_vec_10, 170)));
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[3], _mm256_shuffle_epi32(lhs_vec_10, 255)));
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[4], _mm256_shuffle_epi32(lhs_vec_11, 0)));
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[5], _mm256_shuffle_epi32(lhs_vec_11, 85)));
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[6], _mm256_shuffle_epi32(lhs_vec_11, 170)));
+                        iacc_1 = _mm256_add_epi16(iacc_1, _mm256_maddubs_epi16(rhs_1[7], _mm256_shuffle_epi32(lhs_vec_11, 255)));
+
+                        iacc_1 = _mm256_madd_epi16(iacc_1, scales_1);
+
+                        // Accumulate the iacc value for one sb
+                        iacc_b[y] = _mm256_add_epi32(iacc_b[y], _mm256_add_epi32(iacc_0, iacc_1));
+                    }
 
                     // Broadcast the bsums of the two sub blocks  of the iteration of Q8_K across the vector
                     // Multiply-Add with corresponding mins of Q4_Kx8 with bsums
-                    __m256i q8s_sb = _mm256_shuffle_epi32(q8s, 0);
-                    __m256i iacc_min_sb = _mm256_madd_epi16(q8s_sb, mins_01);
-                    q8s = _mm256_bsrli_epi128(q8s, 4);
-
-                    // Accumulate for the complete block
-                    iacc_b = _mm256_add_epi32(iacc_b, iacc_sb);
-                    iacc_min_b = _mm256_add_epi32(iacc_min_b, iacc_min_sb);
+                    for (y = 0; y < rows; y++) {
+                        const __m256i q8s_sb = _mm256_shuffle_epi32(q8s[y], 0);
+                        iacc_min_b[y] = _mm256_add_epi32(iacc_min_b[y], _mm256_madd_epi16(q8s_sb, mins_01));
+                        q8s[y] = _mm256_bsrli_epi128(q8s[y], 4);
+                    }
                 }
 
                 // Multiply-Add with scale values for the complete super block
-                acc_row = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_b), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row);
-                acc_min_rows = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_min_b), _mm256_mul_ps(col_dmin_f32, row_scale_f32), acc_min_rows);
+                for (int y = 0; y < rows; y++) {
+                    // Load and convert to FP32 scale from block_q8_K
+                    const __m256 row_scale_f32 = _mm256_set1_ps((a_ptr[y * nb + b].d));
 
+                    acc_row[y] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_b[y]), _mm256_mul_ps(col_scale_f32, row_scale_f32), acc_row[y]);
+                    acc_min_rows[y] = _mm256_fmadd_ps(_mm256_cvtepi32_ps(iacc_min_b[y]), _mm256_mul_ps(col_dmin_f32, row_scale_f32), acc_min_rows[y]);
+                }
             }
 
             // Accumulated output values permuted so as to be stored in appropriate order post accumulation
-            acc_row = _mm256_permutevar8x32_ps(acc_row, finalpermutemask);
-            _mm256_storeu_ps(s + (y * nr + x * 8), _mm256_sub_ps(acc_row, acc_min_rows));
+            for (int y = 0; y < rows; y++) {
+                const __m256 acc = _mm256_permutevar8x32_ps(acc_row[y], finalpermutemask);
+                _mm256_storeu_ps(s + ((y0 + y) * bs + x * 8), _mm256_sub_ps(acc, acc_min_rows[y]));
+            }
         }
     }
 
@@ -1512,51 +1605,53 @@ static void ggml_gemv_q4_K_8x8_q8_K(int n, float * GGML_RESTRICT s, size_t bs, c
     int sumi2;
     int sumi;
 
-    const block_q8_K * a_ptr = (const block_q8_K *) vy;
-    for (int x = 0; x < nc / ncols_interleaved; x++) {
-        const block_q4_Kx8 * b_ptr = (const block_q4_Kx8 *) vx + (x * nb);
+    for (int y = 0; y < nr; y++) {
+        const block_q8_K * a_ptr = (const block_q8_K *) vy + (y * nb);
+        for (int x = 0; x < nc / ncols_interleaved; x++) {
+            const block_q4_Kx8 * b_ptr = (const block_q4_Kx8 *) vx + (x * nb);
 
-        for (int j = 0; j < ncols_interleaved; j++) {
-            sumf[j] = 0.0;
-            sum_minf[j] = 0.0;
-        }
-        for (int l = 0; l < nb; l++) {
-            for (int sb = 0; sb < 8; sb++) {
-                memcpy(utmp + sb * 4, b_ptr[l].scales + sb * 12, 12);
-                utmp[sb * 4 + 3] = ((utmp[sb * 4 + 2] >> 4) & kmask2) | (((utmp[sb * 4 + 1] >> 6) & kmask3) << 4);
-                const uint32_t uaux_0 = utmp[sb * 4 + 1] & kmask1;
-                utmp[sb * 4 + 1] = (utmp[sb * 4 + 2] & kmask2) | (((utmp[sb * 4 + 0] >> 6) & kmask3) << 4);
-                utmp[sb * 4 + 2] = uaux_0;
-                utmp[sb * 4 + 0] &= kmask1;
+            for (int j = 0; j < ncols_interleaved; j++) {
+                sumf[j] = 0.0;
+                sum_minf[j] = 0.0;
             }
-            for (int k = 0; k < (qk / (2 * blocklen)); k++) {
-                uint8_t *scales_0 = (uint8_t*) utmp + (k / 4) * 32;
-                uint8_t *scales_1 = (uint8_t*) utmp + (k / 4) * 32 + 16;
-                for (int j = 0; j < ncols_interleaved; j++) {
-                    sumi1 = 0;
-                    sumi2 = 0;
-                    sumi = 0;
-                    for (int i = 0; i < blocklen; ++i) {
-                        const int v0 = (int8_t) (b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] & 0xF);
-                        const int v1 = (int8_t) (b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] >> 4);
-                        sumi1 = (v0 * a_ptr[l].qs[(k >> 2) * 64 + (k % 4) * blocklen + i]);
-                        sumi2 = (v1 * a_ptr[l].qs[(k >> 2) * 64 + (k % 4) * blocklen + i + 32]);
-                        sumi1 = sumi1 * scales_0[j];
-                        sumi2 = sumi2 * scales_1[j];
-                        sumi += sumi1 + sumi2;
+            for (int l = 0; l < nb; l++) {
+                for (int sb = 0; sb < 8; sb++) {
+                    memcpy(utmp + sb * 4, b_ptr[l].scales + sb * 12, 12);
+                    utmp[sb * 4 + 3] = ((utmp[sb * 4 + 2] >> 4) & kmask2) | (((utmp[sb * 4 + 1] >> 6) & kmask3) << 4);
+                    const uint32_t uaux_0 = utmp[sb * 4 + 1] & kmask1;
+                    utmp[sb * 4 + 1] = (utmp[sb * 4 + 2] & kmask2) | (((utmp[sb * 4 + 0] >> 6) & kmask3) << 4);
+                    utmp[sb * 4 + 2] = uaux_0;
+                    utmp[sb * 4 + 0] &= kmask1;
+                }
+                for (int k = 0; k < (qk / (2 * blocklen)); k++) {
+                    uint8_t *scales_0 = (uint8_t*) utmp + (k / 4) * 32;
+                    uint8_t *scales_1 = (uint8_t*) utmp + (k / 4) * 32 + 16;
+                    for (int j = 0; j < ncols_interleaved; j++) {
+                        sumi1 = 0;
+                        sumi2 = 0;
+                        sumi = 0;
+                        for (int i = 0; i < blocklen; ++i) {
+                            const int v0 = (int8_t) (b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] & 0xF);
+                            const int v1 = (int8_t) (b_ptr[l].qs[k * ncols_interleaved * blocklen + j * blocklen + i] >> 4);
+                            sumi1 = (v0 * a_ptr[l].qs[(k >> 2) * 64 + (k % 4) * blocklen + i]);
+                            sumi2 = (v1 * a_ptr[l].qs[(k >> 2) * 64 + (k % 4) * blocklen + i + 32]);
+                            sumi1 = sumi1 * scales_0[j];
+                            sumi2 = sumi2 * scales_1[j];
+                            sumi += sumi1 + sumi2;
+                        }
+                        sumf[j] += sumi * GGML_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d;
                     }
-                    sumf[j] += sumi * GGML_FP16_TO_FP32(b_ptr[l].d[j]) * a_ptr[l].d;
                 }
-            }
-            for (int sb = 0; sb < 8; sb++) {
-                uint8_t *mins = (uint8_t*) utmp + 8 + sb * 16;
-                for (int j = 0; j < ncols_interleaved; j++) {
-                    sum_minf[j] += mins[j] * (a_ptr[l].bsums[sb * 2] + a_ptr[l].bsums[sb * 2 + 1]) * GGML_FP16_TO_FP32(b_ptr[l].dmin[j]) * a_ptr[l].d;
+                for (int sb = 0; sb < 8; sb++) {
+                    uint8_t *mins = (uint8_t*) utmp + 8 + sb * 16;
+                    for (int j = 0; j < ncols_interleaved; j++) {
+                        sum_minf[j] += mins[j] * (a_ptr[l].bsums[sb * 2] + a_ptr[l].bsums[sb * 2 + 1]) * GGML_FP16_TO_FP32(b_ptr[l].dmin[j]) * a_ptr[l].d;
+                    }
                 }
             }
-        }
-        for (int j = 0; j < ncols_interleaved; j++) {
-            s[x * ncols_interleaved + j] = sumf[j] - sum_minf[j];
+            for (int j = 0; j < ncols_interleaved; j++) {
+                s[y * bs + x * ncols_interleaved + j] = sumf[j] - sum_minf[j];
+            }
         }
     }
 #endif
@@ -5986,6 +6081,13 @@ template <> int repack<block_iq4_nl, 4, 4>(struct ggml_tensor * t, const void *
 template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PARAM_TYPE>
 void gemv(int, float *, size_t, const void *, const void *, int, int);
 
+// Rows of src1 a gemv kernel takes in one call; the rows are nr apart in the output (bs) and
+// contiguous in the quantized src1. Most kernels only handle a single row.
+template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PARAM_TYPE>
+constexpr int64_t gemv_max_rows() { return 1; }
+
+template <> constexpr int64_t gemv_max_rows<block_q4_K, 8, 8, GGML_TYPE_Q8_K>() { return 3; }
+
 template <> void gemv<block_q4_0, 4, 4, GGML_TYPE_Q8_0>(int n, float * s, size_t bs, const void * vx, const void * vy, int nr, int nc) {
     ggml_gemv_q4_0_4x4_q8_0(n, s, bs, vx, vy, nr, nc);
 }
@@ -6132,11 +6234,12 @@ template <typename BLOC_TYPE, int64_t INTER_SIZE, int64_t NB_COLS, ggml_type PAR
                     (const char *) src0->data + src0_start * nb01,
                     (const char *) src1_wdata, ne11 - ne11 % 4, src0_end - src0_start);
         }
-        for (int iter = ne11 - ne11 % 4; iter < ne11; iter++) {
+        constexpr int64_t gemv_rows = gemv_max_rows<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>();
+        for (int64_t iter = ne11 - ne11 % 4; iter < ne11; iter += gemv_rows) {
             gemv<BLOC_TYPE, INTER_SIZE, NB_COLS, PARAM_TYPE>(ne00,
                     (float *) ((char *) dst->data + (iter * nb1)) + src0_start, ne01,
                     (const char *) src0->data + src0_start * nb01,
-                    (const char *) src1_wdata + (src1_col_stride * iter), 1,
+                    (const char *) src1_wdata + (src1_col_stride * iter), std::min(gemv_rows, ne11 - iter),
                     src0_end - src0_start);
         }
     }
@@ -6360,6 +6463,33 @@ static ggml_backend_buffer_t ggml_backend_cpu_aarch64_buffer_type_alloc_buffer(g
     return buffer;
 }
 
+static void ggml_backend_cpu_aarch64_prepacked_buffer_set_tensor(ggml_backend_buffer_t buffer, struct ggml_tensor * tensor,
+                                                                 const void * data, size_t offset, size_t size) {
+    GGML_ABORT("%s: tensor %s is read-only, it was loaded already repacked", __func__, tensor->name);
+
+    GGML_UNUSED(buffer);
+    GGML_UNUSED(data);
+    GGML_UNUSED(offset);
+    GGML_UNUSED(size);
+}
+
+ggml_backend_buffer_t ggml_backend_cpu_aarch64_buffer_from_ptr(void * ptr, size_t size) {
+    ggml_backend_buffer_t buffer = ggml_backend_cpu_buffer_from_ptr(ptr, size);
+
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+
+    // the data at ptr must already be in the repacked layout, e.g. a previously saved buffer
+    buffer->buft                = ggml_backend_cpu_aarch64_buffer_type();
+    buffer->iface.init_tensor   = ggml_backend_cpu_aarch64_buffer_init_tensor;
+    buffer->iface.set_tensor    = ggml_backend_cpu_aarch64_prepacked_buffer_set_tensor;
+    buffer->iface.memset_tensor = nullptr;
+    buffer->iface.get_tensor    = nullptr;
+    buffer->iface.cpy_tensor    = nullptr;
+    return buffer;
+}
+
 static size_t ggml_backend_cpu_aarch64_buffer_type_get_alignment(ggml_backend_buffer_type_t buft) {
     return TENSOR_ALIGNMENT;
 
@@ -6,3 +6,6 @@
 // GGML internal header
 
 ggml_backend_buffer_type_t ggml_backend_cpu_aarch64_buffer_type(void);
+
+// wraps memory that already holds tensors in the repacked layout (no repacking on load, read-only)
+ggml_backend_buffer_t ggml_backend_cpu_aarch64_buffer_from_ptr(void * ptr, size_t size);
@@ -36,6 +36,7 @@
 #include <signal.h>
 #if defined(__gnu_linux__)
 #include <syscall.h>
+#include <linux/futex.h>
 #endif
 
 #ifdef GGML_USE_OPENMP
@@ -451,6 +452,14 @@ struct ggml_threadpool {
     atomic_int GGML_CACHE_ALIGN n_barrier_passed;
     atomic_int GGML_CACHE_ALIGN current_chunk; // currently processing chunk during Mat_Mul, shared between all the threads.
 
+    // barrier parking (see ggml_barrier)
+    atomic_int GGML_CACHE_ALIGN n_barrier_sleepers; // threads parked in ggml_barrier
+    atomic_int   barrier_spin;     // current spin budget, adapted to the measured wait times
+    int          barrier_spin_min; // budgets in ggml_thread_cpu_relax() rounds
+    int          barrier_spin_max; // 0 - spin only, never park
+    ggml_mutex_t barrier_mutex;    // parking without futexes
+    ggml_cond_t  barrier_cond;
+
     // these are atomic as an annotation for thread-sanitizer
     atomic_bool stop;         // Used for stopping the threadpool altogether
     atomic_bool pause;        // Used for pausing the threadpool or individual threads
@@ -491,6 +500,122 @@ static inline void ggml_thread_cpu_relax(void) {
 static inline void ggml_thread_cpu_relax(void) {;}
 #endif
 
+#ifndef GGML_USE_OPENMP
+
+// Barrier waits longer than this are not worth spinning through: the thread being waited
+// for is most likely descheduled, e.g. when the cores are oversubscribed
+#define GGML_BARRIER_SPIN_MAX_US 50
+#define GGML_BARRIER_SPIN_MIN_US 1
+
+// Number of ggml_thread_cpu_relax() rounds per microsecond, measured once
+static int ggml_barrier_spins_per_us(void) {
+    static atomic_int spins_per_us = 0;
+
+    int n = atomic_load_explicit(&spins_per_us, memory_order_relaxed);
+    if (n == 0) {
+        const int64_t t0 = ggml_time_us();
+        int64_t spins = 0;
+        int64_t t1;
+        do {
+            for (int i = 0; i < 64; i++) {
+                ggml_thread_cpu_relax();
+            }
+            spins += 64;
+            t1 = ggml_time_us();
+        } while (t1 - t0 < 200);
+
+        n = (int) MAX(1, MIN(spins / (t1 - t0), INT_MAX / (4*GGML_BARRIER_SPIN_MAX_US)));
+        atomic_store_explicit(&spins_per_us, n, memory_order_relaxed);
+    }
+    return n;
+}
+
+#if defined(__gnu_linux__)
+// The kernel reads the futex word as a plain 32-bit int; an atomic_int has the same size
+// and representation, and all other accesses to it stay atomic. The address goes through
+// uintptr_t because casting the _Atomic qualifier away directly trips -Wcast-qual.
+static_assert(sizeof(atomic_int) == sizeof(int), "futex word must be a plain int");
+
+static void * ggml_futex_addr(atomic_int * addr) {
+    return (void *) (uintptr_t) addr;
+}
+
+static void ggml_futex_wait(atomic_int * addr, int val) {
+    syscall(SYS_futex, ggml_futex_addr(addr), FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void ggml_futex_wake_all(atomic_int * addr) {
+    syscall(SYS_futex, ggml_futex_addr(addr), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+// Sleeps until the barrier generation moves past n_passed
+static void ggml_barrier_park(struct ggml_threadpool * tp, int n_passed) {
+    // pairs with the load of n_barrier_sleepers in ggml_barrier (seq-cst on both sides)
+    atomic_fetch_add_explicit(&tp->n_barrier_sleepers, 1, memory_order_seq_cst);
+
+#if defined(__gnu_linux__)
+    while (atomic_load_explicit(&tp->n_barrier_passed, memory_order_seq_cst) == n_passed) {
+        ggml_futex_wait(&tp->n_barrier_passed, n_passed);
+    }
+#else
+    ggml_mutex_lock_shared(&tp->barrier_mutex);
+    while (atomic_load_explicit(&tp->n_barrier_passed, memory_order_seq_cst) == n_passed) {
+        ggml_cond_wait(&tp->barrier_cond, &tp->barrier_mutex);
+    }
+    ggml_mutex_unlock_shared(&tp->barrier_mutex);
+#endif
+
+    atomic_fetch_add_explicit(&tp->n_barrier_sleepers, -1, memory_order_relaxed);
+}
+
+static void ggml_barrier_wake(struct ggml_threadpool * tp) {
+#if defined(__gnu_linux__)
+    ggml_futex_wake_all(&tp->n_barrier_passed);
+#else
+    ggml_mutex_lock(&tp->barrier_mutex);
+    ggml_cond_broadcast(&tp->barrier_cond);
+    ggml_mutex_unlock(&tp->barrier_mutex);
+#endif
+}
+
+// Hybrid wait: spin while the waits are short, park once spinning stops paying off.
+// The spin budget follows twice the typical wait, and drops to the minimum when the
+// waits are longer than GGML_BARRIER_SPIN_MAX_US.
+static void ggml_barrier_wait(struct ggml_threadpool * tp, int n_passed) {
+    if (tp->barrier_spin_max == 0) {
+        while (atomic_load_explicit(&tp->n_barrier_passed, memory_order_relaxed) == n_passed) {
+            ggml_thread_cpu_relax();
+        }
+        return;
+    }
+
+    const int budget = atomic_load_explicit(&tp->barrier_spin, memory_order_relaxed);
+
+    int64_t waited = 0;
+    while (atomic_load_explicit(&tp->n_barrier_passed, memory_order_relaxed) == n_passed) {
+        if (waited >= budget) {
+            const int64_t t0 = ggml_time_us();
+            ggml_barrier_park(tp, n_passed);
+            waited += (ggml_time_us() - t0) * ggml_barrier_spins_per_us();
+            break;
+        }
+        ggml_thread_cpu_relax();
+        waited++;
+    }
+
+    int target = tp->barrier_spin_min;
+    if (waited <= tp->barrier_spin_max) {
+        target = (int) MIN(MAX(2*waited, tp->barrier_spin_min), tp->barrier_spin_max);
+    }
+    const int next = budget + (target - budget) / 8;
+    if (next != budget) {
+        atomic_store_explicit(&tp->barrier_spin, next, memory_order_relaxed);
+    }
+}
+
+#endif // GGML_USE_OPENMP
+
 //
 // NUMA support
 //
@@ -546,13 +671,15 @@ void ggml_barrier(struct ggml_threadpool * tp) {
 
         // exit barrier (fill seq-cst fence)
         atomic_fetch_add_explicit(&tp->n_barrier_passed, 1, memory_order_seq_cst);
+
+        if (atomic_load_explicit(&tp->n_barrier_sleepers, memory_order_seq_cst) > 0) {
+            ggml_barrier_wake(tp);
+        }
         return;
     }
 
     // wait for other threads
-    while (atomic_load_explicit(&tp->n_barrier_passed, memory_order_relaxed) == n_passed) {
-        ggml_thread_cpu_relax();
-    }
+    ggml_barrier_wait(tp, n_passed);
 
     // exit barrier (full seq-cst fence)
     // TSAN doesn't support standalone fence yet, we use a dummy read-modify-write instead
@@ -2598,6 +2725,8 @@ void ggml_threadpool_free(struct ggml_threadpool* threadpool) {
 
     ggml_mutex_destroy(&threadpool->mutex);
     ggml_cond_destroy(&threadpool->cond);
+    ggml_mutex_destroy(&threadpool->barrier_mutex);
+    ggml_cond_destroy(&threadpool->barrier_cond);
 #endif // GGML_USE_OPENMP
 
     const size_t workers_size = sizeof(struct ggml_compute_state) * n_threads;
@@ -3058,6 +3187,14 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
     ggml_mutex_init(&threadpool->mutex);
     ggml_cond_init(&threadpool->cond);
 
+    // Aggressive polling keeps the pure spin barrier
+    threadpool->n_barrier_sleepers = 0;
+    threadpool->barrier_spin_min   = GGML_BARRIER_SPIN_MIN_US * ggml_barrier_spins_per_us();
+    threadpool->barrier_spin_max   = tpp->poll >= 100 ? 0 : GGML_BARRIER_SPIN_MAX_US * ggml_barrier_spins_per_us();
+    threadpool->barrier_spin       = threadpool->barrier_spin_max;
+    ggml_mutex_init(&threadpool->barrier_mutex);
+    ggml_cond_init(&threadpool->barrier_cond);
+
     // Spin the threads for all workers, and update CPU placements.
     // Place the main thread last (towards the higher numbered CPU cores).
 
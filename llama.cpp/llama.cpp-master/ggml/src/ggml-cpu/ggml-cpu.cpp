@@ -609,6 +609,11 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
     if (strcmp(name, "ggml_backend_get_features") == 0) {
         return (void *)ggml_backend_cpu_get_features;
     }
+#ifdef GGML_USE_CPU_AARCH64
+    if (strcmp(name, "ggml_backend_cpu_aarch64_buffer_from_ptr") == 0) {
+        return (void *)ggml_backend_cpu_aarch64_buffer_from_ptr;
+    }
+#endif
     if (strcmp(name, "ggml_backend_set_abort_callback") == 0) {
         return (void *)ggml_backend_cpu_set_abort_callback;
     }
@@ -1043,6 +1043,310 @@ class tinyBLAS_Q0_AVX {
 };
 #endif // __AVX__
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// K-QUANT MATRIX MULTIPLICATION
+
+#if defined(__AVX2__)
+// Q5_K and Q6_K weights against Q8_K activations. The super-blocks of a tile's
+// rows of A are unpacked once into plain unsigned quants with one scale and min
+// per 16 values, which every column of B in the tile then shares. Q4_K is left
+// to the repacked CPU_AARCH64 kernels, which take it over on AVX2.
+template <typename TA>
+class tinyBLAS_QK_AVX {
+  public:
+    tinyBLAS_QK_AVX(int64_t k,
+                    const TA *A, int64_t lda,
+                    const block_q8_K *B, int64_t ldb,
+                    float *C, int64_t ldc,
+                    int ith, int nth)
+        : A(A), B(B), C(C), k(k), lda(lda), ldb(ldb), ldc(ldc), ith(ith), nth(nth) {
+    }
+
+    void matmul(int64_t m, int64_t n) {
+        mnpack(0, m, 0, n);
+    }
+
+  private:
+    // one super-block of A, x = d * scale * q - dmin * min
+    struct unpacked {
+        uint8_t q[QK_K];           // 0..63
+        int16_t scales[QK_K / 2];  // scale of quants 16*(i/8)..16*(i/8)+15, laid out for maddubs pairs
+        int16_t mins[QK_K / 16];   // min of quants 16*i..16*i+15
+        float d;
+        float dmin;
+    };
+
+    void mnpack(int64_t m0, int64_t m, int64_t n0, int64_t n) {
+        int64_t mc, nc, mp, np;
+        switch ((MIN(m - m0, 4) << 4) | MIN(n - n0, 4)) {
+#if VECTOR_REGISTERS == 32
+        case 0x44:
+            mc = 4;
+            nc = 4;
+            gemm<4, 4>(m0, m, n0, n);
+            break;
+        case 0x43:
+            mc = 4;
+            nc = 3;
+            gemm<4, 3>(m0, m, n0, n);
+            break;
+        case 0x34:
+            mc = 3;
+            nc = 4;
+            gemm<3, 4>(m0, m, n0, n);
+            break;
+        case 0x33:
+            mc = 3;
+            nc = 3;
+            gemm<3, 3>(m0, m, n0, n);
+            break;
+        case 0x42:
+            mc = 4;
+            nc = 2;
+            gemm<4, 2>(m0, m, n0, n);
+            break;
+        case 0x24:
+            mc = 2;
+            nc = 4;
+            gemm<2, 4>(m0, m, n0, n);
+            break;
+#else
+        case 0x44:
+        case 0x34:
+        case 0x24:
+            mc = 2;
+            nc = 4;
+            gemm<2, 4>(m0, m, n0, n);
+            break;
+        case 0x43:
+        case 0x42:
+            mc = 4;
+            nc = 2;
+            gemm<4, 2>(m0, m, n0, n);
+            break;
+        case 0x33:
+#endif
+        case 0x32:
+            mc = 3;
+            nc = 2;
+            gemm<3, 2>(m0, m, n0, n);
+            break;
+        case 0x23:
+            mc = 2;
+            nc = 3;
+            gemm<2, 3>(m0, m, n0, n);
+            break;
+        case 0x41:
+            mc = 4;
+            nc = 1;
+            gemm<4, 1>(m0, m, n0, n);
+            break;
+        case 0x22:
+            mc = 2;
+            nc = 2;
+            gemm<2, 2>(m0, m, n0, n);
+            break;
+        case 0x14:
+            mc = 1;
+            nc = 4;
+            gemm<1, 4>(m0, m, n0, n);
+            break;
+        case 0x31:
+            mc = 3;
+            nc = 1;
+            gemm<3, 1>(m0, m, n0, n);
+            break;
+        case 0x13:
+            mc = 1;
+            nc = 3;
+            gemm<1, 3>(m0, m, n0, n);
+            break;
+        case 0x21:
+            mc = 2;
+            nc = 1;
+            gemm<2, 1>(m0, m, n0, n);
+            break;
+        case 0x12:
+            mc = 1;
+            nc = 2;
+            gemm<1, 2>(m0, m, n0, n);
+            break;
+        case 0x11:
+            mc = 1;
+            nc = 1;
+            gemm<1, 1>(m0, m, n0, n);
+            break;
+        default:
+            return;
+        }
+        mp = m0 + (m - m0) / mc * mc;
+        np = n0 + (n - n0) / nc * nc;
+        mnpack(mp, m, n0, np);
+        mnpack(m0, m, np, n);
+    }
+
+    // A job is RM rows of A against a block of up to XB tiles of B. The rows are unpacked
+    // KP super-blocks at a time, and every tile of the block reuses them.
+    template <int RM, int RN>
+    NOINLINE void gemm(int64_t m0, int64_t m, int64_t n0, int64_t n) {
+        constexpr int64_t XB = 16;
+        constexpr int64_t KP = 8;
+        int64_t ytiles = (m - m0) / RM;
+        int64_t xtiles = (n - n0) / RN;
+        int64_t xblocks = (xtiles + XB - 1) / XB;
+        int64_t tiles = xblocks * ytiles;
+        int64_t duty = (tiles + nth - 1) / nth;
+        int64_t start = duty * ith;
+        int64_t end = start + duty;
+        if (end > tiles)
+            end = tiles;
+        unpacked Au[RM][KP];
+        for (int64_t job = start; job < end; ++job) {
+            int64_t ii = m0 + job % ytiles * RM;
+            int64_t jb = job / ytiles * XB;
+            int64_t je = MIN(jb + XB, xtiles);
+            for (int64_t l0 = 0; l0 < k; l0 += KP) {
+                int64_t kp = MIN(KP, k - l0);
+                for (int64_t i = 0; i < RM; ++i)
+                    for (int64_t p = 0; p < kp; ++p)
+                        unpack(A + lda * (ii + i) + l0 + p, &Au[i][p]);
+                for (int64_t jt = jb; jt < je; ++jt) {
+                    int64_t jj = n0 + jt * RN;
+                    __m256 Cv[RN][RM] = {};
+                    for (int64_t p = 0; p < kp; ++p) {
+                        const int64_t l = l0 + p;
+                        // integer sums of scale * q * b, with each chunk of A and B loaded once for the tile
+                        ivec sumi[RN][RM] = {};
+                        for (int c = 0; c < QK_K; c += QCHUNK) {
+                            ivec bv[RN];
+                            for (int64_t j = 0; j < RN; ++j)
+                                bv[j] = iload(B[ldb * (jj + j) + l].qs + c);
+                            for (int64_t i = 0; i < RM; ++i) {
+                                const ivec qv = iload(Au[i][p].q + c);
+                                const ivec sv = iload(Au[i][p].scales + c / 2);
+                                for (int64_t j = 0; j < RN; ++j)
+                                    sumi[j][i] = iadd(sumi[j][i], idot(qv, sv, bv[j]));
+                            }
+                        }
+                        for (int64_t j = 0; j < RN; ++j) {
+                            const block_q8_K *b = B + ldb * (jj + j) + l;
+                            const __m256i bsums = _mm256_loadu_si256((const __m256i *)b->bsums);
+                            for (int64_t i = 0; i < RM; ++i) {
+                                const __m256 summ = _mm256_cvtepi32_ps(
+                                    _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)Au[i][p].mins), bsums));
+                                Cv[j][i] = madd(_mm256_set1_ps(Au[i][p].d * b->d), _mm256_cvtepi32_ps(ireduce(sumi[j][i])), Cv[j][i]);
+                                Cv[j][i] = madd(_mm256_set1_ps(-Au[i][p].dmin * b->d), summ, Cv[j][i]);
+                            }
+                        }
+                    }
+                    for (int64_t j = 0; j < RN; ++j)
+                        for (int64_t i = 0; i < RM; ++i) {
+                            const float sum = hsum(Cv[j][i]);
+                            C[ldc * (jj + j) + (ii + i)] = l0 ? C[ldc * (jj + j) + (ii + i)] + sum : sum;
+                        }
+                }
+            }
+        }
+    }
+
+#if defined(__AVX512BW__)
+    typedef __m512i ivec;
+    static constexpr int QCHUNK = 64;
+
+    static inline __m512i iload(const void *p) { return _mm512_loadu_si512(p); }
+    static inline __m512i iadd(__m512i x, __m512i y) { return _mm512_add_epi32(x, y); }
+    static inline __m512i idot(__m512i q, __m512i s, __m512i b) {
+        return _mm512_madd_epi16(s, _mm512_maddubs_epi16(q, b));
+    }
+    static inline __m256i ireduce(__m512i x) {
+        return _mm256_add_epi32(_mm512_castsi512_si256(x), _mm512_extracti64x4_epi64(x, 1));
+    }
+#else
+    typedef __m256i ivec;
+    static constexpr int QCHUNK = 32;
+
+    static inline __m256i iload(const void *p) { return _mm256_loadu_si256((const __m256i *)p); }
+    static inline __m256i iadd(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+    static inline __m256i idot(__m256i q, __m256i s, __m256i b) {
+        return _mm256_madd_epi16(s, _mm256_maddubs_epi16(q, b));
+    }
+    static inline __m256i ireduce(__m256i x) { return x; }
+#endif
+
+    // 6-bit scales and mins of the 8 sub-blocks of Q5_K
+    static inline void unpack_scales(const uint8_t *s, float d, float dmin, unpacked *u) {
+        for (int j = 0; j < QK_K / 32; ++j) {
+            uint8_t sc, mn;
+            if (j < 4) {
+                sc = s[j] & 63;
+                mn = s[j + 4] & 63;
+            } else {
+                sc = (s[j + 4] & 0xF) | ((s[j - 4] >> 6) << 4);
+                mn = (s[j + 4] >> 4) | ((s[j] >> 6) << 4);
+            }
+            _mm256_storeu_si256((__m256i *)(u->scales + 16 * j), _mm256_set1_epi16(sc));
+            u->mins[2 * j + 0] = mn;
+            u->mins[2 * j + 1] = mn;
+        }
+        u->d = d;
+        u->dmin = dmin;
+    }
+
+    static inline void unpack(const block_q5_K *x, unpacked *u) {
+        const __m256i m4 = _mm256_set1_epi8(15);
+        const __m256i hbit = _mm256_set1_epi8(16);
+        const __m256i qh = _mm256_loadu_si256((const __m256i *)x->qh);
+        for (int j = 0; j < QK_K / 64; ++j) {
+            const __m256i q4 = _mm256_loadu_si256((const __m256i *)(x->qs + 32 * j));
+            const __m256i m0 = _mm256_set1_epi8((char)(1 << (2 * j)));
+            const __m256i m1 = _mm256_set1_epi8((char)(1 << (2 * j + 1)));
+            const __m256i h0 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(qh, m0), m0), hbit);
+            const __m256i h1 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(qh, m1), m1), hbit);
+            _mm256_storeu_si256((__m256i *)(u->q + 64 * j), _mm256_or_si256(_mm256_and_si256(q4, m4), h0));
+            _mm256_storeu_si256((__m256i *)(u->q + 64 * j + 32),
+                                _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(q4, 4), m4), h1));
+        }
+        unpack_scales(x->scales, unhalf(x->d), unhalf(x->dmin), u);
+    }
+
+    // Q6_K quants are stored with an offset of 32, which is folded into the mins
+    static inline void unpack(const block_q6_K *x, unpacked *u) {
+        const __m256i m4 = _mm256_set1_epi8(15);
+        const __m256i m2 = _mm256_set1_epi8(3);
+        for (int j = 0; j < QK_K / 128; ++j) {
+            const __m256i ql0 = _mm256_loadu_si256((const __m256i *)(x->ql + 64 * j));
+            const __m256i ql1 = _mm256_loadu_si256((const __m256i *)(x->ql + 64 * j + 32));
+            const __m256i qh = _mm256_loadu_si256((const __m256i *)(x->qh + 32 * j));
+            const __m256i h0 = _mm256_slli_epi16(_mm256_and_si256(qh, m2), 4);
+            const __m256i h1 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 2), m2), 4);
+            const __m256i h2 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 4), m2), 4);
+            const __m256i h3 = _mm256_slli_epi16(_mm256_and_si256(_mm256_srli_epi16(qh, 6), m2), 4);
+            uint8_t *q = u->q + 128 * j;
+            _mm256_storeu_si256((__m256i *)(q +  0), _mm256_or_si256(_mm256_and_si256(ql0, m4), h0));
+            _mm256_storeu_si256((__m256i *)(q + 32), _mm256_or_si256(_mm256_and_si256(ql1, m4), h1));
+            _mm256_storeu_si256((__m256i *)(q + 64), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql0, 4), m4), h2));
+            _mm256_storeu_si256((__m256i *)(q + 96), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(ql1, 4), m4), h3));
+        }
+        for (int j = 0; j < QK_K / 16; ++j) {
+            _mm_storeu_si128((__m128i *)(u->scales + 8 * j), _mm_set1_epi16(x->scales[j]));
+            u->mins[j] = 32 * x->scales[j];
+        }
+        u->d = unhalf(x->d);
+        u->dmin = u->d;
+    }
+
+    const TA *const A;
+    const block_q8_K *const B;
+    float *const C;
+    const int64_t k;
+    const int64_t lda;
+    const int64_t ldb;
+    const int64_t ldc;
+    const int ith;
+    const int nth;
+};
+#endif // __AVX2__
+
 //PPC Implementation
 #if defined(__MMA__)
 
@@ -3524,6 +3828,38 @@ bool llamafile_sgemm(const struct ggml_compute_params * params, int64_t m, int64
 #endif
     }
 
+    case GGML_TYPE_Q5_K: {
+        if (Btype != GGML_TYPE_Q8_K)
+            return false;
+#if defined(__AVX2__)
+        tinyBLAS_QK_AVX<block_q5_K> tb{
+            k, (const block_q5_K *)A, lda,
+            (const block_q8_K *)B, ldb,
+            (float *)C, ldc,
+            params->ith, params->nth};
+        tb.matmul(m, n);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    case GGML_TYPE_Q6_K: {
+        if (Btype != GGML_TYPE_Q8_K)
+            return false;
+#if defined(__AVX2__)
+        tinyBLAS_QK_AVX<block_q6_K> tb{
+            k, (const block_q6_K *)A, lda,
+            (const block_q8_K *)B, ldb,
+            (float *)C, ldc,
+            params->ith, params->nth};
+        tb.matmul(m, n);
+        return true;
+#else
+        return false;
+#endif
+    }
+
     default:
         return false;
     }
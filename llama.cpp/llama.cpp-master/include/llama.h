@@ -314,11 +314,17 @@ extern "C" {
         // override key-value pairs of the model meta data
         const struct llama_model_kv_override * kv_overrides;
 
+        // file used to cache the CPU-repacked weights between runs (NULL to disable)
+        // the first load writes it, later loads with the same model and CPU map it instead of repacking
+        const char * repack_cache_path;
+
         // Keep the booleans together to avoid misalignment during copy-by-value.
         bool vocab_only;    // only load the vocabulary, no weights
         bool use_mmap;      // use mmap if possible
         bool use_mlock;     // force system to keep model in RAM
         bool check_tensors; // validate model tensor data
+        bool use_prefetch;  // read the mapped weights in while loading, otherwise they are paged in on first use
+        bool use_hugepages; // back the mapped weights with transparent huge pages where the OS supports it
     };
 
     // NOTE: changing the default values of parameters marked as [EXPERIMENTAL] may cause crashes or incorrect results in certain configurations
@@ -534,6 +540,19 @@ extern "C" {
     // Returns the total number of parameters in the model
     LLAMA_API uint64_t llama_model_n_params(const struct llama_model * model);
 
+    enum llama_mmap_advice {
+        LLAMA_MMAP_ADVICE_COLD     = 0, // the weights will not be used for a while, release them from RAM
+        LLAMA_MMAP_ADVICE_WILLNEED = 1, // the weights are about to be used, start reading them in
+    };
+
+    // Hint the OS about the upcoming use of the memory-mapped model weights
+    // Returns false if the model is not memory-mapped or the hint could not be applied
+    LLAMA_API bool llama_model_mmap_advise(const struct llama_model * model, enum llama_mmap_advice advice);
+
+    // Bytes of the memory-mapped model weights that are currently in RAM, out of the bytes mapped
+    // Returns false if the model is not memory-mapped or residency cannot be queried on this platform
+    LLAMA_API bool llama_model_mmap_residency(const struct llama_model * model, size_t * resident, size_t * mapped);
+
     // Returns true if the model contains an encoder that requires llama_encode() call
     LLAMA_API bool llama_model_has_encoder(const struct llama_model * model);
 
@@ -190,6 +190,10 @@ llama_ubatch llama_sbatch::split_seq(size_t n_ubatch) {
 }
 
 llama_sbatch::llama_sbatch(const llama_batch & batch, size_t n_embd, bool simple_split, bool logits_all) {
+    from_batch(batch, n_embd, simple_split, logits_all);
+}
+
+void llama_sbatch::from_batch(const llama_batch & batch, size_t n_embd, bool simple_split, bool logits_all) {
     GGML_ASSERT(batch.n_tokens >= 0);
     this->batch = &batch;
     this->n_embd = n_embd;
@@ -198,6 +202,7 @@ llama_sbatch::llama_sbatch(const llama_batch & batch, size_t n_embd, bool simple
     n_tokens = batch.n_tokens;
     ids.resize(n_tokens);
     out_ids.clear();
+    seq.clear();
     // TODO: reserve out_ids and seq
 
     for (size_t i = 0; i < n_tokens; ++i) {
@@ -72,6 +72,9 @@ struct llama_sbatch {
 
     llama_sbatch() = default;
     llama_sbatch(const llama_batch & batch, size_t n_embd, bool simple_split = false, bool logits_all = false);
+
+    // same as the constructor, but keeps the capacity of the buffers from the previous batch
+    void from_batch(const llama_batch & batch, size_t n_embd, bool simple_split = false, bool logits_all = false);
 };
 
 // temporary allocate memory for the input batch if needed
@@ -250,6 +250,12 @@ llama_context::llama_context(
         if (pipeline_parallel) {
             LLAMA_LOG_INFO("%s: pipeline parallelism enabled (n_copies=%d)\n", __func__, ggml_backend_sched_get_n_copies(sched.get()));
         }
+
+        // only the KV cache stores of the unified cache are patched when reusing a graph
+        graph_reuse =
+            !llama_model_is_recurrent(&model) &&
+            !llama_model_has_encoder(&model) &&
+            ggml_backend_sched_get_n_copies(sched.get()) == 1;
     }
 
     // reserve worst-case graph
@@ -617,18 +623,24 @@ void llama_context::set_embeddings(bool value) {
     LLAMA_LOG_DEBUG("%s: value = %d\n", __func__, value);
 
     cparams.embeddings = value;
+
+    graph_reuse_reset();
 }
 
 void llama_context::set_causal_attn(bool value) {
     LLAMA_LOG_DEBUG("%s: value = %d\n", __func__, value);
 
     cparams.causal_attn = value;
+
+    graph_reuse_reset();
 }
 
 void llama_context::set_warmup(bool value) {
     LLAMA_LOG_DEBUG("%s: value = %d\n", __func__, value);
 
     cparams.warmup = value;
+
+    graph_reuse_reset();
 }
 
 void llama_context::set_adapter_lora(
@@ -637,6 +649,8 @@ void llama_context::set_adapter_lora(
     LLAMA_LOG_DEBUG("%s: adapter = %p, scale = %f\n", __func__, (void *) adapter, scale);
 
     loras[adapter] = scale;
+
+    graph_reuse_reset();
 }
 
 bool llama_context::rm_adapter_lora(
@@ -646,6 +660,7 @@ bool llama_context::rm_adapter_lora(
     auto pos = loras.find(adapter);
     if (pos != loras.end()) {
         loras.erase(pos);
+        graph_reuse_reset();
         return true;
     }
 
@@ -656,6 +671,8 @@ void llama_context::clear_adapter_lora() {
     LLAMA_LOG_DEBUG("%s: call\n", __func__);
 
     loras.clear();
+
+    graph_reuse_reset();
 }
 
 bool llama_context::apply_adapter_cvec(
@@ -666,6 +683,8 @@ bool llama_context::apply_adapter_cvec(
                 int32_t   il_end) {
     LLAMA_LOG_DEBUG("%s: il_start = %d, il_end = %d\n", __func__, il_start, il_end);
 
+    graph_reuse_reset();
+
     return cvec.apply(model, data, len, n_embd, il_start, il_end);
 }
 
@@ -706,7 +725,7 @@ int llama_context::encode(llama_batch & inp_batch) {
 
     const int64_t n_embd = hparams.n_embd;
 
-    llama_sbatch sbatch = llama_sbatch(batch, n_embd, /* simple_split */ true, /* logits_all */ true);
+    sbatch.from_batch(batch, n_embd, /* simple_split */ true, /* logits_all */ true);
 
     const llama_ubatch ubatch = sbatch.split_simple(n_tokens);
 
@@ -897,7 +916,7 @@ int llama_context::decode(llama_batch & inp_batch) {
         n_outputs_all = 1;
     }
 
-    llama_sbatch sbatch = kv_self->sbatch_init(batch, /* logits_all */ n_outputs_all == n_tokens_all);
+    kv_self->sbatch_init(sbatch, batch, /* logits_all */ n_outputs_all == n_tokens_all);
 
     // reserve output buffer
     if (output_reserve(n_outputs_all) < n_outputs_all) {
@@ -937,15 +956,48 @@ int llama_context::decode(llama_batch & inp_batch) {
             return 1;
         }
 
-        ggml_backend_sched_reset(sched.get());
-        ggml_backend_sched_set_eval_callback(sched.get(), cparams.cb_eval, cparams.cb_eval_user_data);
+        ggml_cgraph * gf = nullptr;
+        llm_graph_result_i * res = nullptr;
+        llm_graph_result_ptr res_owned;
 
-        auto * gf = graph_init();
-        auto res = graph_build(ctx_compute.get(), gf, ubatch, LLM_GRAPH_TYPE_DECODER);
+        // graph_reuse implies a unified KV cache
+        const bool is_tg = graph_reuse && ubatch.n_tokens == 1;
+        auto * kv_unified = is_tg ? static_cast<llama_kv_cache_unified *>(kv_self) : nullptr;
+        if (is_tg) {
+            // attend the whole cache, masked past the used cells, so the shape of the graph does
+            // not change as the sequence grows and it is only built once
+            kv_unified->n = kv_unified->size;
+        }
+
+        if (is_tg && gf_tg && gf_tg_n_kv == kv_unified->n && gf_tg_n_outputs == n_outputs && gf_tg_embd == (ubatch.embd != nullptr)) {
+            // same shape as the previous step: keep the allocated graph and move its KV stores to the new slot
+            gf  = gf_tg;
+            res = gf_tg_res.get();
+            res->set_kv_head(kv_unified->head);
+        } else {
+            ggml_backend_sched_reset(sched.get());
+            ggml_backend_sched_set_eval_callback(sched.get(), cparams.cb_eval, cparams.cb_eval_user_data);
 
-        // LLAMA_LOG_INFO("graph build time: %.3f ms (%d nodes, %d leafs)\n", (ggml_time_us() - t_start_us)/1000.0, gf->n_nodes, gf->n_leafs);
+            gf = graph_init();
+            res_owned = graph_build(ctx_compute.get(), gf, ubatch, LLM_GRAPH_TYPE_DECODER);
 
-        ggml_backend_sched_alloc_graph(sched.get(), gf);
+            // LLAMA_LOG_INFO("graph build time: %.3f ms (%d nodes, %d leafs)\n", (ggml_time_us() - t_start_us)/1000.0, gf->n_nodes, gf->n_leafs);
+
+            if (!ggml_backend_sched_alloc_graph(sched.get(), gf)) {
+                LLAMA_LOG_ERROR("%s: failed to allocate the compute graph\n", __func__);
+                return -2;
+            }
+
+            res = res_owned.get();
+
+            if (is_tg) {
+                gf_tg           = gf;
+                gf_tg_res       = std::move(res_owned);
+                gf_tg_n_kv      = kv_unified->n;
+                gf_tg_n_outputs = n_outputs;
+                gf_tg_embd      = ubatch.embd != nullptr;
+            }
+        }
 
         res->set_inputs(&ubatch);
 
@@ -1116,7 +1168,10 @@ int llama_context::decode(llama_batch & inp_batch) {
 
     // Reset state for the next token before backend sync, to allow the CPU activities in the reset to
     // overlap with device computation.
-    ggml_backend_sched_reset(sched.get());
+    // A reusable single-token graph has to stay allocated in the scheduler.
+    if (!gf_tg) {
+        ggml_backend_sched_reset(sched.get());
+    }
 
     return 0;
 }
@@ -1206,6 +1261,9 @@ int32_t llama_context::graph_max_nodes() const {
 }
 
 ggml_cgraph * llama_context::graph_init() {
+    // the cached graph lives in ctx_compute
+    graph_reuse_reset();
+
     ggml_init_params params = {
         /*.mem_size   =*/ buf_compute_meta.size(),
         /*.mem_buffer =*/ buf_compute_meta.data(),
@@ -1267,6 +1325,11 @@ ggml_status llama_context::graph_compute(
     return status;
 }
 
+void llama_context::graph_reuse_reset() {
+    gf_tg = nullptr;
+    gf_tg_res.reset();
+}
+
 llm_graph_cb llama_context::graph_get_cb() const {
     return [&](const llama_ubatch & ubatch, ggml_tensor * cur, const char * name, int il) {
         if (il >= 0) {
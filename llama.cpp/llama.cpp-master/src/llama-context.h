@@ -150,6 +150,7 @@ public:
     int32_t graph_max_nodes() const;
 
     // zero-out inputs and create the ctx_compute for the compute graph
+    // note: this invalidates the reusable single-token graph
     ggml_cgraph * graph_init();
 
     // returns the result of ggml_backend_sched_graph_compute_async execution
@@ -166,6 +167,9 @@ private:
 
     llm_graph_cb graph_get_cb() const;
 
+    // drop the cached single-token graph, e.g. after a change that affects the graph topology
+    void graph_reuse_reset();
+
     // TODO: read/write lora adapters and cvec
     size_t state_write_data(llama_io_write_i & io);
     size_t state_read_data (llama_io_read_i  & io);
@@ -208,6 +212,9 @@ private:
 
     std::vector<int32_t> output_ids; // map batch token positions to ids of the logits and embd buffers
 
+    // split state of the batch being decoded, kept across calls so its buffers are reused
+    llama_sbatch sbatch;
+
     ggml_backend_sched_ptr sched;
 
     ggml_backend_t backend_cpu = nullptr;
@@ -230,6 +237,15 @@ private:
     // memory buffers used to evaluate the model
     std::vector<uint8_t> buf_compute_meta;
 
+    // the last single-token decode graph, kept allocated so that the next step only updates its inputs
+    // it is valid for as long as the KV view size and the number of outputs stay the same
+    bool                 graph_reuse = false; // whether the model and scheduler allow reusing it
+    ggml_cgraph *        gf_tg       = nullptr;
+    llm_graph_result_ptr gf_tg_res;
+    uint32_t             gf_tg_n_kv      = 0;
+    int32_t              gf_tg_n_outputs = 0;
+    bool                 gf_tg_embd      = false;
+
     // host buffer for the model output (logits and embeddings)
     ggml_backend_buffer_ptr buf_output;
 
@@ -1416,7 +1416,9 @@ ggml_tensor * llm_graph_context::build_attn(
         //cb(k_cache_view, "k_cache_view", il);
 
         // note: storing RoPE-ed version of K in the KV cache
-        ggml_build_forward_expand(gf, ggml_cpy(ctx0, k_cur, k_cache_view));
+        ggml_tensor * k_store = ggml_cpy(ctx0, k_cur, k_cache_view);
+        ggml_build_forward_expand(gf, k_store);
+        res->add_kv_store(k_cache_view, k_store, ggml_row_size(kv_self->k_l[il]->type, n_embd_k_gqa));
 
         v_cur = ggml_reshape_2d(ctx0, v_cur, n_embd_v_gqa, n_tokens);
 
@@ -1434,7 +1436,9 @@ ggml_tensor * llm_graph_context::build_attn(
         }
         //cb(v_cache_view, "v_cache_view", il);
 
-        ggml_build_forward_expand(gf, ggml_cpy(ctx0, v_cur, v_cache_view));
+        ggml_tensor * v_store = ggml_cpy(ctx0, v_cur, v_cache_view);
+        ggml_build_forward_expand(gf, v_store);
+        res->add_kv_store(v_cache_view, v_store, v_trans ? ggml_element_size(kv_self->v_l[il]) : ggml_row_size(kv_self->v_l[il]->type, n_embd_v_gqa));
     }
 
     const bool is_swa = hparams.is_swa(il);
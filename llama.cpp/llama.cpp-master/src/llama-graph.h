@@ -5,6 +5,7 @@
 #include "llama-adapter.h"
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <memory>
 #include <set>
@@ -303,6 +304,9 @@ public:
     virtual ggml_tensor * get_embd_pooled() = 0;
 
     virtual void set_inputs(const llama_ubatch * ubatch) = 0;
+
+    // move the KV cache stores of an already allocated graph to the cells starting at head
+    virtual void set_kv_head(uint32_t head) = 0;
 };
 
 using llm_graph_result_ptr = std::unique_ptr<llm_graph_result_i>;
@@ -322,17 +326,43 @@ public:
         }
     }
 
+    void set_kv_head(uint32_t head) override {
+        for (auto & store : kv_stores) {
+            const size_t offs = store.cell_size*head;
+
+            store.view->view_offs = offs;
+            store.view->data      = (char *) store.view->view_src->data + offs;
+            memcpy(store.view->op_params, &offs, sizeof(offs));
+
+            store.cpy->view_offs = offs;
+            store.cpy->data      = store.view->data;
+        }
+    }
+
     llm_graph_input_i * add_input(llm_graph_input_ptr input) {
         inputs.emplace_back(std::move(input));
         return inputs.back().get();
     }
 
+    void add_kv_store(ggml_tensor * view, ggml_tensor * cpy, size_t cell_size) {
+        kv_stores.push_back({ view, cpy, cell_size });
+    }
+
     // important graph nodes
     ggml_tensor * t_logits      = nullptr;
     ggml_tensor * t_embd        = nullptr;
     ggml_tensor * t_embd_pooled = nullptr;
 
     std::vector<llm_graph_input_ptr> inputs;
+
+    // copies of the current K/V into the cache, their offset is the only part of the graph that depends on the KV head
+    struct kv_store {
+        ggml_tensor * view; // destination view of the cache tensor
+        ggml_tensor * cpy;  // GGML_OP_CPY node writing into the view
+        size_t        cell_size;
+    };
+
+    std::vector<kv_store> kv_stores;
 };
 
 //
@@ -443,10 +443,11 @@ void llama_kv_cache_unified::set_full() {
     n = size;
 }
 
-llama_sbatch llama_kv_cache_unified::sbatch_init(
+void llama_kv_cache_unified::sbatch_init(
+        llama_sbatch & sbatch,
         const llama_batch & batch,
         bool logits_all) {
-    return llama_sbatch(batch, hparams.n_embd, true, logits_all);
+    sbatch.from_batch(batch, hparams.n_embd, true, logits_all);
 }
 
 llama_ubatch llama_kv_cache_unified::ubatch_next(
@@ -1714,10 +1715,11 @@ void llama_kv_cache_recurrent::set_full() {
     n = size;
 }
 
-llama_sbatch llama_kv_cache_recurrent::sbatch_init(
+void llama_kv_cache_recurrent::sbatch_init(
+        llama_sbatch & sbatch,
         const llama_batch & batch,
         bool logits_all) {
-    return llama_sbatch(batch, hparams.n_embd, false, logits_all);
+    sbatch.from_batch(batch, hparams.n_embd, false, logits_all);
 }
 
 llama_ubatch llama_kv_cache_recurrent::ubatch_next(llama_sbatch & sbatch, uint32_t n_ubatch, bool embd_pooled) const {
@@ -7,6 +7,7 @@
 
 #include "ggml-cpp.h"
 
+#include <algorithm>
 #include <set>
 #include <vector>
 
@@ -40,7 +41,8 @@ struct llama_kv_cache : public llama_memory_i {
     // batch processing
     //
 
-    virtual llama_sbatch sbatch_init(const llama_batch & batch, bool logits_all) = 0;
+    // (re)initializes sbatch from batch, reusing its buffers
+    virtual void sbatch_init(llama_sbatch & sbatch, const llama_batch & batch, bool logits_all) = 0;
 
     // different KV caches require different batch splitting strategies
     virtual llama_ubatch ubatch_next(llama_sbatch & sbatch, uint32_t n_ubatch, bool embd_pooled) const = 0;
@@ -83,6 +85,82 @@ private:
     llama_kv_cache * kv;
 };
 
+//
+// llama_kv_cell_seq_ids
+//
+
+// sorted set of the sequences a KV cell belongs to
+// a cell rarely belongs to more than a few sequences, so these are stored inline and
+// claiming a cell in find_slot() does not touch the heap
+class llama_kv_cell_seq_ids {
+public:
+    using const_iterator = const llama_seq_id *;
+
+    const_iterator begin() const { return data(); }
+    const_iterator end()   const { return data() + n; }
+
+    const_iterator find(llama_seq_id id) const {
+        const_iterator it = std::lower_bound(begin(), end(), id);
+        return it != end() && *it == id ? it : end();
+    }
+
+    size_t size()  const { return n; }
+    bool   empty() const { return n == 0; }
+
+    void clear() {
+        n = 0;
+        large.clear();
+    }
+
+    void insert(llama_seq_id id) {
+        if (find(id) != end()) {
+            return;
+        }
+        if (n < N_INLINE) {
+            llama_seq_id * pos = std::lower_bound(small, small + n, id);
+            std::copy_backward(pos, small + n, small + n + 1);
+            *pos = id;
+        } else {
+            if (large.empty()) {
+                large.assign(small, small + n);
+            }
+            large.insert(std::lower_bound(large.begin(), large.end(), id), id);
+        }
+        n++;
+    }
+
+    void erase(llama_seq_id id) {
+        if (find(id) == end()) {
+            return;
+        }
+        if (large.empty()) {
+            llama_seq_id * pos = std::lower_bound(small, small + n, id);
+            std::copy(pos + 1, small + n, pos);
+        } else {
+            large.erase(std::lower_bound(large.begin(), large.end(), id));
+            if (large.size() <= N_INLINE) {
+                std::copy(large.begin(), large.end(), small);
+                large.clear();
+            }
+        }
+        n--;
+    }
+
+    bool operator==(const llama_kv_cell_seq_ids & other) const {
+        return std::equal(begin(), end(), other.begin(), other.end());
+    }
+
+private:
+    static constexpr uint32_t N_INLINE = 4;
+
+    // the ids are in `large` instead of `small` while there are more than N_INLINE
+    const llama_seq_id * data() const { return large.empty() ? small : large.data(); }
+
+    uint32_t n = 0;
+    llama_seq_id small[N_INLINE] = {};
+    std::vector<llama_seq_id> large;
+};
+
 //
 // llama_kv_cache_unified
 //
@@ -94,7 +172,7 @@ public:
         llama_pos pos   = -1;
         llama_pos delta =  0;
 
-        std::set<llama_seq_id> seq_id;
+        llama_kv_cell_seq_ids seq_id;
 
         bool has_seq_id(const llama_seq_id & id) const {
             return seq_id.find(id) != seq_id.end();
@@ -149,7 +227,7 @@ public:
 
     void set_full() override;
 
-    llama_sbatch sbatch_init(const llama_batch & batch, bool logits_all) override;
+    void sbatch_init(llama_sbatch & sbatch, const llama_batch & batch, bool logits_all) override;
 
     llama_ubatch ubatch_next(llama_sbatch & sbatch, uint32_t n_ubatch, bool embd_pooled) const override;
 
@@ -320,7 +398,7 @@ public:
 
     void set_full() override;
 
-    llama_sbatch sbatch_init(const llama_batch & batch, bool logits_all) override;
+    void sbatch_init(llama_sbatch & sbatch, const llama_batch & batch, bool logits_all) override;
 
     llama_ubatch ubatch_next(llama_sbatch & sbatch, uint32_t n_ubatch, bool embd_pooled) const override;
 
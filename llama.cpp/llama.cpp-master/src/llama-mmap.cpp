@@ -33,6 +33,7 @@
         #define PATH_MAX MAX_PATH
     #endif
     #include <io.h>
+    #include <psapi.h>
 #endif
 
 #if defined(__APPLE__)
@@ -273,7 +274,7 @@ struct llama_mmap::impl {
 #ifdef _POSIX_MAPPED_FILES
     std::vector<std::pair<size_t, size_t>> mapped_fragments;
 
-    impl(struct llama_file * file, size_t prefetch, bool numa) {
+    impl(struct llama_file * file, size_t prefetch, bool numa, bool hugepages) {
         size = file->size();
         int fd = file->file_id();
         int flags = MAP_SHARED;
@@ -283,13 +284,24 @@ struct llama_mmap::impl {
             LLAMA_LOG_WARN("warning: posix_fadvise(.., POSIX_FADV_SEQUENTIAL) failed: %s\n",
                     strerror(errno));
         }
-        if (prefetch) { flags |= MAP_POPULATE; }
+        // with huge pages the mapping is advised first and read in by the WILLNEED below
+        if (prefetch && !hugepages) { flags |= MAP_POPULATE; }
 #endif
         addr = mmap(NULL, file->size(), PROT_READ, flags, fd, 0);
         if (addr == MAP_FAILED) {
             throw std::runtime_error(format("mmap failed: %s", strerror(errno)));
         }
 
+        if (hugepages) {
+#ifdef MADV_HUGEPAGE
+            if (madvise(addr, file->size(), MADV_HUGEPAGE)) {
+                LLAMA_LOG_WARN("warning: madvise(.., MADV_HUGEPAGE) failed: %s\n", strerror(errno));
+            }
+#else
+            LLAMA_LOG_WARN("warning: transparent huge pages are not supported on this platform\n");
+#endif
+        }
+
         if (prefetch > 0) {
             if (posix_madvise(addr, std::min(file->size(), prefetch), POSIX_MADV_WILLNEED)) {
                 LLAMA_LOG_WARN("warning: posix_madvise(.., POSIX_MADV_WILLNEED) failed: %s\n",
@@ -354,6 +366,63 @@ struct llama_mmap::impl {
         mapped_fragments = std::move(new_mapped_fragments);
     }
 
+    bool advise(enum llama_mmap_advice advice) {
+        bool ok = true;
+        for (const auto & frag : mapped_fragments) {
+            void * frag_addr = (char *) addr + frag.first;
+            size_t frag_len  = frag.second - frag.first;
+            switch (advice) {
+                case LLAMA_MMAP_ADVICE_COLD:
+                    // the mapping is read-only and file-backed: dropping the pages only
+                    // releases them from the process, they are faulted back in from the page cache
+                    if (madvise(frag_addr, frag_len, MADV_DONTNEED)) {
+                        LLAMA_LOG_WARN("warning: madvise(.., MADV_DONTNEED) failed: %s\n", strerror(errno));
+                        ok = false;
+                    }
+                    break;
+                case LLAMA_MMAP_ADVICE_WILLNEED:
+                    if (posix_madvise(frag_addr, frag_len, POSIX_MADV_WILLNEED)) {
+                        LLAMA_LOG_WARN("warning: posix_madvise(.., POSIX_MADV_WILLNEED) failed: %s\n", strerror(errno));
+                        ok = false;
+                    }
+                    break;
+            }
+        }
+        return ok;
+    }
+
+    bool residency(size_t * resident, size_t * mapped) const {
+#if defined(__linux__)
+        using mincore_vec_t = unsigned char;
+#else
+        using mincore_vec_t = char;
+#endif
+        // query in windows of 64k pages to bound the size of the page vector
+        const size_t page_size = sysconf(_SC_PAGESIZE);
+        const size_t window    = page_size * 65536;
+        std::vector<mincore_vec_t> pages;
+
+        *resident = 0;
+        *mapped   = 0;
+        for (const auto & frag : mapped_fragments) {
+            for (size_t first = frag.first; first < frag.second; first += window) {
+                const size_t len = std::min(window, frag.second - first);
+                pages.resize((len + page_size - 1) / page_size);
+                if (mincore((char *) addr + first, len, pages.data())) {
+                    LLAMA_LOG_WARN("warning: mincore failed: %s\n", strerror(errno));
+                    return false;
+                }
+                for (size_t i = 0; i < pages.size(); i++) {
+                    if (pages[i] & 1) {
+                        *resident += std::min(page_size, len - i * page_size);
+                    }
+                }
+            }
+            *mapped += frag.second - frag.first;
+        }
+        return true;
+    }
+
     ~impl() {
         for (const auto & frag : mapped_fragments) {
             if (munmap((char *) addr + frag.first, frag.second - frag.first)) {
@@ -362,9 +431,14 @@ struct llama_mmap::impl {
         }
     }
 #elif defined(_WIN32)
-    impl(struct llama_file * file, size_t prefetch, bool numa) {
+    impl(struct llama_file * file, size_t prefetch, bool numa, bool hugepages) {
         GGML_UNUSED(numa);
 
+        // large pages on Windows need SeLockMemoryPrivilege and cannot back file mappings
+        if (hugepages) {
+            LLAMA_LOG_WARN("warning: huge pages are not supported for mapped files on Windows\n");
+        }
+
         size = file->size();
 
         HANDLE hFile = (HANDLE) _get_osfhandle(file->file_id());
@@ -411,6 +485,74 @@ struct llama_mmap::impl {
         GGML_UNUSED(last);
     }
 
+    bool advise(enum llama_mmap_advice advice) {
+        switch (advice) {
+            case LLAMA_MMAP_ADVICE_COLD:
+                // unlocking pages that are not locked removes them from the working set
+                VirtualUnlock(addr, size);
+                return true;
+            case LLAMA_MMAP_ADVICE_WILLNEED:
+#if _WIN32_WINNT >= 0x602
+                {
+                    BOOL (WINAPI *pPrefetchVirtualMemory) (HANDLE, ULONG_PTR, PWIN32_MEMORY_RANGE_ENTRY, ULONG);
+                    HMODULE hKernel32 = GetModuleHandleW(L"kernel32.dll");
+
+                    pPrefetchVirtualMemory = (decltype(pPrefetchVirtualMemory))(void *) GetProcAddress(hKernel32, "PrefetchVirtualMemory");
+
+                    if (pPrefetchVirtualMemory) {
+                        WIN32_MEMORY_RANGE_ENTRY range;
+                        range.VirtualAddress = addr;
+                        range.NumberOfBytes = (SIZE_T) size;
+                        if (pPrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0)) {
+                            return true;
+                        }
+                        LLAMA_LOG_WARN("warning: PrefetchVirtualMemory failed: %s\n",
+                                llama_format_win_err(GetLastError()).c_str());
+                    }
+                }
+#endif
+                return false;
+        }
+        return false;
+    }
+
+    // pages of the view in the working set of this process
+    bool residency(size_t * resident, size_t * mapped) const {
+        BOOL (WINAPI *pQueryWorkingSetEx) (HANDLE, PVOID, DWORD);
+        HMODULE hKernel32 = GetModuleHandleW(L"kernel32.dll");
+
+        pQueryWorkingSetEx = (decltype(pQueryWorkingSetEx))(void *) GetProcAddress(hKernel32, "K32QueryWorkingSetEx");
+        if (!pQueryWorkingSetEx) {
+            return false;
+        }
+
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        const size_t page_size = si.dwPageSize;
+        const size_t n_pages   = (size + page_size - 1) / page_size;
+        std::vector<PSAPI_WORKING_SET_EX_INFORMATION> pages(std::min<size_t>(n_pages, 65536));
+
+        *resident = 0;
+        *mapped   = size;
+        for (size_t first = 0; first < n_pages; first += pages.size()) {
+            const size_t count = std::min(pages.size(), n_pages - first);
+            for (size_t i = 0; i < count; i++) {
+                pages[i].VirtualAddress = (char *) addr + (first + i) * page_size;
+            }
+            if (!pQueryWorkingSetEx(GetCurrentProcess(), pages.data(), (DWORD) (count * sizeof(pages[0])))) {
+                LLAMA_LOG_WARN("warning: QueryWorkingSetEx failed: %s\n",
+                        llama_format_win_err(GetLastError()).c_str());
+                return false;
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (pages[i].VirtualAttributes.Valid) {
+                    *resident += std::min(page_size, size - (first + i) * page_size);
+                }
+            }
+        }
+        return true;
+    }
+
     ~impl() {
         if (!UnmapViewOfFile(addr)) {
             LLAMA_LOG_WARN("warning: UnmapViewOfFile failed: %s\n",
@@ -418,10 +560,11 @@ struct llama_mmap::impl {
         }
     }
 #else
-    impl(struct llama_file * file, size_t prefetch, bool numa) {
+    impl(struct llama_file * file, size_t prefetch, bool numa, bool hugepages) {
         GGML_UNUSED(file);
         GGML_UNUSED(prefetch);
         GGML_UNUSED(numa);
+        GGML_UNUSED(hugepages);
 
         throw std::runtime_error("mmap not supported");
     }
@@ -432,13 +575,26 @@ struct llama_mmap::impl {
 
         throw std::runtime_error("mmap not supported");
     }
+
+    bool advise(enum llama_mmap_advice advice) {
+        GGML_UNUSED(advice);
+
+        return false;
+    }
+
+    bool residency(size_t * resident, size_t * mapped) const {
+        GGML_UNUSED(resident);
+        GGML_UNUSED(mapped);
+
+        return false;
+    }
 #endif
 
     void * addr;
     size_t size;
 };
 
-llama_mmap::llama_mmap(struct llama_file * file, size_t prefetch, bool numa) : pimpl(std::make_unique<impl>(file, prefetch, numa)) {}
+llama_mmap::llama_mmap(struct llama_file * file, size_t prefetch, bool numa, bool hugepages) : pimpl(std::make_unique<impl>(file, prefetch, numa, hugepages)) {}
 llama_mmap::~llama_mmap() = default;
 
 size_t llama_mmap::size() const { return pimpl->size; }
@@ -446,6 +602,9 @@ void * llama_mmap::addr() const { return pimpl->addr; }
 
 void llama_mmap::unmap_fragment(size_t first, size_t last) { pimpl->unmap_fragment(first, last); }
 
+bool llama_mmap::advise(enum llama_mmap_advice advice) { return pimpl->advise(advice); }
+bool llama_mmap::residency(size_t * resident, size_t * mapped) const { return pimpl->residency(resident, mapped); }
+
 #if defined(_POSIX_MEMLOCK_RANGE) || defined(_WIN32)
 const bool llama_mmap::SUPPORTED  = true;
 #else
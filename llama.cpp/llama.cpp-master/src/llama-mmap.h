@@ -4,6 +4,8 @@
 #include <memory>
 #include <vector>
 
+#include "llama.h"
+
 struct llama_file;
 struct llama_mmap;
 struct llama_mlock;
@@ -36,7 +38,7 @@ private:
 
 struct llama_mmap {
     llama_mmap(const llama_mmap &) = delete;
-    llama_mmap(struct llama_file * file, size_t prefetch = (size_t) -1, bool numa = false);
+    llama_mmap(struct llama_file * file, size_t prefetch = (size_t) -1, bool numa = false, bool hugepages = false);
     ~llama_mmap();
 
     size_t size() const;
@@ -44,6 +46,12 @@ struct llama_mmap {
 
     void unmap_fragment(size_t first, size_t last);
 
+    // apply an access pattern hint to the mapped fragments
+    bool advise(enum llama_mmap_advice advice);
+
+    // bytes of the mapped fragments that are in RAM, and their total size
+    bool residency(size_t * resident, size_t * mapped) const;
+
     static const bool SUPPORTED;
 
 private:
@@ -10,6 +10,7 @@
 
 #include <cstddef>
 #include <map>
+#include <set>
 #include <stdexcept>
 #include <unordered_map>
 
@@ -72,6 +73,7 @@ struct llama_model_loader {
     bool check_tensors;
 
     llama_files files;
+    std::vector<std::string> file_paths; // paths of `files`, in the same order
     llama_ftype ftype;
     llama_fver  fver;
 
@@ -91,6 +93,9 @@ struct llama_model_loader {
     size_t size_data = 0;
     std::vector<std::pair<size_t, size_t>> mmaps_used;
 
+    // buffers that already hold the final tensor data, load_all_data skips their tensors
+    std::set<ggml_backend_buffer_t> bufs_preloaded;
+
     llama_model_loader(
         const std::string & fname,
         std::vector<std::string> & splits, // optional, only need if the split does not follow naming scheme
@@ -148,7 +153,7 @@ struct llama_model_loader {
 
     void done_getting_tensors() const;
 
-    void init_mappings(bool prefetch = true, llama_mlocks * mlock_mmaps = nullptr);
+    void init_mappings(bool prefetch = true, llama_mlocks * mlock_mmaps = nullptr, bool hugepages = false);
 
     void get_mapping_range(size_t * first, size_t * last, void ** addr, int idx, ggml_context * ctx) const;
 
@@ -15,6 +15,7 @@
 #include <cfloat>
 #include <cstring>
 #include <cmath>
+#include <filesystem>
 #include <functional>
 #include <map>
 #include <regex>
@@ -321,6 +322,181 @@ static buft_list_t make_cpu_buft_list(const std::vector<ggml_backend_dev_t> & de
     return buft_list;
 }
 
+//
+// CPU repack cache
+//
+
+static constexpr uint32_t LLAMA_REPACK_CACHE_MAGIC   = 0x4b505247; // "GRPK"
+static constexpr uint32_t LLAMA_REPACK_CACHE_VERSION = 1;
+static constexpr size_t   LLAMA_REPACK_CACHE_HEADER  = 4096; // keeps the data page aligned in the mapping
+
+struct llama_repack_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t size;
+};
+
+typedef ggml_backend_buffer_t (*ggml_backend_cpu_aarch64_buffer_from_ptr_t)(void * ptr, size_t size);
+
+static bool buft_is_cpu_repack(ggml_backend_buffer_type_t buft) {
+    return strcmp(ggml_backend_buft_name(buft), "CPU_AARCH64") == 0;
+}
+
+static uint64_t repack_cache_hash(uint64_t hash, const void * data, size_t size) {
+    // FNV-1a
+    const uint8_t * bytes = (const uint8_t *) data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// the cached buffer is only valid for the same tensors, source files, buffer layout and CPU features
+static uint64_t repack_cache_key(const llama_model_loader & ml, ggml_context * ctx, ggml_backend_buffer_type_t buft) {
+    uint64_t key = 0xcbf29ce484222325ULL;
+    key = repack_cache_hash(key, &LLAMA_REPACK_CACHE_VERSION, sizeof(LLAMA_REPACK_CACHE_VERSION));
+
+    ggml_backend_dev_t cpu_dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    ggml_backend_reg_t cpu_reg = cpu_dev ? ggml_backend_dev_backend_reg(cpu_dev) : nullptr;
+    auto ggml_backend_get_features_fn = cpu_reg ? (ggml_backend_get_features_t)
+        ggml_backend_reg_get_proc_address(cpu_reg, "ggml_backend_get_features") : nullptr;
+    if (ggml_backend_get_features_fn) {
+        for (auto * feature = ggml_backend_get_features_fn(cpu_reg); feature->name; ++feature) {
+            key = repack_cache_hash(key, feature->name,  strlen(feature->name));
+            key = repack_cache_hash(key, feature->value, strlen(feature->value));
+        }
+    }
+
+    const size_t alignment = ggml_backend_buft_get_alignment(buft);
+    key = repack_cache_hash(key, &alignment, sizeof(alignment));
+
+    // a source file rewritten in place keeps the offsets and often the size, so its
+    // modification time is part of the key as well
+    for (size_t i = 0; i < ml.files.size(); ++i) {
+        const size_t size = ml.files[i]->size();
+        key = repack_cache_hash(key, &size, sizeof(size));
+
+        std::error_code ec;
+        const auto mtime = std::filesystem::last_write_time(ml.file_paths.at(i), ec);
+        const int64_t ticks = ec ? 0 : (int64_t) mtime.time_since_epoch().count();
+        key = repack_cache_hash(key, &ticks, sizeof(ticks));
+    }
+
+    for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+        key = repack_cache_hash(key, t->name, strlen(t->name));
+        key = repack_cache_hash(key, &t->type, sizeof(t->type));
+        key = repack_cache_hash(key, t->ne, sizeof(t->ne));
+
+        const auto * weight = ml.get_weight(ggml_get_name(t));
+        if (weight == nullptr) {
+            continue;
+        }
+        key = repack_cache_hash(key, &weight->offs, sizeof(weight->offs));
+
+        // sample the start of the source data to catch a model rewritten in place
+        uint8_t sample[64];
+        const size_t n_sample = std::min(sizeof(sample), ggml_nbytes(t));
+        if (ml.use_mmap) {
+            memcpy(sample, (const uint8_t *) ml.mappings.at(weight->idx)->addr() + weight->offs, n_sample);
+        } else {
+            ml.files.at(weight->idx)->seek(weight->offs, SEEK_SET);
+            ml.files.at(weight->idx)->read_raw(sample, n_sample);
+        }
+        key = repack_cache_hash(key, sample, n_sample);
+    }
+
+    return key;
+}
+
+// maps the cache file and allocates the tensors of ctx in it, in the same order ggml_backend_alloc_ctx_tensors_from_buft uses
+static ggml_backend_buffer_t repack_cache_load(const char * path, uint64_t key, ggml_context * ctx, ggml_backend_buffer_type_t buft,
+                                               bool prefetch, bool hugepages, std::unique_ptr<llama_mmap> & mapping) {
+    ggml_backend_dev_t cpu_dev = ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_CPU);
+    auto buffer_from_ptr_fn = (ggml_backend_cpu_aarch64_buffer_from_ptr_t)
+        ggml_backend_reg_get_proc_address(ggml_backend_dev_backend_reg(cpu_dev), "ggml_backend_cpu_aarch64_buffer_from_ptr");
+    if (!buffer_from_ptr_fn) {
+        return nullptr;
+    }
+
+    const size_t alignment = ggml_backend_buft_get_alignment(buft);
+    size_t size_needed = 0;
+    for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+        if (t->data == nullptr && t->view_src == nullptr) {
+            size_needed += GGML_PAD(ggml_backend_buft_get_alloc_size(buft, t), alignment);
+        }
+    }
+
+    llama_repack_cache_header header = {};
+    try {
+        llama_file file(path, "rb");
+        if (file.size() < LLAMA_REPACK_CACHE_HEADER) {
+            return nullptr;
+        }
+        file.read_raw(&header, sizeof(header));
+        if (header.magic != LLAMA_REPACK_CACHE_MAGIC || header.version != LLAMA_REPACK_CACHE_VERSION || header.key != key ||
+            header.size < size_needed || file.size() != LLAMA_REPACK_CACHE_HEADER + header.size) {
+            LLAMA_LOG_INFO("%s: repack cache %s is stale, it will be rewritten\n", __func__, path);
+            return nullptr;
+        }
+        mapping = std::make_unique<llama_mmap>(&file, prefetch ? -1 : 0, false, hugepages);
+    } catch (const std::exception & err) {
+        LLAMA_LOG_DEBUG("%s: no usable repack cache: %s\n", __func__, err.what());
+        return nullptr;
+    }
+
+    ggml_backend_buffer_t buf = buffer_from_ptr_fn((uint8_t *) mapping->addr() + LLAMA_REPACK_CACHE_HEADER, header.size);
+    if (buf == nullptr) {
+        mapping.reset();
+        return nullptr;
+    }
+
+    ggml_tallocr talloc = ggml_tallocr_new(buf);
+    for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+        if (t->data == nullptr && t->view_src == nullptr) {
+            GGML_ASSERT(ggml_tallocr_alloc(&talloc, t) == GGML_STATUS_SUCCESS);
+        }
+    }
+
+    return buf;
+}
+
+static void repack_cache_save(const char * path, uint64_t key, ggml_backend_buffer_t buf) {
+    const std::string path_tmp = std::string(path) + ".tmp";
+
+    try {
+        llama_repack_cache_header header = {
+            /*.magic   =*/ LLAMA_REPACK_CACHE_MAGIC,
+            /*.version =*/ LLAMA_REPACK_CACHE_VERSION,
+            /*.key     =*/ key,
+            /*.size    =*/ ggml_backend_buffer_get_size(buf),
+        };
+        std::vector<uint8_t> header_data(LLAMA_REPACK_CACHE_HEADER, 0);
+        memcpy(header_data.data(), &header, sizeof(header));
+
+        llama_file file(path_tmp.c_str(), "wb");
+        file.write_raw(header_data.data(), header_data.size());
+        file.write_raw(ggml_backend_buffer_get_base(buf), header.size);
+    } catch (const std::exception & err) {
+        LLAMA_LOG_WARN("%s: failed to write repack cache: %s\n", __func__, err.what());
+        std::remove(path_tmp.c_str());
+        return;
+    }
+
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    std::remove(path);
+#endif
+    if (std::rename(path_tmp.c_str(), path) != 0) {
+        LLAMA_LOG_WARN("%s: failed to replace repack cache %s\n", __func__, path);
+        std::remove(path_tmp.c_str());
+        return;
+    }
+
+    LLAMA_LOG_INFO("%s: saved %.2f MiB of repacked weights to %s\n", __func__, ggml_backend_buffer_get_size(buf) / 1024.0 / 1024.0, path);
+}
+
 // GPU: split if LLAMA_SPLIT_MODE_ROW -> GPU
 static buft_list_t make_gpu_buft_list(ggml_backend_dev_t dev, llama_split_mode split_mode, const float * tensor_split) {
     buft_list_t buft_list;
@@ -4087,7 +4263,7 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
 
     ml.done_getting_tensors();
 
-    ml.init_mappings(true, use_mlock ? &pimpl->mlock_mmaps : nullptr);
+    ml.init_mappings(params.use_prefetch, use_mlock ? &pimpl->mlock_mmaps : nullptr, params.use_hugepages);
     pimpl->mappings.reserve(ml.mappings.size());
 
     // create the backend buffers
@@ -4098,6 +4274,9 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
     const size_t n_max_backend_buffer = ctx_map.size() * ml.files.size();
     pimpl->bufs.reserve(n_max_backend_buffer);
 
+    // repacked CPU buffers to write to the repack cache once their data is loaded
+    std::vector<std::pair<ggml_backend_buffer_t, uint64_t>> repack_cache_pending;
+
     for (auto & it : ctx_map) {
         ggml_backend_buffer_type_t buft = it.first;
         ggml_context * ctx              = it.second;
@@ -4121,7 +4300,34 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
         bool buffer_from_host_ptr_supported = props.caps.buffer_from_host_ptr;
         bool is_default_buft = buft == ggml_backend_dev_buffer_type(dev);
 
-        if (ml.use_mmap && use_mmap_buffer && buffer_from_host_ptr_supported && is_default_buft) {
+        // try to map the weights of the CPU repack buffer type already repacked from a previous run
+        uint64_t repack_key = 0;
+        ggml_backend_buffer_t repack_buf = nullptr;
+        if (params.repack_cache_path && buft_is_cpu_repack(buft)) {
+            repack_key = repack_cache_key(ml, ctx, buft);
+            std::unique_ptr<llama_mmap> mapping;
+            repack_buf = repack_cache_load(params.repack_cache_path, repack_key, ctx, buft,
+                                           params.use_prefetch, params.use_hugepages, mapping);
+            if (repack_buf) {
+                LLAMA_LOG_INFO("%s: using repacked weights from %s\n", __func__, params.repack_cache_path);
+                pimpl->mappings.emplace_back(std::move(mapping));
+                ml.bufs_preloaded.insert(repack_buf);
+            }
+        }
+
+        if (repack_buf) {
+            pimpl->bufs.emplace_back(repack_buf);
+            if (use_mlock) {
+                pimpl->mlock_bufs.emplace_back(new llama_mlock);
+                auto & mlock_buf = pimpl->mlock_bufs.back();
+                mlock_buf->init   (ggml_backend_buffer_get_base(repack_buf));
+                mlock_buf->grow_to(ggml_backend_buffer_get_size(repack_buf));
+            }
+            for (uint32_t idx = 0; idx < ml.files.size(); idx++) {
+                buf_map.emplace(idx, repack_buf);
+            }
+        }
+        else if (ml.use_mmap && use_mmap_buffer && buffer_from_host_ptr_supported && is_default_buft) {
             for (uint32_t idx = 0; idx < ml.files.size(); idx++) {
                 // only the mmap region containing the tensors in the model is mapped to the backend buffer
                 // this is important for metal with apple silicon: if the entire model could be mapped to a metal buffer, then we could just use metal for all layers
@@ -4156,6 +4362,9 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
             for (uint32_t idx = 0; idx < ml.files.size(); idx++) {
                 buf_map.emplace(idx, buf);
             }
+            if (params.repack_cache_path && buft_is_cpu_repack(buft)) {
+                repack_cache_pending.emplace_back(buf, repack_key);
+            }
         }
 
         if (pimpl->bufs.empty()) {
@@ -4212,6 +4421,10 @@ bool llama_model::load_tensors(llama_model_loader & ml) {
         }
     }
 
+    for (const auto & [buf, key] : repack_cache_pending) {
+        repack_cache_save(params.repack_cache_path, key, buf);
+    }
+
     return true;
 }
 
@@ -4231,6 +4444,37 @@ size_t llama_model::size() const {
     return pimpl->n_bytes;
 }
 
+bool llama_model::mmap_advise(enum llama_mmap_advice advice) const {
+    if (pimpl->mappings.empty()) {
+        return false;
+    }
+
+    bool ok = true;
+    for (const auto & mapping : pimpl->mappings) {
+        ok = mapping->advise(advice) && ok;
+    }
+    return ok;
+}
+
+bool llama_model::mmap_residency(size_t * resident, size_t * mapped) const {
+    if (pimpl->mappings.empty()) {
+        return false;
+    }
+
+    *resident = 0;
+    *mapped   = 0;
+    for (const auto & mapping : pimpl->mappings) {
+        size_t mapping_resident = 0;
+        size_t mapping_mapped   = 0;
+        if (!mapping->residency(&mapping_resident, &mapping_mapped)) {
+            return false;
+        }
+        *resident += mapping_resident;
+        *mapped   += mapping_mapped;
+    }
+    return true;
+}
+
 size_t llama_model::n_tensors() const {
     return tensors_by_name.size();
 }
@@ -13163,10 +13407,13 @@ llama_model_params llama_model_default_params() {
         /*.progress_callback           =*/ nullptr,
         /*.progress_callback_user_data =*/ nullptr,
         /*.kv_overrides                =*/ nullptr,
+        /*.repack_cache_path           =*/ nullptr,
         /*.vocab_only                  =*/ false,
         /*.use_mmap                    =*/ true,
         /*.use_mlock                   =*/ false,
         /*.check_tensors               =*/ false,
+        /*.use_prefetch                =*/ true,
+        /*.use_hugepages               =*/ false,
     };
 
 #ifdef GGML_USE_METAL
@@ -13368,6 +13615,14 @@ uint64_t llama_model_size(const llama_model * model) {
     return model->size();
 }
 
+bool llama_model_mmap_advise(const llama_model * model, llama_mmap_advice advice) {
+    return model->mmap_advise(advice);
+}
+
+bool llama_model_mmap_residency(const llama_model * model, size_t * resident, size_t * mapped) {
+    return model->mmap_residency(resident, mapped);
+}
+
 const char * llama_model_chat_template(const llama_model * model, const char * name) {
     const auto key = name ? LLM_KV(model->arch, name)(LLM_KV_TOKENIZER_CHAT_TEMPLATE_N)
         : LLM_KV(model->arch)(LLM_KV_TOKENIZER_CHAT_TEMPLATE);
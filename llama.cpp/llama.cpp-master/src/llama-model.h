@@ -385,6 +385,12 @@ struct llama_model {
     // total number of parameters in the model
     uint64_t n_elements() const;
 
+    // apply an access pattern hint to the memory-mapped weights
+    bool mmap_advise(enum llama_mmap_advice advice) const;
+
+    // bytes of the memory-mapped weights in RAM, and mapped in total
+    bool mmap_residency(size_t * resident, size_t * mapped) const;
+
     void print_info() const;
 
     ggml_backend_dev_t dev_layer(int il) const;
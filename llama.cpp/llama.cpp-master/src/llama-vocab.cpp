@@ -6,6 +6,7 @@
 #include "unicode.h"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cfloat>
 #include <climits>
@@ -102,16 +103,101 @@ struct llm_bigram_spm {
     llm_symbol::index right;
     float score;
     size_t size;
+    llama_token token;
 };
 
 struct llm_tokenizer_spm : llm_tokenizer {
-    llm_tokenizer_spm(const llama_vocab & /*vocab*/) {}
+    llm_tokenizer_spm(const llama_vocab & vocab) {
+        // single-byte symbols are looked up in a table instead of the string map
+        for (int c = 0; c < 256; ++c) {
+            byte_tokens[c] = vocab.text_to_token(std::string(1, (char) c));
+        }
+
+        // every way to write a token as the concatenation of two other tokens, keyed by the
+        // ids of the two halves, so that merging two symbols is a lookup on their token ids
+        std::vector<std::pair<uint64_t, llama_token>> merges;
+        for (uint32_t id = 0; id < vocab.n_tokens(); ++id) {
+            const std::string & text = vocab.get_token_data(id).text;
+            if (text.size() < 2 || vocab.text_to_token(text) != (llama_token) id) {
+                continue; // duplicate texts merge into the id the string map resolves to
+            }
+            for (size_t split = 1; split < text.size(); ++split) {
+                const llama_token left = vocab.text_to_token(text.substr(0, split));
+                if (left == LLAMA_TOKEN_NULL) {
+                    continue;
+                }
+                const llama_token right = vocab.text_to_token(text.substr(split));
+                if (right == LLAMA_TOKEN_NULL) {
+                    continue;
+                }
+                merges.emplace_back(merge_key(left, right), id);
+            }
+        }
+
+        // open addressing with linear probing, at most half full
+        size_t capacity = 16;
+        while (capacity < 2*merges.size()) {
+            capacity *= 2;
+        }
+        merge_mask = capacity - 1;
+        merge_keys.assign(capacity, merge_empty);
+        merge_tokens.assign(capacity, LLAMA_TOKEN_NULL);
+        for (const auto & merge : merges) {
+            size_t i = merge_slot(merge.first);
+            while (merge_keys[i] != merge_empty) {
+                i = (i + 1) & merge_mask;
+            }
+            merge_keys[i]   = merge.first;
+            merge_tokens[i] = merge.second;
+        }
+    }
+
+    // the token whose text is the text of `left` followed by the text of `right`, if any
+    llama_token merge(llama_token left, llama_token right) const {
+        const uint64_t key = merge_key(left, right);
+        for (size_t i = merge_slot(key); ; i = (i + 1) & merge_mask) {
+            if (merge_keys[i] == key) {
+                return merge_tokens[i];
+            }
+            if (merge_keys[i] == merge_empty) {
+                return LLAMA_TOKEN_NULL;
+            }
+        }
+    }
+
+    llama_token byte_token(uint8_t c) const {
+        return byte_tokens[c];
+    }
+
+private:
+    static constexpr uint64_t merge_empty = UINT64_MAX;
+
+    static uint64_t merge_key(llama_token left, llama_token right) {
+        return ((uint64_t) (uint32_t) left << 32) | (uint32_t) right;
+    }
+
+    size_t merge_slot(uint64_t key) const {
+        return (size_t) ((key * 0x9E3779B97F4A7C15ull) >> 32) & merge_mask;
+    }
+
+    std::array<llama_token, 256> byte_tokens;
+
+    size_t merge_mask = 0;
+    std::vector<uint64_t>    merge_keys;
+    std::vector<llama_token> merge_tokens;
 };
 
+// the session keeps its buffers between calls, so a session reused for the fragments of a
+// text does not allocate per fragment, and merging symbols does not allocate at all
 struct llm_tokenizer_spm_session {
-    llm_tokenizer_spm_session(const llama_vocab & vocab) : vocab(vocab) {}
+    llm_tokenizer_spm_session(const llama_vocab & vocab, const llm_tokenizer_spm & tokenizer) : vocab(vocab), tokenizer(tokenizer) {}
 
     void tokenize(const std::string & text, std::vector<llama_token> & output) {
+        symbols.clear();
+        symbol_tokens.clear();
+        symbols.reserve(text.size());
+        symbol_tokens.reserve(text.size());
+
         // split string into utf8 chars
         int index = 0;
         size_t offs = 0;
@@ -125,6 +211,7 @@ struct llm_tokenizer_spm_session {
             sym.next = offs == text.size() ? -1 : index + 1;
             index++;
             symbols.emplace_back(sym);
+            symbol_tokens.push_back(sym.n == 1 ? tokenizer.byte_token(sym.text[0]) : vocab.text_to_token(std::string(sym.text, sym.n)));
         }
 
         // seed the work queue with all possible 2-character tokens.
@@ -149,6 +236,7 @@ struct llm_tokenizer_spm_session {
             // merge the right sym into the left one
             left_sym.n += right_sym.n;
             right_sym.n = 0;
+            symbol_tokens[bigram.left] = bigram.token;
 
             //LLAMA_LOG_INFO("left = '%*s' size = %zu\n", (int) left_sym.n, left_sym.text, bigram.size);
 
@@ -164,15 +252,13 @@ struct llm_tokenizer_spm_session {
         }
 
         for (int i = 0; i != -1; i = symbols[i].next) {
-            auto & symbol = symbols[i];
-            resegment(symbol, output);
+            resegment(i, output);
         }
     }
 
 private:
-    void resegment(llm_symbol & symbol, std::vector<llama_token> & output) {
-        auto text = std::string(symbol.text, symbol.n);
-        auto token = vocab.text_to_token(text);
+    void resegment(int index, std::vector<llama_token> & output) {
+        const llama_token token = symbol_tokens[index];
 
         // Do we need to support is_unused?
         if (token != LLAMA_TOKEN_NULL) {
@@ -180,28 +266,29 @@ private:
             return;
         }
 
-        const auto p = rev_merge.find(text);
-
-        if (p == rev_merge.end()) {
-            // output any symbols that did not form tokens as bytes.
-            output.reserve(output.size() + symbol.n);
-            for (int j = 0; j < (int)symbol.n; ++j) {
-                llama_token id = vocab.byte_to_token(symbol.text[j]);
-                output.push_back(id);
-            }
-            return;
+        // merged symbols are always tokens, so this is a single character that is not one:
+        // output it as bytes
+        const auto & symbol = symbols[index];
+        output.reserve(output.size() + symbol.n);
+        for (int j = 0; j < (int)symbol.n; ++j) {
+            llama_token id = vocab.byte_to_token(symbol.text[j]);
+            output.push_back(id);
         }
-
-        resegment(symbols[p->second.first], output);
-        resegment(symbols[p->second.second], output);
     }
 
     void try_add_bigram(int left, int right) {
         if (left == -1 || right == -1) {
             return;
         }
-        const std::string text = std::string(symbols[left].text, symbols[left].n + symbols[right].n);
-        auto token = vocab.text_to_token(text);
+        const size_t size = symbols[left].n + symbols[right].n;
+
+        // a character that is not a token itself can only be merged by its text
+        llama_token token;
+        if (symbol_tokens[left] != LLAMA_TOKEN_NULL && symbol_tokens[right] != LLAMA_TOKEN_NULL) {
+            token = tokenizer.merge(symbol_tokens[left], symbol_tokens[right]);
+        } else {
+            token = vocab.text_to_token(std::string(symbols[left].text, size));
+        }
 
         if (token == LLAMA_TOKEN_NULL) {
             return;
@@ -217,21 +304,18 @@ private:
         bigram.left  = left;
         bigram.right = right;
         bigram.score = tok_data.score;
-        bigram.size  = text.size();
+        bigram.size  = size;
+        bigram.token = token;
 
         work_queue.push(bigram);
-
-        // Do we need to support is_unused?
-        rev_merge[text] = std::make_pair(left, right);
     }
 
     const llama_vocab & vocab;
-    // currently unused
-    // const llm_tokenizer_spm * spm_tokenizer;
+    const llm_tokenizer_spm & tokenizer;
 
     std::vector<llm_symbol> symbols;
+    std::vector<llama_token> symbol_tokens; // token of each symbol's text, LLAMA_TOKEN_NULL if none
     llm_bigram_spm::queue work_queue;
-    std::map<std::string, std::pair<int, int>> rev_merge;
 };
 
 //
@@ -2385,6 +2469,8 @@ std::vector<llama_token> llama_vocab::impl::tokenize(
 
                 bool is_prev_special = true;  // prefix with space if first token
 
+                llm_tokenizer_spm_session session(vocab, *static_cast<const llm_tokenizer_spm *>(tokenizer.get()));
+
                 if (add_special && add_bos) {
                     GGML_ASSERT(special_bos_id != LLAMA_TOKEN_NULL);
                     output.push_back(special_bos_id);
@@ -2406,7 +2492,6 @@ std::vector<llama_token> llama_vocab::impl::tokenize(
                         LLAMA_LOG_WARN("TT: (%ld %ld %ld) '%s'\n", text.length(), fragment.offset, fragment.length, text.c_str());
 #endif
                         llama_escape_whitespace(text);
-                        llm_tokenizer_spm_session session(vocab);
                         session.tokenize(text, output);
                         is_prev_special = false;
                     } else { // if (fragment.type == FRAGMENT_BUFFER_VARIANT_TYPE_TOKEN)
@@ -4249,6 +4249,13 @@ static std::vector<std::unique_ptr<test_case>> make_test_cases_eval() {
             test_cases.emplace_back(new test_mul_mat(type_a, type_b, 16, 1, 256, {1,  1}, {1, 1}));
         }
     }
+    // prompt-sized K-quant batches, with ragged edges on both sides of the CPU sgemm tiles
+    for (ggml_type type_a : {GGML_TYPE_Q5_K, GGML_TYPE_Q6_K}) {
+        for (int n : {2, 7, 33}) {
+            test_cases.emplace_back(new test_mul_mat(type_a, GGML_TYPE_F32, 19, n, 512, {1,  1}, {1, 1}));
+            test_cases.emplace_back(new test_mul_mat(type_a, GGML_TYPE_F32, 64, n, 512, {3,  1}, {1, 1}));
+        }
+    }
 #else
     // m = a rows
     // n = b rows
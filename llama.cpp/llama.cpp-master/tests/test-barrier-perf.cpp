@@ -0,0 +1,95 @@
+// Throughput of ggml_barrier with more threads than cores: the hybrid spin/park barrier
+// (default polling) against the pure spin barrier (polling level 100)
+
+#include "ggml.h"
+#include "ggml-cpu.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static double bench(struct ggml_cgraph * gf, int n_threads, uint32_t poll, int n_rounds) {
+    struct ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+    tpp.poll = poll;
+
+    struct ggml_threadpool * threadpool = ggml_threadpool_new(&tpp);
+    if (!threadpool) {
+        fprintf(stderr, "threadpool create failed : n_threads %d\n", n_threads);
+        exit(1);
+    }
+
+    struct ggml_cplan cplan = ggml_graph_plan(gf, n_threads, threadpool);
+
+    std::vector<uint8_t> work_data(cplan.work_size);
+    cplan.work_data = work_data.data();
+
+    // Warmup
+    ggml_graph_compute(gf, &cplan);
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+
+    for (int i = 0; i < n_rounds; i++) {
+        ggml_graph_compute(gf, &cplan);
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    ggml_threadpool_free(threadpool);
+
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / n_rounds;
+}
+
+int main(int argc, char *argv[]) {
+
+    int n_cores  = (int) std::thread::hardware_concurrency();
+    int n_rounds = 10;
+
+    if (argc > 1) {
+        n_cores  = std::atoi(argv[1]);
+    }
+
+    if (argc > 2) {
+        n_rounds = std::atoi(argv[2]);
+    }
+
+    struct ggml_init_params params = {
+        /* .mem_size   = */ 256*1024*1024,
+        /* .mem_buffer = */ NULL,
+        /* .no_alloc   = */ false,
+    };
+
+    struct ggml_context * ctx = ggml_init(params);
+
+    // Lots of small, parallel ops where barriers in between will dominate
+    struct ggml_cgraph * gf = ggml_new_graph(ctx);
+
+    struct ggml_tensor * out = ggml_new_tensor_1d(ctx, GGML_TYPE_F32,  64);
+    for (int i = 0; i < 500; i++) {
+        struct ggml_tensor * a = ggml_new_tensor_2d(ctx, GGML_TYPE_Q4_0, 64, 128);
+        out = ggml_mul_mat(ctx, a, out);
+
+        struct ggml_tensor * d = ggml_new_tensor_2d(ctx, GGML_TYPE_Q4_0, 128, 64);
+        out = ggml_mul_mat(ctx, d, out);
+    }
+
+    ggml_build_forward_expand(gf, out);
+    const int n_nodes = ggml_graph_n_nodes(gf);
+
+    fprintf(stderr, "graph-compute with %d nodes, %d cores, %d rounds\n", n_nodes, n_cores, n_rounds);
+    fprintf(stderr, "%8s %8s %16s %16s %8s\n", "oversub", "threads", "spin us/iter", "hybrid us/iter", "speedup");
+
+    for (int oversub : { 1, 2, 4 }) {
+        const int n_threads = oversub * n_cores;
+
+        const double t_spin   = bench(gf, n_threads, 100, n_rounds);
+        const double t_hybrid = bench(gf, n_threads,  50, n_rounds);
+
+        fprintf(stderr, "%7dx %8d %16.1f %16.1f %7.2fx\n", oversub, n_threads, t_spin, t_hybrid, t_spin / t_hybrid);
+    }
+
+    ggml_free(ctx);
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Benchmark the small-batch Q4_K matrix multiplication of the CPU backend: the repacked
+// CPU_AARCH64 kernels against the same graph on an unrepacked buffer, for 1 to 4 columns
+// of src1. llamafile_sgemm has no Q4_K kernel, so the unrepacked graph runs vec_dot.
+
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4244 4267) // possible loss of data
+#endif
+
+#define WARMUP 3
+
+static ggml_backend_buffer_type_t find_extra_buft(ggml_backend_dev_t dev, const char * name) {
+    ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(dev);
+    auto get_extra_bufts = (ggml_backend_dev_get_extra_bufts_t)
+        ggml_backend_reg_get_proc_address(reg, "ggml_backend_dev_get_extra_bufts");
+    if (!get_extra_bufts) {
+        return nullptr;
+    }
+    for (ggml_backend_buffer_type_t * buft = get_extra_bufts(dev); buft && *buft; ++buft) {
+        if (strcmp(ggml_backend_buft_name(*buft), name) == 0) {
+            return *buft;
+        }
+    }
+    return nullptr;
+}
+
+static double nmse(const std::vector<float> & a, const std::vector<float> & b) {
+    double err = 0.0;
+    double ref = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        err += (a[i] - b[i]) * (a[i] - b[i]);
+        ref += b[i] * b[i];
+    }
+    return err / ref;
+}
+
+int main(int argc, char ** argv) {
+    int64_t ne00       = 4096;
+    int64_t ne01       = 4096;
+    int     n_threads  = 1;
+    int     iterations = 20;
+
+    if (argc > 1) {
+        ne00 = std::atoll(argv[1]);
+    }
+    if (argc > 2) {
+        ne01 = std::atoll(argv[2]);
+    }
+    if (argc > 3) {
+        n_threads = std::atoi(argv[3]);
+    }
+    if (argc > 4) {
+        iterations = std::atoi(argv[4]);
+    }
+
+    if (ne00 % ggml_blck_size(GGML_TYPE_Q4_K) != 0 || ne01 % 8 != 0) {
+        fprintf(stderr, "usage: %s [ne00 (multiple of 256)] [ne01 (multiple of 8)] [n_threads] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    ggml_backend_cpu_set_n_threads(backend, n_threads);
+
+    ggml_backend_buffer_type_t repack_buft = find_extra_buft(ggml_backend_get_device(backend), "CPU_AARCH64");
+    if (!repack_buft) {
+        printf("CPU_AARCH64 buffer type not available, skipping\n");
+        ggml_backend_free(backend);
+        return 0;
+    }
+
+    const int max_cols = 4;
+
+    ggml_init_params params = {
+        /* .mem_size   = */ ggml_tensor_overhead() * 64 + ggml_graph_overhead() * max_cols * 2,
+        /* .mem_buffer = */ NULL,
+        /* .no_alloc   = */ true,
+    };
+    ggml_context * ctx_repack = ggml_init(params);
+    ggml_context * ctx        = ggml_init(params);
+
+    ggml_tensor * w_repack = ggml_new_tensor_2d(ctx_repack, GGML_TYPE_Q4_K, ne00, ne01);
+    ggml_tensor * w_ref    = ggml_new_tensor_2d(ctx,        GGML_TYPE_Q4_K, ne00, ne01);
+
+    ggml_tensor * x[max_cols];
+    ggml_tensor * out_repack[max_cols];
+    ggml_tensor * out_ref[max_cols];
+    for (int n = 1; n <= max_cols; n++) {
+        x[n - 1]          = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, ne00, n);
+        out_repack[n - 1] = ggml_mul_mat(ctx, w_repack, x[n - 1]);
+        out_ref[n - 1]    = ggml_mul_mat(ctx, w_ref,    x[n - 1]);
+    }
+
+    ggml_backend_buffer_t buf_repack = ggml_backend_alloc_ctx_tensors_from_buft(ctx_repack, repack_buft);
+    ggml_backend_buffer_t buf        = ggml_backend_alloc_ctx_tensors(ctx, backend);
+
+    // Synthetic weights and activations
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    std::vector<float> data(ne00 * ne01);
+    for (float & v : data) {
+        v = dist(rng);
+    }
+    std::vector<uint8_t> wq(ggml_row_size(GGML_TYPE_Q4_K, ne00) * ne01);
+    ggml_quantize_chunk(GGML_TYPE_Q4_K, data.data(), wq.data(), 0, ne01, ne00, nullptr);
+    ggml_backend_tensor_set(w_repack, wq.data(), 0, wq.size());
+    ggml_backend_tensor_set(w_ref,    wq.data(), 0, wq.size());
+
+    for (int n = 1; n <= max_cols; n++) {
+        std::vector<float> xd(ne00 * n);
+        for (float & v : xd) {
+            v = dist(rng);
+        }
+        ggml_backend_tensor_set(x[n - 1], xd.data(), 0, xd.size() * sizeof(float));
+    }
+
+    const double weight_gb = ggml_nbytes(w_ref) / 1e9;
+
+    printf("Q4_K x F32: ne00 = %lld, ne01 = %lld, %.1f MiB of weights, %d threads, %d iterations\n",
+           (long long) ne00, (long long) ne01, ggml_nbytes(w_ref) / 1024.0 / 1024.0, n_threads, iterations);
+    printf("%4s %17s %10s %16s %10s %10s\n", "n", "unrepacked min us", "GB/s", "repacked min us", "GB/s", "nmse");
+
+    bool ok = true;
+
+    for (int n = 1; n <= max_cols; n++) {
+        double us[2];
+        std::vector<float> result[2];
+
+        ggml_tensor * outs[2] = { out_ref[n - 1], out_repack[n - 1] };
+        for (int k = 0; k < 2; k++) {
+            ggml_cgraph * gf = ggml_new_graph(ctx);
+            ggml_build_forward_expand(gf, outs[k]);
+
+            for (int i = 0; i < WARMUP; i++) {
+                ggml_backend_graph_compute(backend, gf);
+            }
+
+            // best of the iterations, which is the least disturbed by other load on the machine
+            us[k] = INFINITY;
+            for (int i = 0; i < iterations; i++) {
+                const auto t0 = std::chrono::high_resolution_clock::now();
+                ggml_backend_graph_compute(backend, gf);
+                const auto t1 = std::chrono::high_resolution_clock::now();
+
+                us[k] = std::min(us[k], std::chrono::duration<double, std::micro>(t1 - t0).count());
+            }
+
+            result[k].resize(ggml_nelements(outs[k]));
+            ggml_backend_tensor_get(outs[k], result[k].data(), 0, ggml_nbytes(outs[k]));
+        }
+
+        const double err = nmse(result[1], result[0]);
+        ok = ok && err < 1e-6;
+
+        printf("%4d %17.1f %10.2f %16.1f %10.2f %10.2e%s\n", n,
+               us[0], weight_gb / (us[0] * 1e-6),
+               us[1], weight_gb / (us[1] * 1e-6), err, err < 1e-6 ? "" : "  FAIL");
+    }
+
+    ggml_backend_buffer_free(buf);
+    ggml_backend_buffer_free(buf_repack);
+    ggml_free(ctx);
+    ggml_free(ctx_repack);
+    ggml_backend_free(backend);
+
+    return ok ? 0 : 1;
+}
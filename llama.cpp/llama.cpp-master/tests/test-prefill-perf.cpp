@@ -0,0 +1,165 @@
+// Benchmark prompt-sized K-quant matrix multiplications of the CPU backend: the graph path, which
+// goes through the llamafile sgemm kernels when they are built in, against a plain vec_dot loop
+// over the same Q8_K activations
+
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+#include "ggml-cpu.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER)
+#pragma warning(disable: 4244 4267) // possible loss of data
+#endif
+
+#define WARMUP 2
+
+static double nmse(const std::vector<float> & a, const std::vector<float> & b) {
+    double err = 0.0;
+    double ref = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        err += (a[i] - b[i]) * (a[i] - b[i]);
+        ref += b[i] * b[i];
+    }
+    return err / ref;
+}
+
+// dst[j*ne01 + i] = src0 row i . src1 column j, one row at a time
+static void mul_mat_vec_dot(ggml_type type, int64_t ne00, int64_t ne01, int64_t n,
+                            const uint8_t * wq, const uint8_t * xq, float * dst) {
+    const auto * traits = ggml_get_type_traits_cpu(type);
+    const size_t w_row  = ggml_row_size(type, ne00);
+    const size_t x_row  = ggml_row_size(traits->vec_dot_type, ne00);
+
+    for (int64_t j = 0; j < n; j++) {
+        for (int64_t i = 0; i < ne01; i++) {
+            traits->vec_dot(ne00, dst + j*ne01 + i, 0, wq + i*w_row, 0, xq + j*x_row, 0, 1);
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    int64_t ne00       = 2048;
+    int64_t ne01       = 2048;
+    int     n_threads  = 1;
+    int     iterations = 5;
+
+    if (argc > 1) {
+        ne00 = std::atoll(argv[1]);
+    }
+    if (argc > 2) {
+        ne01 = std::atoll(argv[2]);
+    }
+    if (argc > 3) {
+        n_threads = std::atoi(argv[3]);
+    }
+    if (argc > 4) {
+        iterations = std::atoi(argv[4]);
+    }
+
+    if (ne00 % ggml_blck_size(GGML_TYPE_Q5_K) != 0) {
+        fprintf(stderr, "usage: %s [ne00 (multiple of 256)] [ne01] [n_threads] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    ggml_backend_cpu_set_n_threads(backend, n_threads);
+
+    const ggml_type types[] = { GGML_TYPE_Q5_K, GGML_TYPE_Q6_K };
+    const int       batch[] = { 8, 32, 128 };
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    std::vector<float> data(ne00 * ne01);
+    for (float & v : data) {
+        v = dist(rng);
+    }
+
+    printf("K-quant x F32: ne00 = %lld, ne01 = %lld, %d threads, %d iterations\n",
+           (long long) ne00, (long long) ne01, n_threads, iterations);
+    printf("%6s %5s %16s %10s %16s %10s %10s\n", "type", "n", "vec_dot min us", "GFLOPS", "graph min us", "GFLOPS", "nmse");
+
+    bool ok = true;
+
+    for (ggml_type type : types) {
+        const ggml_type vec_dot_type = ggml_get_type_traits_cpu(type)->vec_dot_type;
+
+        std::vector<uint8_t> wq(ggml_row_size(type, ne00) * ne01);
+        ggml_quantize_chunk(type, data.data(), wq.data(), 0, ne01, ne00, nullptr);
+
+        for (int n : batch) {
+            ggml_init_params params = {
+                /* .mem_size   = */ ggml_tensor_overhead() * 8 + ggml_graph_overhead(),
+                /* .mem_buffer = */ NULL,
+                /* .no_alloc   = */ true,
+            };
+            ggml_context * ctx = ggml_init(params);
+
+            ggml_tensor * w   = ggml_new_tensor_2d(ctx, type,          ne00, ne01);
+            ggml_tensor * x   = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, ne00, n);
+            ggml_tensor * out = ggml_mul_mat(ctx, w, x);
+
+            ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors(ctx, backend);
+
+            std::vector<float> xd(ne00 * n);
+            for (float & v : xd) {
+                v = dist(rng);
+            }
+            ggml_backend_tensor_set(w, wq.data(), 0, wq.size());
+            ggml_backend_tensor_set(x, xd.data(), 0, xd.size() * sizeof(float));
+
+            // the graph quantizes src1 the same way before it multiplies
+            std::vector<uint8_t> xq(ggml_row_size(vec_dot_type, ne00) * n);
+            for (int j = 0; j < n; j++) {
+                ggml_get_type_traits_cpu(vec_dot_type)->from_float(xd.data() + j*ne00,
+                        xq.data() + j*ggml_row_size(vec_dot_type, ne00), ne00);
+            }
+
+            ggml_cgraph * gf = ggml_new_graph(ctx);
+            ggml_build_forward_expand(gf, out);
+
+            std::vector<float> result[2];
+            result[0].resize(ne01 * n);
+            result[1].resize(ne01 * n);
+
+            // best of the iterations, which is the least disturbed by other load on the machine
+            double us[2] = { INFINITY, INFINITY };
+            for (int i = 0; i < WARMUP + iterations; i++) {
+                const auto t0 = std::chrono::high_resolution_clock::now();
+                mul_mat_vec_dot(type, ne00, ne01, n, wq.data(), xq.data(), result[0].data());
+                const auto t1 = std::chrono::high_resolution_clock::now();
+                ggml_backend_graph_compute(backend, gf);
+                const auto t2 = std::chrono::high_resolution_clock::now();
+
+                if (i >= WARMUP) {
+                    us[0] = std::min(us[0], std::chrono::duration<double, std::micro>(t1 - t0).count());
+                    us[1] = std::min(us[1], std::chrono::duration<double, std::micro>(t2 - t1).count());
+                }
+            }
+            ggml_backend_tensor_get(out, result[1].data(), 0, ggml_nbytes(out));
+
+            const double err   = nmse(result[1], result[0]);
+            const double flops = 2.0 * ne00 * ne01 * n;
+            ok = ok && err < 1e-6;
+
+            printf("%6s %5d %16.1f %10.2f %16.1f %10.2f %10.2e%s\n", ggml_type_name(type), n,
+                   us[0], flops / (us[0] * 1e3),
+                   us[1], flops / (us[1] * 1e3), err, err < 1e-6 ? "" : "  FAIL");
+
+            ggml_backend_buffer_free(buf);
+            ggml_free(ctx);
+        }
+    }
+
+    ggml_backend_free(backend);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#include "decode_arena.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef TEXTMASTER_COUNT_ALLOCATIONS
+// Opt-in builds (cmake -DTEXTMASTER_COUNT_ALLOCATIONS=ON) count every operator new per
+// thread, so a decode loop can check that its steady state stays allocation free. Every
+// replaceable form is covered so that no allocation bypasses the count.
+namespace {
+thread_local quint64 g_threadAllocations = 0;
+
+void* countedAlloc(std::size_t size, std::size_t alignment = 0) noexcept
+{
+    ++g_threadAllocations;
+    size = size ? size : 1;
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    // aligned_alloc wants a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+void* countedAllocOrThrow(std::size_t size, std::size_t alignment = 0)
+{
+    if (void* ptr = countedAlloc(size, alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void alignedFree(void* ptr) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+}
+
+void* operator new(std::size_t size) { return countedAllocOrThrow(size); }
+void* operator new[](std::size_t size) { return countedAllocOrThrow(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return countedAllocOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return countedAllocOrThrow(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAlloc(size, static_cast<std::size_t>(alignment));
+}
+// Over-aligned requests at or below max_align_t came from malloc, the others from the
+// aligned allocator
+void operator delete(void* ptr, std::align_val_t alignment) noexcept
+{
+    static_cast<std::size_t>(alignment) <= alignof(std::max_align_t) ? std::free(ptr) : alignedFree(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+void operator delete(void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    operator delete(ptr, alignment);
+}
+void operator delete[](void* ptr, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    operator delete(ptr, alignment);
+}
+#endif
+
+DecodeArena::~DecodeArena()
+{
+    if (m_capacity > 0) {
+        llama_batch_free(m_batch);
+    }
+}
+
+void DecodeArena::reserve(int capacity)
+{
+    if (capacity <= m_capacity) {
+        return;
+    }
+
+    if (m_capacity > 0) {
+        llama_batch_free(m_batch);
+    }
+    m_batch = llama_batch_init(capacity, 0, 1);
+    m_capacity = capacity;
+    m_responseTokens.reserve(capacity);
+}
+
+llama_batch& DecodeArena::fill(llama_seq_id seq, const llama_token* tokens, int count, llama_pos pos, bool logitsLast)
+{
+    Q_ASSERT(count <= m_capacity);
+
+    for (int i = 0; i < count; i++) {
+        m_batch.token[i] = tokens[i];
+        m_batch.pos[i] = pos + i;
+        m_batch.n_seq_id[i] = 1;
+        m_batch.seq_id[i][0] = seq;
+        m_batch.logits[i] = false;
+    }
+    if (logitsLast && count > 0) {
+        m_batch.logits[count - 1] = true;
+    }
+    m_batch.n_tokens = count;
+    return m_batch;
+}
+
+quint64 DecodeArena::threadAllocations()
+{
+#ifdef TEXTMASTER_COUNT_ALLOCATIONS
+    return g_threadAllocations;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,42 @@
+#ifndef DECODE_ARENA_H
+#define DECODE_ARENA_H
+
+#include <QtGlobal>
+#include <vector>
+
+#include "llama.h"
+
+// Batch and token storage for one llama context, sized once for the whole context window
+// and reused by every decode step and request, so steady-state generation does not touch
+// the heap.
+class DecodeArena
+{
+public:
+    DecodeArena() = default;
+    ~DecodeArena();
+
+    DecodeArena(const DecodeArena&) = delete;
+    DecodeArena& operator=(const DecodeArena&) = delete;
+
+    // Grows the buffers to hold `capacity` tokens; a no-op when they are large enough
+    void reserve(int capacity);
+    int capacity() const { return m_capacity; }
+
+    // Fills the batch with `count` consecutive tokens of one sequence starting at `pos`.
+    // Only the last token requests logits when `logitsLast` is set.
+    llama_batch& fill(llama_seq_id seq, const llama_token* tokens, int count, llama_pos pos, bool logitsLast);
+
+    // Scratch buffer for the tokens sampled by the running request
+    std::vector<llama_token>& responseTokens() { return m_responseTokens; }
+
+    // Heap allocations made so far by the calling thread; always 0 unless the build
+    // counts them (TEXTMASTER_COUNT_ALLOCATIONS)
+    static quint64 threadAllocations();
+
+private:
+    llama_batch m_batch{};
+    int m_capacity = 0;
+    std::vector<llama_token> m_responseTokens;
+};
+
+#endif // DECODE_ARENA_H
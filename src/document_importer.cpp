@@ -0,0 +1,175 @@
+#include "document_importer.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringDecoder>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Bytes decoded per step, and the sample encodings without a byte order mark are guessed from
+constexpr qint64 kDecodeChunk = 4 * 1024 * 1024;
+constexpr qint64 kSniffBytes = 1024 * 1024;
+
+struct Encoding {
+    QStringConverter::Encoding encoding;
+    int bomBytes;
+};
+
+Encoding detectEncoding(const uchar* data, qint64 size)
+{
+    auto startsWith = [&](std::initializer_list<uchar> bom) {
+        return size >= static_cast<qint64>(bom.size()) && std::equal(bom.begin(), bom.end(), data);
+    };
+    if (startsWith({0xEF, 0xBB, 0xBF})) {
+        return {QStringConverter::Utf8, 3};
+    }
+    if (startsWith({0xFF, 0xFE, 0x00, 0x00})) {
+        return {QStringConverter::Utf32LE, 4};
+    }
+    if (startsWith({0x00, 0x00, 0xFE, 0xFF})) {
+        return {QStringConverter::Utf32BE, 4};
+    }
+    if (startsWith({0xFF, 0xFE})) {
+        return {QStringConverter::Utf16LE, 2};
+    }
+    if (startsWith({0xFE, 0xFF})) {
+        return {QStringConverter::Utf16BE, 2};
+    }
+
+    // UTF-16 text without a mark has a zero in every other byte of its ASCII characters
+    const qint64 sample = std::min(size, kSniffBytes);
+    qint64 evenZeros = 0;
+    qint64 oddZeros = 0;
+    for (qint64 i = 0; i < sample; i++) {
+        if (data[i] == 0) {
+            (i % 2 == 0 ? evenZeros : oddZeros)++;
+        }
+    }
+    if (oddZeros > sample / 4 && evenZeros < sample / 64) {
+        return {QStringConverter::Utf16LE, 0};
+    }
+    if (evenZeros > sample / 4 && oddZeros < sample / 64) {
+        return {QStringConverter::Utf16BE, 0};
+    }
+
+    // Anything that is not valid UTF-8 is most likely a single-byte code page. The sample
+    // may end inside a character, which a stateful decoder keeps for the bytes to come
+    // rather than counting it as an error.
+    QStringDecoder utf8(QStringConverter::Utf8);
+    QString ignored = utf8.decode(QByteArrayView(data, sample));
+    Q_UNUSED(ignored);
+    if (utf8.hasError()) {
+        return {QStringConverter::Latin1, 0};
+    }
+    return {QStringConverter::Utf8, 0};
+}
+
+QString encodingName(QStringConverter::Encoding encoding)
+{
+    const char* name = QStringConverter::nameForEncoding(encoding);
+    return name ? QString::fromLatin1(name) : QString("unknown");
+}
+
+// Unix line ends, no NULs or stray control characters; page breaks become paragraph
+// breaks. `pendingCR` carries a CR at the end of one chunk over to the next.
+int normalizeInto(QString& out, const QString& chunk, bool& pendingCR, bool& inWord)
+{
+    int words = 0;
+    for (const QChar c : chunk) {
+        const char16_t u = c.unicode();
+        if (pendingCR) {
+            pendingCR = false;
+            out += u'\n';
+            if (u == u'\n') {
+                continue;
+            }
+        }
+        if (u == u'\r') {
+            pendingCR = true;
+            inWord = false;
+            continue;
+        }
+        if (u == u'\f') {
+            out += QStringLiteral("\n\n");
+            inWord = false;
+            continue;
+        }
+        if (u < 0x20 && u != u'\n' && u != u'\t') {
+            continue;
+        }
+        if (u == 0xFEFF) {
+            continue;
+        }
+        const bool space = c.isSpace();
+        if (!space && !inWord) {
+            words++;
+        }
+        inWord = !space;
+        out += c;
+    }
+    return words;
+}
+
+}
+
+ImportedDocument DocumentImporter::import(const QString& path, const std::function<void(qint64, qint64)>& progress)
+{
+    ImportedDocument document;
+    document.path = path;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        document.error = file.errorString();
+        return document;
+    }
+    document.bytes = file.size();
+    if (document.bytes == 0) {
+        document.encoding = encodingName(QStringConverter::Utf8);
+        return document;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const uchar* data = file.map(0, document.bytes);
+    if (!data) {
+        document.error = "Could not map the file: " + file.errorString();
+        return document;
+    }
+
+    const Encoding encoding = detectEncoding(data, document.bytes);
+    document.encoding = encodingName(encoding.encoding);
+    QStringDecoder decoder(encoding.encoding);
+
+    // A UTF-8 or single-byte file needs at most one character per byte
+    const qint64 maxChars = encoding.encoding == QStringConverter::Utf8 || encoding.encoding == QStringConverter::Latin1
+        ? document.bytes : document.bytes / 2;
+    document.text.reserve(static_cast<qsizetype>(maxChars));
+
+    bool pendingCR = false;
+    bool inWord = false;
+    for (qint64 offset = encoding.bomBytes; offset < document.bytes; offset += kDecodeChunk) {
+        const qint64 length = std::min(kDecodeChunk, document.bytes - offset);
+        const QString chunk = decoder.decode(QByteArrayView(data + offset, length));
+        document.words += normalizeInto(document.text, chunk, pendingCR, inWord);
+        if (progress) {
+            progress(offset + length, document.bytes);
+        }
+    }
+    if (pendingCR) {
+        document.text += u'\n';
+    }
+    document.text.squeeze();
+
+    file.unmap(const_cast<uchar*>(data));
+    if (decoder.hasError()) {
+        qDebug() << "Replaced undecodable bytes in" << path;
+    }
+    qDebug() << "Imported" << document.bytes << "bytes of" << document.encoding << "as" << document.text.size()
+             << "characters in" << timer.elapsed() << "ms";
+    return document;
+}
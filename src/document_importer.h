@@ -0,0 +1,30 @@
+#ifndef DOCUMENT_IMPORTER_H
+#define DOCUMENT_IMPORTER_H
+
+#include <QString>
+#include <functional>
+
+// A text file read by DocumentImporter
+struct ImportedDocument {
+    QString path;
+    QString text;       // decoded and normalized; empty on failure
+    QString encoding;   // what the bytes were decoded as
+    qint64 bytes = 0;   // size of the file
+    int words = 0;
+    QString error;      // set when the file could not be read
+
+    bool isValid() const { return error.isEmpty(); }
+};
+
+// Reads text files of any size off the GUI thread. The file is memory-mapped rather than
+// read into a buffer, its encoding is taken from the byte order mark or guessed from the
+// first megabyte, and it is decoded and normalized a few megabytes at a time straight
+// into the one string that holds the result.
+class DocumentImporter
+{
+public:
+    // Reports bytes decoded out of the file size; safe to call from any thread
+    static ImportedDocument import(const QString& path, const std::function<void(qint64, qint64)>& progress = {});
+};
+
+#endif // DOCUMENT_IMPORTER_H
@@ -34,12 +34,17 @@ void EnumerationsPage::setEnumerations(const QStringList& items)
 {
     enumerationsList->clear();
     for (const QString& item : items) {
-        QListWidgetItem *listItem = new QListWidgetItem(item);
-        listItem->setFlags(listItem->flags() | Qt::ItemIsSelectable);
-        enumerationsList->addItem(listItem);
+        addEnumeration(item);
     }
 }
 
+void EnumerationsPage::addEnumeration(const QString& item)
+{
+    QListWidgetItem *listItem = new QListWidgetItem(item);
+    listItem->setFlags(listItem->flags() | Qt::ItemIsSelectable);
+    enumerationsList->addItem(listItem);
+}
+
 void EnumerationsPage::clearEnumerations()
 {
     enumerationsList->clear();
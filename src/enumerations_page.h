@@ -13,6 +13,7 @@ public:
     ~EnumerationsPage();
 
     void setEnumerations(const QStringList& items);
+    void addEnumeration(const QString& item);
     void clearEnumerations();
 
 signals:
@@ -67,6 +67,17 @@ void FlashcardsPage::setFlashcards(const QVector<QPair<QString, QString>>& cards
     updateCardDisplay();
 }
 
+void FlashcardsPage::addFlashcard(const QString& front, const QString& back)
+{
+    flashcards.append(qMakePair(front, back));
+    if (flashcards.size() == 1) {
+        updateCardDisplay();
+        return;
+    }
+    prevButton->setEnabled(currentIndex > 0);
+    nextButton->setEnabled(currentIndex < flashcards.size() - 1);
+}
+
 void FlashcardsPage::clearFlashcards()
 {
     flashcards.clear();
@@ -15,6 +15,8 @@ public:
     ~FlashcardsPage();
 
     void setFlashcards(const QVector<QPair<QString, QString>>& cards);
+    // Adds a card without moving away from the one being studied
+    void addFlashcard(const QString& front, const QString& back);
     void clearFlashcards();
     void revealDefinition();
     void prevCard();
@@ -3,14 +3,62 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFrame>
-#include <QRegularExpression>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+namespace {
+
+// Characters per page of the document preview
+constexpr int kPreviewPageChars = 20000;
+
+// Runs of non-space characters, the same words QString::split on whitespace finds
+int countWords(const QString& text)
+{
+    int words = 0;
+    bool inWord = false;
+    for (const QChar c : text) {
+        const bool space = c.isSpace();
+        if (!space && !inWord) {
+            words++;
+        }
+        inWord = !space;
+    }
+    return words;
+}
+
+}
 
 HomePage::HomePage(QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::HomePage)
+    , idleTimer(new QTimer(this))
+    , tokenTimer(new QTimer(this))
+    , tokenWatcher(new QFutureWatcher<int>(this))
 {
     ui->setupUi(this);
     
+    // Token counts follow typing after a short pause; counting a long document takes
+    // longer than a keystroke should
+    tokenTimer->setSingleShot(true);
+    tokenTimer->setInterval(300);
+    connect(tokenTimer, &QTimer::timeout, this, &HomePage::startTokenCount);
+    connect(tokenWatcher, &QFutureWatcher<int>::finished, this, &HomePage::onTokensCounted);
+    
+    // Report the input once typing has paused so it can be prefilled
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(800);
+    connect(idleTimer, &QTimer::timeout, this, [this]() {
+        // An imported document is not prefilled: it is too long for one prompt
+        QString text = ui->textInput->toPlainText();
+        if (!hasDocument() && !text.trimmed().isEmpty()) {
+            emit inputIdle(text);
+        }
+    });
+    
     // Make analysis type buttons checkable
     ui->studyGuideButton->setCheckable(true);
     ui->quizButton->setCheckable(true);
@@ -19,44 +67,242 @@ HomePage::HomePage(QWidget *parent)
     
     // Connect signals
     connect(ui->textInput, &QTextEdit::textChanged, this, &HomePage::onTextChanged);
+    connect(ui->textInput->document(), &QTextDocument::contentsChange, this, &HomePage::onContentsChange);
     connect(ui->importButton, &QPushButton::clicked, this, &HomePage::onImportClicked);
     connect(ui->letsGoButton, &QPushButton::clicked, this, &HomePage::onAnalyzeClicked);
     connect(ui->studyGuideButton, &QPushButton::clicked, this, &HomePage::onStudyGuideClicked);
     connect(ui->quizButton, &QPushButton::clicked, this, &HomePage::onQuizClicked);
     connect(ui->flashcardsButton, &QPushButton::clicked, this, &HomePage::onFlashcardsClicked);
     connect(ui->enumerationsButton, &QPushButton::clicked, this, &HomePage::onEnumerationsClicked);
+    connect(ui->previousPageButton, &QPushButton::clicked, this, [this]() { showPage(currentPage - 1); });
+    connect(ui->nextPageButton, &QPushButton::clicked, this, [this]() { showPage(currentPage + 1); });
+    connect(ui->closeDocumentButton, &QPushButton::clicked, this, &HomePage::closeDocument);
+    ui->documentBar->hide();
 
     // Set default analysis type
     currentAnalysisType = "study_guide";
     ui->studyGuideButton->setChecked(true);
+    
+    recountAllBlocks();
+    updateCountLabel();
 }
 
 HomePage::~HomePage()
 {
+    tokenWatcher->waitForFinished();
     delete ui;
 }
 
 QString HomePage::getInputText() const
 {
-    return ui->textInput->toPlainText();
+    return hasDocument() ? document.text : ui->textInput->toPlainText();
 }
 
 void HomePage::setInputText(const QString& text)
 {
+    closeDocument();
     ui->textInput->setPlainText(text);
 }
 
 void HomePage::clearInput()
 {
+    closeDocument();
     ui->textInput->clear();
 }
 
+void HomePage::setDocument(const ImportedDocument& imported)
+{
+    document = imported;
+    splitPages();
+    textSerial++;
+    ui->textInput->setReadOnly(true);
+    ui->documentBar->show();
+    showPage(0);
+}
+
+void HomePage::closeDocument()
+{
+    if (!hasDocument()) {
+        return;
+    }
+    document = ImportedDocument();
+    documentPages.clear();
+    currentPage = 0;
+    ui->documentBar->hide();
+    ui->textInput->setReadOnly(false);
+    ui->textInput->clear();
+}
+
+// Pages end at the last line break before the page size where there is one
+void HomePage::splitPages()
+{
+    documentPages.clear();
+    const QString& text = document.text;
+    int start = 0;
+    do {
+        documentPages.push_back(start);
+        int end = static_cast<int>(std::min<qsizetype>(start + kPreviewPageChars, text.size()));
+        if (end < text.size()) {
+            const int lineBreak = text.lastIndexOf(u'\n', end - 1);
+            if (lineBreak > start) {
+                end = lineBreak + 1;
+            }
+        }
+        start = end;
+    } while (start < text.size());
+}
+
+void HomePage::showPage(int page)
+{
+    if (page < 0 || page >= static_cast<int>(documentPages.size())) {
+        return;
+    }
+    currentPage = page;
+    const int start = documentPages[page];
+    const int end = page + 1 < static_cast<int>(documentPages.size()) ? documentPages[page + 1]
+                                                                      : static_cast<int>(document.text.size());
+    ui->textInput->setPlainText(document.text.mid(start, end - start));
+    ui->documentLabel->setText(QString("%1 - page %2 of %3")
+        .arg(QFileInfo(document.path).fileName()).arg(page + 1).arg(documentPages.size()));
+    ui->previousPageButton->setEnabled(page > 0);
+    ui->nextPageButton->setEnabled(page + 1 < static_cast<int>(documentPages.size()));
+}
+
 void HomePage::onTextChanged()
 {
-    QString text = ui->textInput->toPlainText();
-    int wordCount = text.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts).size();
-    ui->wordCountLabel->setText(QString("Words: %1/1000").arg(wordCount));
-    emit wordCountChanged(wordCount);
+    if (hasDocument() && ui->textInput->isReadOnly()) {
+        // Turning a page of the preview; the document itself is unchanged
+        if (countedSerial != textSerial) {
+            tokenTimer->start();
+        }
+        updateCountLabel();
+        emit wordCountChanged(document.words);
+        return;
+    }
+    textSerial++;
+    if (tokenCounter) {
+        tokenTimer->start();
+    }
+    updateCountLabel();
+    emit wordCountChanged(wordTotal);
+    idleTimer->start();
+}
+
+// Recounts the blocks the edit left behind and swaps them in for the blocks it replaced.
+// The number of replaced blocks follows from how much the block count changed.
+void HomePage::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+    const QTextDocument* document = ui->textInput->document();
+    const int blockCount = document->blockCount();
+
+    QTextBlock first = document->findBlock(position);
+    QTextBlock last = document->findBlock(position + charsAdded);
+    if (!first.isValid()) {
+        first = document->lastBlock();
+    }
+    if (!last.isValid()) {
+        last = document->lastBlock();
+    }
+    const int firstNumber = first.blockNumber();
+    const int newBlocks = last.blockNumber() - firstNumber + 1;
+    const int oldBlocks = newBlocks - (blockCount - static_cast<int>(blockWords.size()));
+    if (oldBlocks < 1 || firstNumber + oldBlocks > static_cast<int>(blockWords.size())) {
+        recountAllBlocks();
+        return;
+    }
+
+    const auto begin = blockWords.begin() + firstNumber;
+    for (auto it = begin; it != begin + oldBlocks; ++it) {
+        wordTotal -= *it;
+    }
+    std::vector<int> counts;
+    counts.reserve(newBlocks);
+    for (QTextBlock block = first; block.isValid() && block.blockNumber() <= last.blockNumber(); block = block.next()) {
+        counts.push_back(countWords(block.text()));
+        wordTotal += counts.back();
+    }
+    blockWords.erase(begin, begin + oldBlocks);
+    blockWords.insert(blockWords.begin() + firstNumber, counts.begin(), counts.end());
+}
+
+void HomePage::recountAllBlocks()
+{
+    const QTextDocument* document = ui->textInput->document();
+    blockWords.clear();
+    blockWords.reserve(document->blockCount());
+    wordTotal = 0;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        blockWords.push_back(countWords(block.text()));
+        wordTotal += blockWords.back();
+    }
+}
+
+void HomePage::updateCountLabel()
+{
+    if (!tokenCounter) {
+        ui->wordCountLabel->setText(QString("Words: %1").arg(wordCount()));
+        return;
+    }
+    const QString tokenText = countedSerial == textSerial ? QString::number(tokens) : QString("...");
+    ui->wordCountLabel->setText(QString("Words: %1 | Tokens: %2/%3").arg(wordCount()).arg(tokenText).arg(maxTokens));
+}
+
+void HomePage::setTokenCounter(std::function<int(const QString&)> counter, int limit)
+{
+    tokenWatcher->waitForFinished();
+    tokenCounter = std::move(counter);
+    maxTokens = limit;
+    tokens = -1;
+    countedSerial = textSerial - 1;
+    if (tokenCounter) {
+        tokenTimer->start();
+    } else {
+        tokenTimer->stop();
+    }
+    updateCountLabel();
+}
+
+// One count runs at a time; edits during it are picked up when it finishes
+void HomePage::startTokenCount()
+{
+    if (!tokenCounter || tokenWatcher->isRunning()) {
+        return;
+    }
+    countingSerial = textSerial;
+    tokenWatcher->setFuture(QtConcurrent::run(tokenCounter, getInputText()));
+}
+
+void HomePage::onTokensCounted()
+{
+    if (countedSerial == textSerial) {
+        // Counted synchronously in the meantime
+        return;
+    }
+    if (countingSerial != textSerial) {
+        // The text changed while counting
+        startTokenCount();
+        return;
+    }
+    tokens = tokenWatcher->result();
+    countedSerial = countingSerial;
+    updateCountLabel();
+    emit tokenCountChanged(tokens);
+}
+
+int HomePage::tokenCount()
+{
+    if (!tokenCounter) {
+        return -1;
+    }
+    if (countedSerial != textSerial) {
+        tokenWatcher->waitForFinished();
+        tokens = tokenCounter(getInputText());
+        countedSerial = textSerial;
+        tokenTimer->stop();
+        updateCountLabel();
+    }
+    return tokens;
 }
 
 void HomePage::onImportClicked()
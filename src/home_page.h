@@ -5,6 +5,11 @@
 #include <QTextEdit>
 #include <QPushButton>
 #include <QLabel>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <functional>
+#include <vector>
+#include "document_importer.h"
 
 namespace Ui {
 class HomePage;
@@ -20,11 +25,30 @@ public:
     QString getInputText() const;
     void setInputText(const QString& text);
     void clearInput();
+    // "study_guide", "quiz", "flashcards" or "enumerations"
+    QString analysisType() const { return currentAnalysisType; }
+
+    // Shows an imported document a page at a time instead of putting it all into the
+    // editor; getInputText() returns the whole document until it is closed or replaced
+    void setDocument(const ImportedDocument& document);
+    bool hasDocument() const { return !documentPages.empty(); }
+    void closeDocument();
+
+    int wordCount() const { return hasDocument() ? document.words : wordTotal; }
+    // Counts tokens off the GUI thread once typing pauses and shows them against the
+    // limit. An empty counter goes back to words only.
+    void setTokenCounter(std::function<int(const QString&)> counter, int limit);
+    int tokenLimit() const { return maxTokens; }
+    // Tokens of the current text, counted now if the last count is out of date;
+    // -1 without a counter
+    int tokenCount();
 
 signals:
     void importFileClicked();
     void analyzeTextClicked();
     void wordCountChanged(int count);
+    void tokenCountChanged(int count);
+    void inputIdle(const QString& text);
     void studyGuideClicked();
     void quizClicked();
     void flashcardsClicked();
@@ -32,6 +56,9 @@ signals:
 
 private slots:
     void onTextChanged();
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void onTokensCounted();
+    void showPage(int page);
     void onImportClicked();
     void onAnalyzeClicked();
     void onStudyGuideClicked();
@@ -42,6 +69,32 @@ private slots:
 private:
     Ui::HomePage *ui;
     QString currentAnalysisType;
+    QTimer *idleTimer;
+
+    void splitPages();
+    void recountAllBlocks();
+    void updateCountLabel();
+    void startTokenCount();
+
+    // Words per block of the document, kept in step with its edits so a keystroke only
+    // recounts the paragraph it touched
+    std::vector<int> blockWords;
+    int wordTotal = 0;
+
+    std::function<int(const QString&)> tokenCounter;
+    QTimer *tokenTimer;
+    QFutureWatcher<int> *tokenWatcher;
+    int maxTokens = 0;
+    int tokens = -1;
+    // Edits so far, the edit the running count started at, and the one `tokens` is for
+    quint64 textSerial = 0;
+    quint64 countingSerial = 0;
+    quint64 countedSerial = 0;
+
+    // Imported document being previewed, and the offset of each page in its text
+    ImportedDocument document;
+    std::vector<int> documentPages;
+    int currentPage = 0;
 };
 
 #endif // HOME_PAGE_H 
\ No newline at end of file
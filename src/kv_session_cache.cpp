@@ -0,0 +1,66 @@
+#include "kv_session_cache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+KVSessionCache::KVSessionCache(const QString& directory, qint64 maxBytes)
+    : m_dir(directory)
+    , m_maxBytes(maxBytes)
+{
+    if (!m_dir.exists() && !m_dir.mkpath(".")) {
+        qWarning() << "Could not create KV session cache directory" << directory;
+    }
+}
+
+void KVSessionCache::setModelFingerprint(const QString& fingerprint)
+{
+    m_modelFingerprint = fingerprint;
+}
+
+bool KVSessionCache::isEnabled() const
+{
+    return !m_modelFingerprint.isEmpty() && m_dir.exists();
+}
+
+QString KVSessionCache::sessionPath(const QString& document) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(m_modelFingerprint.toUtf8());
+    hash.addData(document.toUtf8());
+    return m_dir.filePath(QString::fromLatin1(hash.result().toHex()) + ".kv");
+}
+
+QString KVSessionCache::snapshotPath(const QString& name) const
+{
+    return m_dir.filePath(QString("%1-%2.snapshot").arg(name, m_modelFingerprint.left(16)));
+}
+
+bool KVSessionCache::contains(const QString& document) const
+{
+    return isEnabled() && QFile::exists(sessionPath(document));
+}
+
+void KVSessionCache::touch(const QString& path)
+{
+    QFile file(path);
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    }
+}
+
+void KVSessionCache::prune()
+{
+    // Newest first, so everything past the budget is the least recently used
+    const QFileInfoList files = m_dir.entryInfoList(QStringList() << "*.kv", QDir::Files, QDir::Time);
+
+    qint64 totalBytes = 0;
+    for (const QFileInfo& info : files) {
+        totalBytes += info.size();
+        if (totalBytes > m_maxBytes) {
+            qDebug() << "Evicting KV session" << info.fileName();
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef KV_SESSION_CACHE_H
+#define KV_SESSION_CACHE_H
+
+#include <QString>
+#include <QDir>
+
+// Bounded on-disk store of per-document KV cache snapshots.
+// Files are keyed by the document text and the fingerprint of the loaded model,
+// and the least recently used ones are removed once the directory outgrows its budget.
+class KVSessionCache
+{
+public:
+    explicit KVSessionCache(const QString& directory, qint64 maxBytes = 256 * 1024 * 1024);
+
+    void setModelFingerprint(const QString& fingerprint);
+    bool isEnabled() const;
+
+    QString sessionPath(const QString& document) const;
+    bool contains(const QString& document) const;
+
+    // Location for a named snapshot of the current model, kept out of the LRU budget
+    QString snapshotPath(const QString& name) const;
+
+    // Mark a snapshot as recently used so pruning keeps it
+    void touch(const QString& path);
+    void prune();
+
+private:
+    QDir m_dir;
+    qint64 m_maxBytes;
+    QString m_modelFingerprint;
+};
+
+#endif // KV_SESSION_CACHE_H
@@ -1,9 +1,15 @@
 #include "llm_processor.h"
+#include "kv_session_cache.h"
+#include "decode_arena.h"
+#include "retrieval_index.h"
+#include "tokenizer_service.h"
+#include "stop_matcher.h"
 #include <QDebug>
 #include <QCoreApplication>
 #include <QMetaObject>
 #include <QThread>
 #include <QDir>
+#include <QFile>
 #include <QProcess>
 #include <QFuture>
 #include <QPromise>
@@ -12,42 +18,980 @@
 #include <QThreadPool>
 #include <QtConcurrent>
 #include <QTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
 
 // Include llama.cpp headers
 #include "llama.h"
 #include "ggml.h"
+#include "ggml-cpu.h"
+
+namespace {
+
+// KV cache sequence holding the prompt, possibly prefilled while the user was typing
+constexpr llama_seq_id kPromptSeq = 0;
+// KV cache sequence the generation loop runs on, forked from kPromptSeq per request.
+// It stays alive after the request so follow-up questions only decode the new turn.
+constexpr llama_seq_id kGenerateSeq = 1;
+constexpr int kSeqCount = 2;
+
+// Prefill decodes in small chunks so a generation request can preempt it quickly
+constexpr int kPrefillChunk = 64;
+
+constexpr int kMaxResponseTokens = 2048;
+// Room a prompt has to leave for the answer. Context shifting never discards prompt
+// tokens: the instructions follow the document, so the tail of the prompt matters most.
+constexpr int kMinGenerateWindow = 128;
+// Room kept free for the answer when a follow-up question is decoded
+constexpr int kFollowUpReserve = 256;
+
+constexpr int kDefaultIdleTimeoutMs = 5 * 60 * 1000;
+
+// Context cells of every processor
+constexpr int kContextSize = 2048;
+
+// Retrieved passages get at most this many tokens, and never the room that the
+// instructions and the answer need after the document
+constexpr int kRetrievalTopK = 6;
+constexpr int kMaxRetrievalTokens = 512;
+constexpr int kRetrievalReserve = 768;
+
+// Processors alive in the process; the backend is shared by all of them
+std::atomic<int> backendUsers{0};
+
+size_t commonPrefix(const std::vector<llama_token>& a, const std::vector<llama_token>& b)
+{
+    size_t n = 0;
+    while (n < a.size() && n < b.size() && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+// Text that ends the answer of a task: the model starting over on the prompt, moving on
+// to the heading of another task, or repeating a heading of its own answer. The prompt
+// ends in the task's own heading, which the answer may echo once.
+std::vector<StopMatcher::Sequence> stopSequences(ModelTask task)
+{
+    std::vector<StopMatcher::Sequence> sequences = {
+        {"Text to analyze:"},
+        {"<|user|>"},
+        {"<|im_start|>"},
+        {"### Instruction"},
+    };
+    switch (task) {
+    case ModelTask::StudyGuide:
+        sequences.insert(sequences.end(), {
+            {"Study Guide:", 2},
+            {"Create a study guide"},
+            {"Quiz:"},
+            {"Flashcards:"},
+            {"KEY TERMS AND DEFINITIONS:", 2},
+            {"MAIN IDEAS:", 2},
+            {"BRIEF SUMMARY:", 2},
+        });
+        break;
+    case ModelTask::Quiz:
+        sequences.insert(sequences.end(), {
+            {"Quiz:", 2},
+            {"Create a quiz"},
+            {"Flashcards:"},
+            {"Key Points:"},
+            {"Study Guide:"},
+        });
+        break;
+    case ModelTask::Flashcards:
+        sequences.insert(sequences.end(), {
+            {"Flashcards:", 2},
+            {"Create flashcards"},
+            {"Quiz:"},
+            {"Key Points:"},
+            {"Study Guide:"},
+        });
+        break;
+    case ModelTask::Enumerations:
+        sequences.insert(sequences.end(), {
+            {"Key Points:", 2},
+            {"Create a list of key points"},
+            {"Quiz:"},
+            {"Flashcards:"},
+            {"Study Guide:"},
+        });
+        break;
+    }
+    return sequences;
+}
+
+// Tokens the answer of a task may take: a fixed part plus a share of the input, clamped.
+// The shares are well above what complete answers take, so the budget only cuts off a
+// model that keeps going.
+int responseBudget(ModelTask task, int inputTokens)
+{
+    struct Budget {
+        int base;
+        double perInputToken;
+        int minimum;
+        int maximum;
+    };
+    Budget budget{};
+    switch (task) {
+    case ModelTask::StudyGuide:   budget = {256, 0.75, 384, 1536}; break;
+    case ModelTask::Quiz:         budget = {192, 0.5, 256, 1024}; break;
+    case ModelTask::Flashcards:   budget = {160, 0.5, 256, 1024}; break;
+    case ModelTask::Enumerations: budget = {128, 0.4, 192, 768}; break;
+    }
+    const int predicted = budget.base + static_cast<int>(inputTokens * budget.perInputToken);
+    return std::min(std::clamp(predicted, budget.minimum, budget.maximum), kMaxResponseTokens);
+}
+
+const char* stopReasonName(StopReason reason)
+{
+    switch (reason) {
+    case StopReason::None:         return "nothing generated";
+    case StopReason::EndOfText:    return "end of text";
+    case StopReason::StopSequence: return "stop sequence";
+    case StopReason::Budget:       return "token budget";
+    case StopReason::Repetition:   return "repeated tokens";
+    case StopReason::EmptyTokens:  return "empty tokens";
+    case StopReason::ContextFull:  return "full context";
+    case StopReason::Error:        return "decode error";
+    }
+    return "unknown";
+}
+
+// Length of the text up to a UTF-8 character that is still missing bytes, so streamed
+// pieces never split a character
+size_t completeUtf8Length(const std::string& text)
+{
+    const size_t size = text.size();
+    for (size_t back = 1; back <= 3 && back <= size; back++) {
+        const unsigned char c = text[size - back];
+        if ((c & 0xC0) == 0x80) {
+            continue;
+        }
+        const size_t needed = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        return needed > back ? size - back : size;
+    }
+    return size;
+}
+
+}
 
 struct LLMProcessor::Impl {
     llama_context* context = nullptr;
     llama_model* model = nullptr;
+
+    // Parameters to recreate the context with after an idle teardown
+    llama_context_params contextParams = llama_context_default_params();
+    bool suspended = false;
+    QTimer* idleTimer = nullptr;
+    QFuture<void> suspendFuture;
+
+    // Serializes access to the context between generation and background prefill
+    QMutex mutex;
+
+    // Compute threads for generation steps and prompt batches, owned here so they are
+    // not spawned per graph and can be parked between requests. The config is written
+    // by the GUI and picked up by the next request.
+    ggml_threadpool* decodePool = nullptr;
+    ggml_threadpool* prefillPool = nullptr;
+    InferenceThreadConfig threadConfig;
+    InferenceThreadConfig poolConfig;
+    std::atomic<bool> threadConfigChanged{false};
+    mutable QMutex threadConfigMutex;
+
+    // Residency policy for the next load, and the one the loaded model was mapped with
+    ModelResidencyPolicy residencyPolicy;
+    ModelResidencyPolicy loadedResidency;
+    mutable QMutex residencyMutex;
+    QFuture<void> prefetchFuture;
+
+    // Parks the compute threads once the request holding it returns
+    struct ThreadpoolPause {
+        Impl& impl;
+        ~ThreadpoolPause() { impl.pauseThreadpools(); }
+    };
+
+    // Bumped by every prefill or generation request; a prefill aborts once it is stale
+    std::atomic<quint64> requestSerial{0};
+    // Generation and follow-up requests queued or running
+    std::atomic<int> activeRequests{0};
+    // Prefills started by prefillAsync that may still be running, from the GUI thread.
+    // A stale one only returns once it sees the new serial, so all of them are waited for.
+    QList<QFuture<void>> prefillFutures;
+
+    // Tokens currently decoded into kPromptSeq
+    std::vector<llama_token> promptTokens;
+    // How many of them the open conversation shares cells with, from position 0 on
+    size_t sharedPrompt = 0;
+
+    // Batch and response buffers reused by every decode on the context
+    DecodeArena arena;
+
+    // Per-document prompt snapshots that survive app restarts
+    std::unique_ptr<KVSessionCache> sessionCache;
+    QByteArray modelFingerprint;
+
+    // Library to ground study guides in, and the passages found for the last input, which
+    // the prefill and the request that follows it share
+    RetrievalIndex* retrieval = nullptr;
+    mutable QMutex retrievalMutex;
+    QString retrievalKey;
+    QString retrievalContext;
+    // Counts tokens for the budget without needing the weights, and tokenizes prompts with
+    // the paragraphs it already knows from counting
+    std::shared_ptr<const TokenizerService> tokenizer;
+
+    // LoRA adapters by task and the one applied to the context. The KV cache only holds
+    // state computed under the active adapter.
+    struct Adapter {
+        llama_adapter_lora* lora = nullptr;
+        float scale = 1.0f;
+        QString path;
+    };
+    std::map<ModelTask, Adapter> adapters;
+    Adapter activeAdapter;
+
+    // Conversation continuing on kGenerateSeq: the chat turns so far, the text whose
+    // tokens are decoded there, the next free position and how many leading tokens
+    // (the document turn) are protected from context shifting
+    std::vector<std::pair<std::string, std::string>> chatMessages;
+    std::string chatText;
+    llama_pos generatePos = 0;
+    llama_pos generateKeep = 0;
+    // Readable from the GUI thread without waiting for a running request
+    std::atomic<bool> conversationOpen{false};
+
+    // Stats of the running request, published for the GUI once it finishes
+    GenerationStats stats;
+    GenerationStats publishedStats;
+    QMutex statsMutex;
+
+    std::vector<llama_token> tokenize(const std::string& text, bool addSpecial, bool parseSpecial = false) const;
+    std::string detokenize(const llama_token* tokens, size_t count) const;
+    int appendPiece(std::string& text, llama_token token) const;
+    std::string applyChatTemplate(const std::vector<std::pair<std::string, std::string>>& messages,
+                                  bool addAssistant) const;
+    std::string formatPrompt(const QString& prompt) const;
+    bool decodeTokens(llama_seq_id seq, const llama_token* tokens, size_t count, llama_pos pos);
+    int syncPrompt(const std::vector<llama_token>& tokens, size_t count, int chunk,
+                   const std::function<bool()>& cancelled);
+    bool restoreSession(const QString& path, const std::vector<llama_token>& tokens);
+    bool saveSession(const QString& path);
+    // Text of the tokens of the last generate call, up to the stop sequence that ended it
+    std::string responseText;
+
+    // `onPiece` receives the response text as it is sampled. Text that may be the start of
+    // one of the `stops` sequences is held back until it turns out not to be.
+    const std::vector<llama_token>& generate(llama_token first, int maxTokens, StopMatcher* stops = nullptr,
+                                             const std::function<void(const char*, int)>& onPiece = {});
+    void truncateResponse(size_t textLength);
+    int shiftGenerateSeq(int needed);
+    void endConversation();
+    Adapter adapterFor(ModelTask task) const;
+    void activateAdapter(const Adapter& next);
+    void updateSessionFingerprint();
+    void releaseAdapter(ModelTask task);
+    void freeAdapters();
+    bool ensureContext();
+    void setupThreadpools();
+    void pauseThreadpools();
+    void freeThreadpools();
 };
 
+std::vector<llama_token> LLMProcessor::Impl::tokenize(const std::string& text, bool addSpecial, bool parseSpecial) const
+{
+    // The shared tokenizer is of the same model file and gives the same tokens
+    std::shared_ptr<const TokenizerService> service;
+    {
+        QMutexLocker locker(&retrievalMutex);
+        service = tokenizer;
+    }
+    if (service && service->isReady()) {
+        return service->tokenize(text, addSpecial, parseSpecial);
+    }
+
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    std::vector<llama_token> tokens(text.length() + 2);
+    int n_tokens = llama_tokenize(vocab, text.c_str(), text.length(), tokens.data(), tokens.size(), addSpecial, parseSpecial);
+    if (n_tokens < 0) {
+        return {};
+    }
+    tokens.resize(n_tokens);
+    return tokens;
+}
+
+std::string LLMProcessor::Impl::detokenize(const llama_token* tokens, size_t count) const
+{
+    std::string text;
+    for (size_t i = 0; i < count; i++) {
+        appendPiece(text, tokens[i]);
+    }
+    return text;
+}
+
+// Appends the text of a token and returns its length. Pieces are written straight into
+// the text; a negative length is the room a longer piece needs.
+int LLMProcessor::Impl::appendPiece(std::string& text, llama_token token) const
+{
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    constexpr int kPieceBytes = 64;
+    const size_t offset = text.size();
+    text.resize(offset + kPieceBytes);
+    int length = llama_token_to_piece(vocab, token, text.data() + offset, kPieceBytes, 0, false);
+    if (length < 0) {
+        text.resize(offset - length);
+        length = llama_token_to_piece(vocab, token, text.data() + offset, -length, 0, false);
+    }
+    length = std::max(length, 0);
+    text.resize(offset + length);
+    return length;
+}
+
+// Formats (role, content) turns with the model's chat template; empty if the model has none
+std::string LLMProcessor::Impl::applyChatTemplate(const std::vector<std::pair<std::string, std::string>>& messages,
+                                                  bool addAssistant) const
+{
+    const char* tmpl = llama_model_chat_template(model, nullptr);
+    if (!tmpl || messages.empty()) {
+        return {};
+    }
+
+    std::vector<llama_chat_message> chat;
+    size_t length = 0;
+    for (const auto& message : messages) {
+        chat.push_back({message.first.c_str(), message.second.c_str()});
+        length += message.second.size();
+    }
+
+    std::string formatted(2 * length + 256, '\0');
+    int n = llama_chat_apply_template(tmpl, chat.data(), chat.size(), addAssistant,
+                                      formatted.data(), formatted.size());
+    if (n > static_cast<int>(formatted.size())) {
+        formatted.resize(n);
+        n = llama_chat_apply_template(tmpl, chat.data(), chat.size(), addAssistant,
+                                      formatted.data(), formatted.size());
+    }
+    if (n < 0) {
+        return {};
+    }
+    formatted.resize(n);
+    return formatted;
+}
+
+// The prompt as the first user turn of a chat, or as-is for models without a template
+std::string LLMProcessor::Impl::formatPrompt(const QString& prompt) const
+{
+    std::string formatted = applyChatTemplate({{"user", prompt.toStdString()}}, true);
+    return formatted.empty() ? prompt.toStdString() : formatted;
+}
+
+bool LLMProcessor::Impl::decodeTokens(llama_seq_id seq, const llama_token* tokens, size_t count, llama_pos pos)
+{
+    return llama_decode(context, arena.fill(seq, tokens, count, pos, false)) == 0;
+}
+
+// Brings kPromptSeq in line with the first `count` tokens, decoding only what differs
+// from the tokens already cached. Returns the number of reused tokens, or -1 if the
+// decode failed or was cancelled.
+int LLMProcessor::Impl::syncPrompt(const std::vector<llama_token>& tokens, size_t count, int chunk,
+                                   const std::function<bool()>& cancelled)
+{
+    const size_t n_common = std::min(commonPrefix(promptTokens, tokens), count);
+
+    llama_kv_self_seq_rm(context, kPromptSeq, n_common, -1);
+    promptTokens.resize(n_common);
+    sharedPrompt = std::min(sharedPrompt, n_common);
+
+    for (size_t start = n_common; start < count; start += chunk) {
+        if (cancelled && cancelled()) {
+            return -1;
+        }
+
+        const size_t end = std::min(count, start + chunk);
+        if (!decodeTokens(kPromptSeq, tokens.data() + start, end - start, start)) {
+            qDebug() << "Failed to decode prompt tokens" << start << "to" << end;
+            return -1;
+        }
+        promptTokens.insert(promptTokens.end(), tokens.begin() + start, tokens.begin() + end);
+    }
+
+    return static_cast<int>(n_common);
+}
+
+// Adopts the saved kPromptSeq snapshot at `path` if it covers more of `tokens` than
+// what is already cached in memory. The snapshot is staged in kGenerateSeq so the
+// in-memory prompt survives when the file turns out to be worse or unreadable.
+bool LLMProcessor::Impl::restoreSession(const QString& path, const std::vector<llama_token>& tokens)
+{
+    const size_t n_cached = commonPrefix(promptTokens, tokens);
+    if (n_cached * 2 >= tokens.size()) {
+        return false;
+    }
+
+    std::vector<llama_token> loaded(llama_n_ctx(context));
+    size_t n_loaded = 0;
+    const std::string path_std = QDir::toNativeSeparators(path).toStdString();
+    if (llama_state_seq_load_file(context, path_std.c_str(), kGenerateSeq, loaded.data(), loaded.size(), &n_loaded) == 0) {
+        qDebug() << "Failed to load KV session" << path;
+        llama_kv_self_seq_rm(context, kGenerateSeq, -1, -1);
+        return false;
+    }
+    loaded.resize(n_loaded);
+
+    if (commonPrefix(loaded, tokens) <= n_cached) {
+        llama_kv_self_seq_rm(context, kGenerateSeq, -1, -1);
+        return false;
+    }
+
+    llama_kv_self_seq_rm(context, kPromptSeq, -1, -1);
+    llama_kv_self_seq_cp(context, kGenerateSeq, kPromptSeq, -1, -1);
+    llama_kv_self_seq_rm(context, kGenerateSeq, -1, -1);
+    promptTokens = std::move(loaded);
+    sharedPrompt = 0;
+    return true;
+}
+
+bool LLMProcessor::Impl::saveSession(const QString& path)
+{
+    const std::string path_std = QDir::toNativeSeparators(path).toStdString();
+    const size_t written = llama_state_seq_save_file(context, path_std.c_str(), kPromptSeq,
+                                                     promptTokens.data(), promptTokens.size());
+    if (written == 0) {
+        qDebug() << "Failed to save KV session" << path;
+        return false;
+    }
+    qDebug() << "Saved KV session of" << promptTokens.size() << "tokens," << written << "bytes";
+    sessionCache->prune();
+    return true;
+}
+
+// Greedy decode loop on kGenerateSeq. `first` is the last input token, whose logits are
+// still pending, and goes to generatePos. Every sampled token but the last one ends up
+// decoded in the KV cache, and generatePos is left at the next free position.
+// The returned tokens live in the arena and stay valid until the next call.
+const std::vector<llama_token>& LLMProcessor::Impl::generate(llama_token first, int maxTokens, StopMatcher* stops,
+                                                             const std::function<void(const char*, int)>& onPiece)
+{
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    const int n_ctx = llama_n_ctx(context);
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    std::vector<llama_token>& response_tokens = arena.responseTokens();
+    response_tokens.clear();
+    maxTokens = std::min(maxTokens, arena.capacity());
+    stats.tokenBudget = maxTokens;
+    stats.stopReason = maxTokens > 0 ? StopReason::Budget : StopReason::None;
+
+    responseText.clear();
+    responseText.reserve(static_cast<size_t>(maxTokens) * 8);
+    size_t streamed = 0;
+
+    // Generate response tokens
+    int consecutive_empty_tokens = 0;
+    const int max_empty_tokens = 5;  // Maximum number of consecutive empty tokens before stopping
+
+    // Heap allocations of the steps after the first one, which may still set up buffers
+    quint64 steadyAllocations = 0;
+    
+    for (int i = 0; i < maxTokens; i++) {
+        const quint64 stepAllocations = DecodeArena::threadAllocations();
+        llama_token next_token = (i == 0) ? first : response_tokens.back();
+
+        // Slide the window instead of overrunning the KV cache at the n_ctx boundary
+        if (generatePos >= n_ctx && shiftGenerateSeq(1) == 0) {
+            qDebug() << "Context is full and cannot be shifted at position" << i;
+            stats.stopReason = StopReason::ContextFull;
+            break;
+        }
+        llama_batch& next_batch = arena.fill(kGenerateSeq, &next_token, 1, generatePos, true);
+        
+        // Process next token; a full KV cache gets one more chance after a shift
+        int ret = llama_decode(context, next_batch);
+        if (ret == 1 && shiftGenerateSeq(1) > 0) {
+            next_batch.pos[0] = generatePos;
+            ret = llama_decode(context, next_batch);
+        }
+        if (ret != 0) {
+            qDebug() << "Failed to decode token at position" << i;
+            stats.stopReason = StopReason::Error;
+            break;
+        }
+        generatePos++;
+        
+        // Get logits for the next token
+        const float* logits = llama_get_logits_ith(context, 0);
+        if (!logits) {
+            qDebug() << "Failed to get logits at position" << i;
+            stats.stopReason = StopReason::Error;
+            break;
+        }
+        
+        // Find the token with the highest probability
+        llama_token best_token = -1;
+        float best_logit = -INFINITY;
+        
+        for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
+            float logit = logits[token_id];
+            if (logit > best_logit) {
+                best_logit = logit;
+                best_token = token_id;
+            }
+        }
+        
+        if (best_token == -1) {
+            qDebug() << "Failed to find best token at position" << i;
+            stats.stopReason = StopReason::Error;
+            break;
+        }
+        
+        // Add token to response; the arena reserved room for the whole context
+        response_tokens.push_back(best_token);
+        if (i > 0) {
+            steadyAllocations += DecodeArena::threadAllocations() - stepAllocations;
+        }
+        
+        // Check for end of text or stop conditions
+        if (best_token == llama_vocab_eos(vocab)) {
+            qDebug() << "End of text token found at position" << i;
+            stats.stopReason = StopReason::EndOfText;
+            break;
+        }
+        
+        // Check for repeated tokens
+        if (response_tokens.size() > 3 && 
+            response_tokens[response_tokens.size()-1] == response_tokens[response_tokens.size()-2] &&
+            response_tokens[response_tokens.size()-2] == response_tokens[response_tokens.size()-3]) {
+            qDebug() << "Stop condition met: repeated tokens at position" << i;
+            stats.stopReason = StopReason::Repetition;
+            break;
+        }
+        
+        // Check for stop sequences and empty tokens
+        const size_t pieceStart = responseText.size();
+        const int length = appendPiece(responseText, best_token);
+        if (length > 0) {
+            size_t consumed = 0;
+            const int stop = stops ? stops->feed(responseText.data() + pieceStart, length, consumed) : -1;
+            if (stop >= 0) {
+                const size_t matchStart = pieceStart + consumed - stops->sequence(stop).size();
+                qDebug() << "Stop condition met: stop sequence" << stops->sequence(stop).c_str() << "at position" << i;
+                stats.stopReason = StopReason::StopSequence;
+                stats.stopSequence = QString::fromStdString(stops->sequence(stop));
+                truncateResponse(std::max(matchStart, streamed));
+                break;
+            }
+            const size_t complete = responseText.size() - (stops ? stops->pendingBytes() : 0);
+            if (onPiece && complete > streamed) {
+                onPiece(responseText.data() + streamed, complete - streamed);
+                streamed = complete;
+            }
+        }
+        if (length <= 0) {
+            consecutive_empty_tokens++;
+            if (consecutive_empty_tokens >= max_empty_tokens) {
+                qDebug() << "Stop condition met: too many consecutive empty tokens at position" << i;
+                stats.stopReason = StopReason::EmptyTokens;
+                break;
+            }
+        } else {
+            consecutive_empty_tokens = 0;
+        }
+    }
+
+    // Text held back for a stop sequence that never completed
+    if (onPiece && responseText.size() > streamed) {
+        onPiece(responseText.data() + streamed, responseText.size() - streamed);
+    }
+
+#ifdef TEXTMASTER_COUNT_ALLOCATIONS
+    if (response_tokens.size() > 1) {
+        qDebug() << "Decode loop made" << steadyAllocations << "heap allocations in"
+                 << response_tokens.size() - 1 << "steady-state steps";
+    }
+#endif
+
+    return response_tokens;
+}
+
+// Cuts the response at `textLength` bytes of its text. Tokens reaching past the cut are
+// dropped along with their KV cells, and as after any generate call, every remaining
+// token but the last one stays decoded. The text ends with the last kept token, so a
+// token the cut falls inside goes with its leading bytes, and the text, the tokens and
+// the KV cache stay in agreement.
+void LLMProcessor::Impl::truncateResponse(size_t textLength)
+{
+    std::vector<llama_token>& response_tokens = arena.responseTokens();
+    size_t keep = 0;
+    size_t end = 0;
+    std::string piece;
+    while (keep < response_tokens.size()) {
+        piece.clear();
+        const size_t next = end + appendPiece(piece, response_tokens[keep]);
+        if (next > textLength) {
+            break;
+        }
+        end = next;
+        keep++;
+    }
+
+    // Positions only ever slide down, so the newest cells are the last ones of the sequence
+    const int decoded = static_cast<int>(response_tokens.size()) - 1;
+    const int discard = decoded - std::max(static_cast<int>(keep) - 1, 0);
+    if (discard > 0) {
+        llama_kv_self_seq_rm(context, kGenerateSeq, generatePos - discard, -1);
+        generatePos -= discard;
+    }
+    response_tokens.resize(keep);
+    responseText.resize(end);
+}
+
+// Makes room for `needed` more tokens in kGenerateSeq by discarding the oldest tokens
+// after the protected prefix and sliding the rest down. The prompt cache shares cells
+// with this sequence, so it is dropped first to keep its positions intact.
+// Returns the number of discarded tokens, 0 if nothing could be shifted.
+int LLMProcessor::Impl::shiftGenerateSeq(int needed)
+{
+    if (!llama_kv_self_can_shift(context)) {
+        return 0;
+    }
+
+    const int n_ctx = llama_n_ctx(context);
+    const int available = generatePos - generateKeep;
+    const int discard = std::max(needed - (n_ctx - generatePos), available / 2);
+    if (discard <= 0 || discard > available) {
+        return 0;
+    }
+
+    llama_kv_self_seq_rm(context, kPromptSeq, -1, -1);
+    promptTokens.clear();
+    sharedPrompt = 0;
+
+    llama_kv_self_seq_rm(context, kGenerateSeq, generateKeep, generateKeep + discard);
+    llama_kv_self_seq_add(context, kGenerateSeq, generateKeep + discard, generatePos, -discard);
+    generatePos -= discard;
+    stats.shiftedTokens += discard;
+
+    qDebug() << "Shifted context: discarded" << discard << "tokens after the first" << generateKeep;
+    return discard;
+}
+
+// Recreates the context after an idle teardown and restores the sequences that were
+// snapshotted to disk. Returns false if there is no usable context.
+bool LLMProcessor::Impl::ensureContext()
+{
+    if (context) {
+        setupThreadpools();
+        return true;
+    }
+    if (!suspended || !model) {
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    llama_model_mmap_advise(model, LLAMA_MMAP_ADVICE_WILLNEED);
+
+    context = llama_new_context_with_model(model, contextParams);
+    if (!context) {
+        qDebug() << "Failed to recreate context after idle teardown";
+        return false;
+    }
+    suspended = false;
+    arena.reserve(llama_n_ctx(context));
+    setupThreadpools();
+    if (activeAdapter.lora) {
+        llama_set_adapter_lora(context, activeAdapter.lora, activeAdapter.scale);
+    }
+
+    // The conversation goes first. Both snapshots need a contiguous run of free cells, and
+    // the prompt it was forked from is rebuilt from its leading cells instead of loading a
+    // second copy of them.
+    const QString chatSnapshot = sessionCache->snapshotPath("conversation");
+    if (conversationOpen && QFile::exists(chatSnapshot)) {
+        size_t n_tokens = 0;
+        if (llama_state_seq_load_file(context, QDir::toNativeSeparators(chatSnapshot).toStdString().c_str(),
+                                      kGenerateSeq, nullptr, 0, &n_tokens) == 0) {
+            qDebug() << "Failed to restore the conversation";
+            endConversation();
+        }
+    } else {
+        endConversation();
+    }
+
+    // Only a prompt that has moved on from the conversation was snapshotted on its own
+    const QString promptSnapshot = sessionCache->snapshotPath("prompt");
+    bool promptRestored = false;
+    if (!promptTokens.empty() && sharedPrompt < promptTokens.size() && QFile::exists(promptSnapshot)) {
+        std::vector<llama_token> tokens(llama_n_ctx(context));
+        size_t n_tokens = 0;
+        if (llama_state_seq_load_file(context, QDir::toNativeSeparators(promptSnapshot).toStdString().c_str(),
+                                      kPromptSeq, tokens.data(), tokens.size(), &n_tokens) > 0) {
+            tokens.resize(n_tokens);
+            promptTokens = std::move(tokens);
+            sharedPrompt = 0;
+            promptRestored = true;
+        }
+    }
+    if (!promptRestored) {
+        llama_kv_self_seq_rm(context, kPromptSeq, -1, -1);
+        if (sharedPrompt > 0) {
+            llama_kv_self_seq_cp(context, kGenerateSeq, kPromptSeq, 0, sharedPrompt);
+        }
+        promptTokens.resize(sharedPrompt);
+    }
+
+    QFile::remove(promptSnapshot);
+    QFile::remove(chatSnapshot);
+
+    qDebug() << "Context restored in" << timer.elapsed() << "ms with" << promptTokens.size()
+             << "cached prompt tokens, conversation:" << conversationOpen.load();
+    return true;
+}
+
+// Rebuilds the thread pools if their config changed and attaches them to the context.
+// Without pools llama.cpp falls back to spawning threads per graph.
+void LLMProcessor::Impl::setupThreadpools()
+{
+    if (threadConfigChanged.exchange(false) || !decodePool || !prefillPool) {
+        {
+            QMutexLocker locker(&threadConfigMutex);
+            poolConfig = threadConfig;
+        }
+        const InferenceThreadConfig& config = poolConfig;
+
+        if (context) {
+            llama_detach_threadpool(context);
+        }
+        freeThreadpools();
+
+        auto createPool = [&config](int n_threads, const QList<int>& cpus, int poll) {
+            ggml_threadpool_params params;
+            ggml_threadpool_params_init(&params, n_threads);
+            for (int cpu : cpus) {
+                if (cpu >= 0 && cpu < GGML_MAX_N_THREADS) {
+                    params.cpumask[cpu] = true;
+                }
+            }
+            params.strict_cpu = config.strictCpu && !cpus.isEmpty();
+            params.prio = static_cast<ggml_sched_priority>(std::clamp(config.priority, 0, 3));
+            params.poll = std::clamp(poll, 0, 100);
+            params.paused = true;
+            return ggml_threadpool_new(&params);
+        };
+        decodePool = createPool(config.decodeThreads, config.decodeCpus, config.decodePoll);
+        prefillPool = createPool(config.prefillThreads, config.prefillCpus, config.prefillPoll);
+        if (!decodePool || !prefillPool) {
+            qDebug() << "Failed to create the inference thread pools";
+            freeThreadpools();
+            return;
+        }
+        qDebug() << "Inference thread pools: decode" << config.decodeThreads << "threads, prefill"
+                 << config.prefillThreads << "threads";
+    }
+
+    if (context) {
+        llama_attach_threadpool(context, decodePool, prefillPool);
+        llama_set_n_threads(context, poolConfig.decodeThreads, poolConfig.prefillThreads);
+    }
+}
+
+// Parked threads block on a condition variable instead of polling for the next graph.
+// The next compute on a pool resumes it.
+void LLMProcessor::Impl::pauseThreadpools()
+{
+    if (decodePool) {
+        ggml_threadpool_pause(decodePool);
+    }
+    if (prefillPool) {
+        ggml_threadpool_pause(prefillPool);
+    }
+}
+
+void LLMProcessor::Impl::freeThreadpools()
+{
+    if (decodePool) {
+        ggml_threadpool_free(decodePool);
+        decodePool = nullptr;
+    }
+    if (prefillPool) {
+        ggml_threadpool_free(prefillPool);
+        prefillPool = nullptr;
+    }
+}
+
+void LLMProcessor::Impl::endConversation()
+{
+    if (context) {
+        llama_kv_self_seq_rm(context, kGenerateSeq, -1, -1);
+    }
+    chatMessages.clear();
+    chatText.clear();
+    generatePos = 0;
+    generateKeep = 0;
+    sharedPrompt = 0;
+    conversationOpen = false;
+}
+
+LLMProcessor::Impl::Adapter LLMProcessor::Impl::adapterFor(ModelTask task) const
+{
+    const auto it = adapters.find(task);
+    return it != adapters.end() ? it->second : Adapter();
+}
+
+// Applies `next` in place of the active adapter. The cached prompt and the conversation
+// were computed under the old one and are dropped; the base weights stay as they are.
+void LLMProcessor::Impl::activateAdapter(const Adapter& next)
+{
+    if (next.lora == activeAdapter.lora && next.scale == activeAdapter.scale) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    if (context) {
+        llama_clear_adapter_lora(context);
+        if (next.lora) {
+            llama_set_adapter_lora(context, next.lora, next.scale);
+        }
+        llama_kv_self_seq_rm(context, kPromptSeq, -1, -1);
+    } else if (sessionCache) {
+        // The snapshots of a suspended context belong to the old adapter
+        QFile::remove(sessionCache->snapshotPath("prompt"));
+        QFile::remove(sessionCache->snapshotPath("conversation"));
+    }
+    promptTokens.clear();
+    endConversation();
+    activeAdapter = next;
+    updateSessionFingerprint();
+
+    qDebug() << "Switched LoRA adapter to" << (next.lora ? next.path : QString("none")) << "in"
+             << timer.elapsed() << "ms";
+}
+
+// Saved sessions hold KV state computed under the active adapter, so they are keyed by it
+void LLMProcessor::Impl::updateSessionFingerprint()
+{
+    if (!sessionCache) {
+        return;
+    }
+    if (!activeAdapter.lora) {
+        sessionCache->setModelFingerprint(QString::fromLatin1(modelFingerprint));
+        return;
+    }
+    QCryptographicHash fingerprint(QCryptographicHash::Sha1);
+    fingerprint.addData(modelFingerprint);
+    fingerprint.addData(QFileInfo(activeAdapter.path).fileName().toUtf8());
+    fingerprint.addData(QByteArray::number(QFileInfo(activeAdapter.path).size()));
+    fingerprint.addData(QByteArray::number(activeAdapter.scale));
+    sessionCache->setModelFingerprint(QString::fromLatin1(fingerprint.result().toHex()));
+}
+
+// Drops the task's adapter, freeing it unless another task shares it
+void LLMProcessor::Impl::releaseAdapter(ModelTask task)
+{
+    const auto it = adapters.find(task);
+    if (it == adapters.end()) {
+        return;
+    }
+    llama_adapter_lora* lora = it->second.lora;
+    adapters.erase(it);
+
+    const bool shared = std::any_of(adapters.begin(), adapters.end(), [lora](const auto& entry) {
+        return entry.second.lora == lora;
+    });
+    if (!shared) {
+        if (activeAdapter.lora == lora) {
+            activateAdapter(Adapter());
+        }
+        llama_adapter_lora_free(lora);
+    }
+}
+
+// Tasks may share an adapter file, which is loaded once
+void LLMProcessor::Impl::freeAdapters()
+{
+    std::vector<llama_adapter_lora*> freed;
+    for (const auto& entry : adapters) {
+        llama_adapter_lora* lora = entry.second.lora;
+        if (std::find(freed.begin(), freed.end(), lora) == freed.end()) {
+            llama_adapter_lora_free(lora);
+            freed.push_back(lora);
+        }
+    }
+    adapters.clear();
+    activeAdapter = Adapter();
+}
+
 LLMProcessor::LLMProcessor(QObject* parent)
     : QObject(parent)
     , m_impl(std::make_unique<Impl>())
 {
     // Initialize llama.cpp backend
-    llama_backend_init();
+    if (backendUsers++ == 0) {
+        llama_backend_init();
+    }
+
+    // Tear the context down once the app has been idle for a while
+    m_impl->idleTimer = new QTimer(this);
+    m_impl->idleTimer->setSingleShot(true);
+    m_impl->idleTimer->setInterval(kDefaultIdleTimeoutMs);
+    connect(m_impl->idleTimer, &QTimer::timeout, this, [this]() {
+        m_impl->suspendFuture = QtConcurrent::run([this]() {
+            suspendContext();
+        });
+    });
 }
 
 LLMProcessor::~LLMProcessor()
 {
     cleanup();
+    if (--backendUsers == 0) {
+        llama_backend_free();
+    }
 }
 
 void LLMProcessor::cleanup()
 {
     if (m_impl) {
+        // Let a running prefill notice it is stale before the context goes away
+        m_impl->requestSerial++;
+        for (QFuture<void>& prefill : m_impl->prefillFutures) {
+            prefill.waitForFinished();
+        }
+        m_impl->prefillFutures.clear();
+        m_impl->suspendFuture.waitForFinished();
+        m_impl->prefetchFuture.waitForFinished();
+
+        QMutexLocker locker(&m_impl->mutex);
+        m_impl->promptTokens.clear();
+        m_impl->sharedPrompt = 0;
+        m_impl->chatMessages.clear();
+        m_impl->chatText.clear();
+        m_impl->conversationOpen = false;
+        m_impl->suspended = false;
+        m_impl->sessionCache.reset();
         if (m_impl->context) {
             llama_free(m_impl->context);
             m_impl->context = nullptr;
         }
+        m_impl->freeThreadpools();
+        m_impl->freeAdapters();
         if (m_impl->model) {
             llama_free_model(m_impl->model);
             m_impl->model = nullptr;
         }
     }
-    llama_backend_free();
 }
 
 bool LLMProcessor::initialize(const QString& modelPath)
@@ -87,6 +1031,33 @@ bool LLMProcessor::initialize(const QString& modelPath)
         
         llama_model_params model_params = llama_model_default_params();
         model_params.n_gpu_layers = 0;  // CPU only for stability
+
+        const ModelResidencyPolicy residency = residencyPolicy();
+        model_params.use_mlock = residency.lockInMemory;
+        model_params.use_hugepages = residency.hugePages;
+        // Under NUMA the pages land on the node of the thread that first touches them, so
+        // they are left to the compute threads instead of a prefetch
+        const bool backgroundPrefetch = residency.backgroundPrefetch && residency.numa == ModelResidencyPolicy::Numa::Off;
+        model_params.use_prefetch = !backgroundPrefetch;
+
+        // llama.cpp only honours the first NUMA setup of the process, before any model is loaded
+        static bool numaInitialized = false;
+        if (!numaInitialized) {
+            numaInitialized = true;
+            switch (residency.numa) {
+            case ModelResidencyPolicy::Numa::Distribute: llama_numa_init(GGML_NUMA_STRATEGY_DISTRIBUTE); break;
+            case ModelResidencyPolicy::Numa::Isolate:    llama_numa_init(GGML_NUMA_STRATEGY_ISOLATE);    break;
+            case ModelResidencyPolicy::Numa::Off:        break;
+            }
+        }
+
+        // Keep the CPU-repacked weights between runs so later launches can map them directly
+        const QString repackDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/repack";
+        QDir().mkpath(repackDir);
+        const std::string repackCachePath =
+            QDir::toNativeSeparators(repackDir + "/" + QFileInfo(modelPath).fileName() + ".repack").toStdString();
+        model_params.repack_cache_path = repackCachePath.c_str();
+
         m_impl->model = llama_load_model_from_file(modelPath.toStdString().c_str(), model_params);
         
         if (!m_impl->model) {
@@ -94,16 +1065,35 @@ bool LLMProcessor::initialize(const QString& modelPath)
             return false;
         }
         qDebug() << "Model loaded successfully";
+        {
+            QMutexLocker locker(&m_impl->residencyMutex);
+            m_impl->loadedResidency = residency;
+        }
+
+        // Read the weights in off the GUI thread; the first requests page-fault the rest
+        if (backgroundPrefetch) {
+            llama_model* model = m_impl->model;
+            m_impl->prefetchFuture = QtConcurrent::run([this, model]() {
+                QElapsedTimer timer;
+                timer.start();
+                llama_model_mmap_advise(model, LLAMA_MMAP_ADVICE_WILLNEED);
+                const ModelResidency resident = this->residency();
+                qDebug() << "Prefetched model weights:" << resident.residentBytes / (1024 * 1024) << "of"
+                         << resident.mappedBytes / (1024 * 1024) << "MiB resident after" << timer.elapsed() << "ms";
+            });
+        }
         
         // Stage 3: Create context with optimized parameters
         qDebug() << "Stage 3: Creating context...";
         llama_context_params ctx_params = llama_context_default_params();
         
         // Set context parameters for stability
-        ctx_params.n_ctx = 2048;          // Increased context size to match model's training context
+        ctx_params.n_ctx = kContextSize;  // Increased context size to match model's training context
         ctx_params.n_batch = 2048;        // Match batch size to context
-        ctx_params.n_threads = 4;        // Use multiple threads
-        ctx_params.n_threads_batch = 4;  // Use multiple threads for batch
+        const InferenceThreadConfig threads = threadConfig();
+        ctx_params.n_threads = threads.decodeThreads;
+        ctx_params.n_threads_batch = threads.prefillThreads;
+        ctx_params.n_seq_max = kSeqCount; // Prompt cache plus generation sequence
         
         // Memory and performance settings
         ctx_params.type_k = GGML_TYPE_F32;  // Use F32 for KV cache
@@ -139,11 +1129,11 @@ bool LLMProcessor::initialize(const QString& modelPath)
         // Verify context parameters
         int n_ctx = llama_n_ctx(m_impl->context);
         qDebug() << "Context created with size:" << n_ctx;
-        if (n_ctx != 2048) {
-            qDebug() << "Warning: Context size mismatch. Expected 2048, got" << n_ctx;
+        if (n_ctx != kContextSize) {
+            qDebug() << "Warning: Context size mismatch. Expected" << kContextSize << "got" << n_ctx;
             // Try to recreate with correct size
             llama_free(m_impl->context);
-            ctx_params.n_ctx = 2048;
+            ctx_params.n_ctx = kContextSize;
             m_impl->context = llama_new_context_with_model(m_impl->model, ctx_params);
             if (!m_impl->context) {
                 qDebug() << "Failed to recreate context with correct size";
@@ -155,6 +1145,30 @@ bool LLMProcessor::initialize(const QString& modelPath)
             qDebug() << "Recreated context with size:" << n_ctx;
         }
 
+        // Fingerprint the model and KV layout so saved sessions are never restored into another setup
+        char modelDesc[128];
+        llama_model_desc(m_impl->model, modelDesc, sizeof(modelDesc));
+        QFileInfo modelInfo(modelPath);
+        QCryptographicHash fingerprint(QCryptographicHash::Sha1);
+        fingerprint.addData(modelInfo.fileName().toUtf8());
+        fingerprint.addData(QByteArray::number(modelSize));
+        fingerprint.addData(modelInfo.lastModified().toString(Qt::ISODate).toUtf8());
+        fingerprint.addData(QByteArray(modelDesc));
+        fingerprint.addData(QByteArray::number(n_ctx));
+        fingerprint.addData(QByteArray::number(static_cast<int>(ctx_params.type_k)));
+        fingerprint.addData(QByteArray::number(static_cast<int>(ctx_params.type_v)));
+
+        const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/kv_sessions";
+        m_impl->sessionCache = std::make_unique<KVSessionCache>(cacheDir);
+        m_impl->modelFingerprint = fingerprint.result().toHex();
+        m_impl->updateSessionFingerprint();
+        qDebug() << "KV session cache:" << cacheDir;
+
+        m_impl->contextParams = ctx_params;
+        m_impl->arena.reserve(n_ctx);
+        m_impl->setupThreadpools();
+        scheduleIdleTeardown();
+
         return true;
     } catch (const std::exception& e) {
         emit error(QString("Error initializing LLM: %1").arg(e.what()));
@@ -163,9 +1177,15 @@ bool LLMProcessor::initialize(const QString& modelPath)
     }
 }
 
-QString LLMProcessor::processText(const QString& prompt)
+QString LLMProcessor::processText(const QString& prompt, const QString& document, ModelTask task)
 {
-    if (!m_impl->context || !m_impl->model) {
+    // Preempt any speculative prefill so this request gets the context right away
+    m_impl->requestSerial++;
+    QMutexLocker locker(&m_impl->mutex);
+    Impl::ThreadpoolPause pauseThreads{*m_impl};
+    scheduleIdleTeardown();
+
+    if (!m_impl->ensureContext() || !m_impl->model) {
         qDebug() << "LLM not initialized - context:" << (m_impl->context ? "valid" : "null") 
                  << "model:" << (m_impl->model ? "valid" : "null");
         emit error("LLM not initialized");
@@ -175,148 +1195,112 @@ QString LLMProcessor::processText(const QString& prompt)
     qDebug() << "Processing prompt:" << prompt;
 
     try {
-        // Get vocab for tokenization
-        const llama_vocab* vocab = llama_model_get_vocab(m_impl->model);
-        if (!vocab) {
-            qDebug() << "Failed to get vocab";
-            emit error("Failed to get vocab");
-            return QString();
-        }
+        m_impl->activateAdapter(m_impl->adapterFor(task));
 
-        // Convert QString to std::string
-        std::string prompt_std = prompt.toStdString();
-        qDebug() << "Converted prompt to std::string, length:" << prompt_std.length();
+        // A new request starts a new conversation
+        m_impl->endConversation();
+        m_impl->stats = GenerationStats();
+
+        // Format the request as the first user turn of a chat with the model's template
+        std::string prompt_std = m_impl->formatPrompt(prompt);
+        if (prompt_std != prompt.toStdString()) {
+            m_impl->chatMessages.push_back({"user", prompt.toStdString()});
+        } else {
+            qDebug() << "Model has no usable chat template, follow-ups are disabled";
+        }
+        qDebug() << "Formatted prompt length:" << prompt_std.length();
 
         // Tokenize the prompt
-        std::vector<llama_token> tokens;
-        tokens.resize(prompt_std.length() + 1);
-        int n_tokens = llama_tokenize(vocab, prompt_std.c_str(), prompt_std.length(), tokens.data(), tokens.size(), true, false);
-        
-        if (n_tokens < 0) {
-            qDebug() << "Failed to tokenize input, error code:" << n_tokens;
+        std::vector<llama_token> tokens = m_impl->tokenize(prompt_std, true, true);
+        if (tokens.empty()) {
+            qDebug() << "Failed to tokenize input";
             emit error("Failed to tokenize input");
             return QString();
         }
         
-        tokens.resize(n_tokens);
+        const int n_tokens = tokens.size();
+        const int n_ctx = llama_n_ctx(m_impl->context);
         qDebug() << "Tokenized" << n_tokens << "tokens";
-
-        // Process the text in chunks
-        std::vector<llama_token> response_tokens;
-        const int max_response_tokens = 2048;  // Increased from 1024 to allow for longer responses
-        
-        // Create initial batch for the prompt
-        llama_batch batch = llama_batch_init(tokens.size(), 0, 1);
-        for (size_t i = 0; i < tokens.size(); i++) {
-            batch.token[i] = tokens[i];
-            batch.pos[i] = i;
-            batch.n_seq_id[i] = 1;
-            batch.seq_id[i][0] = 0;
-            batch.logits[i] = false;  // Disable logits for all tokens initially
-        }
-        batch.n_tokens = tokens.size();
-        
-        // Process the prompt
-        if (llama_decode(m_impl->context, batch) != 0) {
-            qDebug() << "Failed to decode prompt";
-            llama_batch_free(batch);
+        if (n_tokens > n_ctx - kMinGenerateWindow) {
+            m_impl->chatMessages.clear();
+            emit error("Input is too long for the model context");
             return QString();
         }
         
-        // Generate response tokens
-        int consecutive_empty_tokens = 0;
-        const int max_empty_tokens = 5;  // Maximum number of consecutive empty tokens before stopping
-        
-        for (int i = 0; i < max_response_tokens; i++) {
-            // Create a new batch for the next token
-            llama_batch next_batch = llama_batch_init(1, 0, 1);
-            next_batch.token[0] = (i == 0) ? tokens.back() : response_tokens.back();
-            next_batch.pos[0] = tokens.size() + i;
-            next_batch.n_seq_id[0] = 1;
-            next_batch.seq_id[0][0] = 0;
-            next_batch.logits[0] = true;  // Enable logits for the next token
-            next_batch.n_tokens = 1;
-            
-            // Process next token
-            if (llama_decode(m_impl->context, next_batch) != 0) {
-                qDebug() << "Failed to decode token at position" << i;
-                llama_batch_free(next_batch);
-                break;
-            }
-            
-            // Get logits for the next token
-            const float* logits = llama_get_logits_ith(m_impl->context, 0);
-            if (!logits) {
-                qDebug() << "Failed to get logits at position" << i;
-                llama_batch_free(next_batch);
-                break;
-            }
-            
-            // Find the token with the highest probability
-            llama_token best_token = -1;
-            float best_logit = -INFINITY;
-            const int n_vocab = llama_vocab_n_tokens(vocab);
-            
-            for (llama_token token_id = 0; token_id < n_vocab; token_id++) {
-                float logit = logits[token_id];
-                if (logit > best_logit) {
-                    best_logit = logit;
-                    best_token = token_id;
-                }
-            }
-            
-            if (best_token == -1) {
-                qDebug() << "Failed to find best token at position" << i;
-                llama_batch_free(next_batch);
-                break;
-            }
-            
-            // Add token to response
-            response_tokens.push_back(best_token);
-            
-            // Check for end of text or stop conditions
-            if (best_token == llama_vocab_eos(vocab)) {
-                qDebug() << "End of text token found at position" << i;
-                llama_batch_free(next_batch);
-                break;
-            }
-            
-            // Check for repeated tokens
-            if (response_tokens.size() > 3 && 
-                response_tokens[response_tokens.size()-1] == response_tokens[response_tokens.size()-2] &&
-                response_tokens[response_tokens.size()-2] == response_tokens[response_tokens.size()-3]) {
-                qDebug() << "Stop condition met: repeated tokens at position" << i;
-                llama_batch_free(next_batch);
-                break;
+        // Pick up this document's prompt state from an earlier run if memory has little of it
+        QString sessionPath;
+        if (!document.isEmpty() && m_impl->sessionCache && m_impl->sessionCache->isEnabled()) {
+            sessionPath = m_impl->sessionCache->sessionPath(document);
+            if (QFile::exists(sessionPath) && m_impl->restoreSession(sessionPath, tokens)) {
+                m_impl->sessionCache->touch(sessionPath);
+                qDebug() << "Restored KV session of" << m_impl->promptTokens.size() << "tokens";
             }
-            
-            // Check for empty tokens
-            char piece[8];
-            int length = llama_token_to_piece(vocab, best_token, piece, sizeof(piece), 0, false);
-            if (length <= 0) {
-                consecutive_empty_tokens++;
-                if (consecutive_empty_tokens >= max_empty_tokens) {
-                    qDebug() << "Stop condition met: too many consecutive empty tokens at position" << i;
-                    llama_batch_free(next_batch);
-                    break;
+        }
+
+        // Decode the prompt except its last token, reusing whatever prefix is already cached
+        const int reused = m_impl->syncPrompt(tokens, tokens.size() - 1, llama_n_batch(m_impl->context), nullptr);
+        if (reused < 0) {
+            qDebug() << "Failed to decode prompt";
+            return QString();
+        }
+        qDebug() << "Reused" << reused << "cached prompt tokens, decoded" << (n_tokens - 1 - reused);
+
+        // Fork the generation sequence off the cached prompt. Shifting keeps the whole
+        // prompt and only discards the oldest generated tokens.
+        llama_kv_self_seq_cp(m_impl->context, kPromptSeq, kGenerateSeq, -1, -1);
+        m_impl->sharedPrompt = m_impl->promptTokens.size();
+        m_impl->generatePos = n_tokens - 1;
+        m_impl->generateKeep = n_tokens;
+
+        // The answer stops at the task's stop sequences or when the budget predicted from
+        // the length of the document runs out
+        const int inputTokens = document.isEmpty() ? n_tokens
+                                                   : static_cast<int>(m_impl->tokenize(document.toStdString(), false).size());
+        const int budget = responseBudget(task, inputTokens);
+        StopMatcher stops(stopSequences(task));
+
+        // Stream the response as it is generated, a whole character at a time
+        std::string pendingText;
+        const std::vector<llama_token>& response_tokens = m_impl->generate(tokens.back(), budget, &stops,
+            [this, &pendingText](const char* piece, int length) {
+                pendingText.append(piece, length);
+                const size_t complete = completeUtf8Length(pendingText);
+                if (complete > 0) {
+                    emit responseChunk(QString::fromUtf8(pendingText.data(), complete));
+                    pendingText.erase(0, complete);
                 }
-            } else {
-                consecutive_empty_tokens = 0;
-            }
-            
-            llama_batch_free(next_batch);
+            });
+        qDebug() << "Generated" << response_tokens.size() << "response tokens of a budget of" << budget
+                 << "for" << inputTokens << "input tokens, stopped by" << stopReasonName(m_impl->stats.stopReason)
+                 << m_impl->stats.stopSequence;
+
+        m_impl->stats.promptTokens = n_tokens;
+        m_impl->stats.reusedPromptTokens = reused;
+        m_impl->stats.generatedTokens = response_tokens.size();
+        if (m_impl->stats.shiftedTokens > 0) {
+            qDebug() << "Context shifting discarded" << m_impl->stats.shiftedTokens << "tokens";
+            emit statusUpdate(QString("Long response: shifted %1 tokens out of the context").arg(m_impl->stats.shiftedTokens));
+        }
+        {
+            QMutexLocker statsLocker(&m_impl->statsMutex);
+            m_impl->publishedStats = m_impl->stats;
+        }
+
+        // Persist the prompt state for this document if it has changed since it was saved
+        const bool decodedPrompt = reused < n_tokens - 1;
+        if (!sessionPath.isEmpty() && (decodedPrompt || !QFile::exists(sessionPath))) {
+            m_impl->saveSession(sessionPath);
         }
         
-        qDebug() << "Generated" << response_tokens.size() << "response tokens";
-        
-        // Convert tokens to text
-        std::string response;
-        char piece[8];
-        for (const auto& token : response_tokens) {
-            int length = llama_token_to_piece(vocab, token, piece, sizeof(piece), 0, false);
-            if (length > 0) {
-                response.append(piece, length);
-            }
+        const std::string& response = m_impl->responseText;
+
+        // Keep the conversation going for follow-up questions
+        if (response_tokens.empty()) {
+            m_impl->chatMessages.clear();
+        } else if (!m_impl->chatMessages.empty()) {
+            m_impl->chatMessages.push_back({"assistant", response});
+            m_impl->chatText = prompt_std + m_impl->detokenize(response_tokens.data(), response_tokens.size() - 1);
+            m_impl->conversationOpen = true;
         }
         
         // Clean up the response
@@ -338,59 +1322,556 @@ QString LLMProcessor::processText(const QString& prompt)
 
 QString LLMProcessor::generateStudyGuide(const QString& inputText)
 {
+    std::shared_ptr<const TokenizerService> tokenizer;
+    {
+        QMutexLocker locker(&m_impl->retrievalMutex);
+        tokenizer = m_impl->tokenizer;
+    }
+    if (tokenizer && tokenizer->countTokens(inputText) > maxInputTokens()) {
+        return generateStudyGuideInParts(inputText, *tokenizer);
+    }
+
     QString prompt = formatStudyGuidePrompt(inputText);
-    return processText(prompt);
+    return processText(prompt, inputText, ModelTask::StudyGuide);
+}
+
+// Documents longer than one prompt get a study guide per part, in document order
+QString LLMProcessor::generateStudyGuideInParts(const QString& inputText, const TokenizerService& tokenizer)
+{
+    const QStringList parts = splitIntoParts(inputText, tokenizer);
+    qDebug() << "Generating the study guide in" << parts.size() << "parts";
+
+    QString guide;
+    for (int i = 0; i < parts.size(); i++) {
+        emit statusUpdate(QString("Generating study guide part %1 of %2...").arg(i + 1).arg(parts.size()));
+        emit responseChunk(QString("Part %1 of %2\n\n").arg(i + 1).arg(parts.size()));
+        const QString result = processText(formatStudyGuidePrompt(parts[i]), parts[i], ModelTask::StudyGuide);
+        if (result.isEmpty()) {
+            return QString();
+        }
+        emit responseChunk("\n\n");
+        guide += QString("Part %1 of %2\n\n%3\n\n").arg(i + 1).arg(parts.size()).arg(result.trimmed());
+    }
+    return guide.trimmed();
+}
+
+// Cuts the text into parts within the input budget. Parts end at paragraph breaks; a
+// paragraph that is too long by itself is cut at sentence ends, and a sentence that is
+// too long at a proportional character count.
+QStringList LLMProcessor::splitIntoParts(const QString& text, const TokenizerService& tokenizer)
+{
+    static const QRegularExpression paragraphBreak("\n\\s*\n");
+    static const QRegularExpression sentenceEnd("(?<=[.!?])\\s+");
+    const int budget = maxInputTokens();
+
+    QStringList parts;
+    QString current;
+    int currentTokens = 0;
+    auto add = [&](const QString& piece, int tokens) {
+        // One token for the paragraph break joining the pieces
+        if (!current.isEmpty() && currentTokens + tokens + 1 > budget) {
+            parts.append(current);
+            current.clear();
+            currentTokens = 0;
+        }
+        if (!current.isEmpty()) {
+            current += "\n\n";
+            currentTokens++;
+        }
+        current += piece;
+        currentTokens += tokens;
+    };
+
+    for (const QString& paragraph : text.split(paragraphBreak, Qt::SkipEmptyParts)) {
+        const int tokens = tokenizer.countTokens(paragraph);
+        if (tokens <= budget) {
+            add(paragraph, tokens);
+            continue;
+        }
+        for (const QString& sentence : paragraph.split(sentenceEnd, Qt::SkipEmptyParts)) {
+            const int sentenceTokens = tokenizer.countTokens(sentence);
+            if (sentenceTokens <= budget) {
+                add(sentence, sentenceTokens);
+                continue;
+            }
+            const qsizetype step = std::max<qsizetype>(1, sentence.size() * budget / sentenceTokens * 9 / 10);
+            for (qsizetype start = 0; start < sentence.size(); start += step) {
+                const QString slice = sentence.mid(start, step);
+                add(slice, tokenizer.countTokens(slice));
+            }
+        }
+    }
+    if (!current.isEmpty()) {
+        parts.append(current);
+    }
+    return parts;
 }
 
 QString LLMProcessor::generateQuiz(const QString& inputText)
 {
     QString prompt = formatQuizPrompt(inputText);
-    return processText(prompt);
+    return processText(prompt, inputText, ModelTask::Quiz);
 }
 
 QString LLMProcessor::generateFlashcards(const QString& inputText)
 {
     QString prompt = formatFlashcardsPrompt(inputText);
-    return processText(prompt);
+    return processText(prompt, inputText, ModelTask::Flashcards);
 }
 
 QString LLMProcessor::generateEnumerations(const QString& inputText)
 {
     QString prompt = formatEnumerationsPrompt(inputText);
-    return processText(prompt);
+    return processText(prompt, inputText, ModelTask::Enumerations);
 }
 
 QFuture<QString> LLMProcessor::generateStudyGuideAsync(const QString& input)
 {
-    return QtConcurrent::run([this, input]() {
+    return runAsync([this, input]() {
         return generateStudyGuide(input);
     });
 }
 
 QFuture<QString> LLMProcessor::generateQuizAsync(const QString& input)
 {
-    return QtConcurrent::run([this, input]() {
+    return runAsync([this, input]() {
         return generateQuiz(input);
     });
 }
 
 QFuture<QString> LLMProcessor::generateFlashcardsAsync(const QString& input)
 {
-    return QtConcurrent::run([this, input]() {
+    return runAsync([this, input]() {
         return generateFlashcards(input);
     });
 }
 
 QFuture<QString> LLMProcessor::generateEnumerationsAsync(const QString& input)
 {
-    return QtConcurrent::run([this, input]() {
+    return runAsync([this, input]() {
         return generateEnumerations(input);
     });
 }
 
+// Counts the request as in flight from the moment it is queued
+QFuture<QString> LLMProcessor::runAsync(std::function<QString()> request)
+{
+    m_impl->activeRequests++;
+    return QtConcurrent::run([this, request]() {
+        struct Done {
+            std::atomic<int>& active;
+            ~Done() { active--; }
+        } done{m_impl->activeRequests};
+        return request();
+    });
+}
+
+bool LLMProcessor::isBusy() const
+{
+    return m_impl->activeRequests > 0;
+}
+
+QString LLMProcessor::sendFollowUp(const QString& message)
+{
+    m_impl->requestSerial++;
+    QMutexLocker locker(&m_impl->mutex);
+    Impl::ThreadpoolPause pauseThreads{*m_impl};
+    scheduleIdleTeardown();
+
+    if (!m_impl->ensureContext() || m_impl->chatMessages.empty()) {
+        emit error("There is no conversation to follow up on");
+        return QString();
+    }
+
+    try {
+        m_impl->chatMessages.push_back({"user", message.toStdString()});
+        const std::string formatted = m_impl->applyChatTemplate(m_impl->chatMessages, true);
+
+        // Only the text past what is already decoded needs to go through the model
+        std::vector<llama_token> tokens;
+        const bool continues = !formatted.empty() && formatted.compare(0, m_impl->chatText.size(), m_impl->chatText) == 0;
+        if (continues) {
+            tokens = m_impl->tokenize(formatted.substr(m_impl->chatText.size()), false, true);
+        } else {
+            qDebug() << "Chat template output diverged from the cache, re-encoding the conversation";
+            m_impl->chatText.clear();
+            llama_kv_self_seq_rm(m_impl->context, kGenerateSeq, -1, -1);
+            m_impl->generatePos = 0;
+            m_impl->sharedPrompt = 0;
+            tokens = m_impl->tokenize(formatted, true, true);
+            // As after the first request, the document turn with its instructions is kept
+            // and shifting discards the turns after it
+            const std::string firstTurn = m_impl->applyChatTemplate({m_impl->chatMessages.front()}, true);
+            m_impl->generateKeep = std::min<int>(tokens.size(), m_impl->tokenize(firstTurn, true, true).size());
+        }
+        if (tokens.empty()) {
+            m_impl->chatMessages.pop_back();
+            emit error("Failed to tokenize follow-up question");
+            return QString();
+        }
+
+        const int n_tokens = tokens.size();
+        const int n_ctx = llama_n_ctx(m_impl->context);
+        m_impl->stats = GenerationStats();
+        m_impl->stats.promptTokens = n_tokens;
+        if (m_impl->generatePos + n_tokens + kFollowUpReserve > n_ctx &&
+            m_impl->shiftGenerateSeq(n_tokens + kFollowUpReserve) == 0) {
+            m_impl->chatMessages.pop_back();
+            emit error("The conversation no longer fits in the model context");
+            return QString();
+        }
+
+        qDebug() << "Follow-up: decoding" << n_tokens << "new tokens at position" << m_impl->generatePos;
+        if (!m_impl->decodeTokens(kGenerateSeq, tokens.data(), n_tokens - 1, m_impl->generatePos)) {
+            // Drop the part of the question that made it into the cache, so the conversation
+            // still ends with the last answer. A re-encoded one has nothing left to go on.
+            llama_kv_self_seq_rm(m_impl->context, kGenerateSeq, m_impl->generatePos, -1);
+            m_impl->chatMessages.pop_back();
+            if (!continues) {
+                m_impl->endConversation();
+            }
+            emit error("Failed to decode follow-up question");
+            return QString();
+        }
+        m_impl->generatePos += n_tokens - 1;
+
+        const std::vector<llama_token>& response_tokens = m_impl->generate(tokens.back(), kMaxResponseTokens);
+        m_impl->stats.generatedTokens = response_tokens.size();
+        {
+            QMutexLocker statsLocker(&m_impl->statsMutex);
+            m_impl->publishedStats = m_impl->stats;
+        }
+        std::string response = m_impl->detokenize(response_tokens.data(), response_tokens.size());
+        if (response_tokens.empty()) {
+            m_impl->endConversation();
+            return QString();
+        }
+
+        m_impl->chatMessages.push_back({"assistant", response});
+        m_impl->chatText = formatted + m_impl->detokenize(response_tokens.data(), response_tokens.size() - 1);
+
+        return QString::fromStdString(response).trimmed();
+    } catch (const std::exception& e) {
+        qDebug() << "Exception in sendFollowUp:" << e.what();
+        emit error(QString("Error processing follow-up: %1").arg(e.what()));
+        return QString();
+    }
+}
+
+QFuture<QString> LLMProcessor::sendFollowUpAsync(const QString& message)
+{
+    return runAsync([this, message]() {
+        return sendFollowUp(message);
+    });
+}
+
+bool LLMProcessor::hasConversation() const
+{
+    return m_impl->conversationOpen;
+}
+
+void LLMProcessor::setIdleTimeout(int msecs)
+{
+    m_impl->idleTimer->setInterval(msecs);
+    scheduleIdleTeardown();
+}
+
+void LLMProcessor::setThreadConfig(const InferenceThreadConfig& config)
+{
+    QMutexLocker locker(&m_impl->threadConfigMutex);
+    m_impl->threadConfig = config;
+    m_impl->threadConfig.decodeThreads = std::clamp(config.decodeThreads, 1, GGML_MAX_N_THREADS);
+    m_impl->threadConfig.prefillThreads = std::clamp(config.prefillThreads, 1, GGML_MAX_N_THREADS);
+    m_impl->threadConfigChanged = true;
+}
+
+InferenceThreadConfig LLMProcessor::threadConfig() const
+{
+    QMutexLocker locker(&m_impl->threadConfigMutex);
+    return m_impl->threadConfig;
+}
+
+bool LLMProcessor::loadAdapter(ModelTask task, const QString& path, float scale)
+{
+    QMutexLocker locker(&m_impl->mutex);
+    if (!m_impl->model) {
+        emit error("Load a model before its adapters");
+        return false;
+    }
+
+    const Impl::Adapter current = m_impl->adapterFor(task);
+    if (current.lora && current.path == path) {
+        m_impl->adapters[task].scale = scale;
+        if (m_impl->activeAdapter.lora == current.lora) {
+            m_impl->activateAdapter(m_impl->adapters[task]);
+        }
+        return true;
+    }
+
+    // Reuse the adapter if another task already loaded the same file
+    llama_adapter_lora* lora = nullptr;
+    for (const auto& entry : m_impl->adapters) {
+        if (entry.second.path == path) {
+            lora = entry.second.lora;
+        }
+    }
+    if (!lora) {
+        QElapsedTimer timer;
+        timer.start();
+        lora = llama_adapter_lora_init(m_impl->model, QDir::toNativeSeparators(path).toStdString().c_str());
+        if (!lora) {
+            emit error(QString("Failed to load LoRA adapter %1").arg(QFileInfo(path).fileName()));
+            return false;
+        }
+        qDebug() << "Loaded LoRA adapter" << path << "in" << timer.elapsed() << "ms";
+    }
+
+    m_impl->releaseAdapter(task);
+    m_impl->adapters[task] = Impl::Adapter{lora, scale, path};
+    return true;
+}
+
+void LLMProcessor::clearAdapter(ModelTask task)
+{
+    QMutexLocker locker(&m_impl->mutex);
+    m_impl->releaseAdapter(task);
+}
+
+int LLMProcessor::maxInputTokens()
+{
+    return kContextSize - kRetrievalReserve;
+}
+
+void LLMProcessor::setTokenizer(std::shared_ptr<const TokenizerService> tokenizer)
+{
+    QMutexLocker locker(&m_impl->retrievalMutex);
+    m_impl->tokenizer = std::move(tokenizer);
+}
+
+void LLMProcessor::setRetrievalIndex(RetrievalIndex* index)
+{
+    QMutexLocker locker(&m_impl->retrievalMutex);
+    m_impl->retrieval = index;
+    m_impl->retrievalKey.clear();
+    m_impl->retrievalContext.clear();
+}
+
+void LLMProcessor::setResidencyPolicy(const ModelResidencyPolicy& policy)
+{
+    QMutexLocker locker(&m_impl->residencyMutex);
+    m_impl->residencyPolicy = policy;
+}
+
+ModelResidencyPolicy LLMProcessor::residencyPolicy() const
+{
+    QMutexLocker locker(&m_impl->residencyMutex);
+    return m_impl->residencyPolicy;
+}
+
+ModelResidency LLMProcessor::residency() const
+{
+    ModelResidency result;
+    if (!m_impl->model) {
+        return result;
+    }
+
+    size_t resident = 0;
+    size_t mapped = 0;
+    if (llama_model_mmap_residency(m_impl->model, &resident, &mapped)) {
+        result.residentBytes = static_cast<qint64>(resident);
+        result.mappedBytes = static_cast<qint64>(mapped);
+    }
+    QMutexLocker locker(&m_impl->residencyMutex);
+    result.locked = m_impl->loadedResidency.lockInMemory;
+    return result;
+}
+
+// Restarts the idle countdown; safe to call from worker threads
+void LLMProcessor::scheduleIdleTeardown()
+{
+    QMetaObject::invokeMethod(this, [this]() {
+        if (m_impl->idleTimer->interval() > 0) {
+            m_impl->idleTimer->start();
+        } else {
+            m_impl->idleTimer->stop();
+        }
+    }, Qt::QueuedConnection);
+}
+
+// Frees the context with its KV cache and compute buffers and lets the OS reclaim the
+// mapped weights. The cached prompt and any open conversation are snapshotted so the
+// next request can pick up where this one left off.
+void LLMProcessor::suspendContext()
+{
+    // A request is running; it restarts the countdown itself
+    std::unique_lock<QMutex> locker(m_impl->mutex, std::try_to_lock);
+    if (!locker.owns_lock()) {
+        scheduleIdleTeardown();
+        return;
+    }
+    if (!m_impl->context) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // A prompt the conversation still shares is rebuilt from the conversation's snapshot
+    const size_t shared = m_impl->conversationOpen ? m_impl->sharedPrompt : 0;
+    if (m_impl->promptTokens.size() > shared) {
+        const QString path = QDir::toNativeSeparators(m_impl->sessionCache->snapshotPath("prompt"));
+        llama_state_seq_save_file(m_impl->context, path.toStdString().c_str(), kPromptSeq,
+                                  m_impl->promptTokens.data(), m_impl->promptTokens.size());
+    }
+    if (m_impl->conversationOpen) {
+        const QString path = QDir::toNativeSeparators(m_impl->sessionCache->snapshotPath("conversation"));
+        llama_state_seq_save_file(m_impl->context, path.toStdString().c_str(), kGenerateSeq, nullptr, 0);
+    }
+
+    llama_free(m_impl->context);
+    m_impl->context = nullptr;
+    m_impl->suspended = true;
+    // Locked weights stay in RAM by policy
+    if (!residency().locked) {
+        llama_model_mmap_advise(m_impl->model, LLAMA_MMAP_ADVICE_COLD);
+    }
+
+    qDebug() << "Idle: released the context in" << timer.elapsed() << "ms";
+}
+
+GenerationStats LLMProcessor::lastGenerationStats() const
+{
+    QMutexLocker locker(&m_impl->statsMutex);
+    return m_impl->publishedStats;
+}
+
+void LLMProcessor::prefillAsync(const QString& inputText)
+{
+    if (!m_impl->model || inputText.trimmed().isEmpty()) {
+        return;
+    }
+
+    m_impl->prefillFutures.erase(std::remove_if(m_impl->prefillFutures.begin(), m_impl->prefillFutures.end(),
+                                                [](const QFuture<void>& prefill) { return prefill.isFinished(); }),
+                                 m_impl->prefillFutures.end());
+
+    const quint64 serial = ++m_impl->requestSerial;
+    m_impl->prefillFutures.append(QtConcurrent::run([this, inputText, serial]() {
+        // Formatted here: retrieval embeds the input, which is no work for the GUI thread
+        prefillPrompt(formatStudyGuidePrompt(inputText), serial);
+    }));
+}
+
+void LLMProcessor::prefillPrompt(const QString& prompt, quint64 serial)
+{
+    QMutexLocker locker(&m_impl->mutex);
+    Impl::ThreadpoolPause pauseThreads{*m_impl};
+    if (m_impl->requestSerial != serial) {
+        return;
+    }
+    // Switching adapters would throw away the open conversation of another task for a
+    // guess; the study guide request decodes its prompt itself if it comes
+    const Impl::Adapter adapter = m_impl->adapterFor(ModelTask::StudyGuide);
+    if (m_impl->conversationOpen
+        && (adapter.lora != m_impl->activeAdapter.lora || adapter.scale != m_impl->activeAdapter.scale)) {
+        qDebug() << "Skipping prefill: the conversation of another adapter is open";
+        return;
+    }
+    if (!m_impl->ensureContext()) {
+        return;
+    }
+    scheduleIdleTeardown();
+    m_impl->activateAdapter(adapter);
+
+    std::vector<llama_token> tokens = m_impl->tokenize(m_impl->formatPrompt(prompt), true, true);
+    if (tokens.empty() || tokens.size() >= llama_n_ctx(m_impl->context)) {
+        return;
+    }
+
+    // Stay out of the way of the GUI: lowest priority and half the batch threads
+    QThread* thread = QThread::currentThread();
+    const QThread::Priority priority = thread->priority();
+    thread->setPriority(QThread::LowestPriority);
+    const int n_threads = llama_n_threads(m_impl->context);
+    const int n_threads_batch = llama_n_threads_batch(m_impl->context);
+    llama_set_n_threads(m_impl->context, n_threads, std::max(1, n_threads_batch / 2));
+
+    const int reused = m_impl->syncPrompt(tokens, tokens.size() - 1, kPrefillChunk, [this, serial]() {
+        return m_impl->requestSerial != serial;
+    });
+
+    llama_set_n_threads(m_impl->context, n_threads, n_threads_batch);
+    thread->setPriority(priority);
+
+    if (reused < 0) {
+        qDebug() << "Prefill interrupted, cached prompt tokens:" << m_impl->promptTokens.size();
+    } else {
+        qDebug() << "Prefilled prompt: reused" << reused << "tokens, cached" << m_impl->promptTokens.size();
+    }
+}
+
+// Library passages closest to the input, formatted for the prompt. Passages are taken
+// best first while they fit the token budget.
+QString LLMProcessor::retrievedContext(const QString& input)
+{
+    // Embedding and search run outside the lock, which tokenizing prompts takes as well
+    RetrievalIndex* index;
+    std::shared_ptr<const TokenizerService> tokenizer;
+    {
+        QMutexLocker locker(&m_impl->retrievalMutex);
+        index = m_impl->retrieval;
+        tokenizer = m_impl->tokenizer;
+    }
+    if (!index || !tokenizer || index->passageCount() == 0) {
+        return QString();
+    }
+    const QString key = index->libraryPath() + QString::number(index->passageCount()) + input;
+    {
+        QMutexLocker locker(&m_impl->retrievalMutex);
+        if (key == m_impl->retrievalKey) {
+            return m_impl->retrievalContext;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const int inputTokens = tokenizer->countTokens(input);
+    int budget = std::min(kMaxRetrievalTokens,
+                          static_cast<int>(m_impl->contextParams.n_ctx) - inputTokens - kRetrievalReserve);
+
+    QString context;
+    const QList<RetrievedPassage> passages = index->search(input, kRetrievalTopK);
+    for (const RetrievedPassage& passage : passages) {
+        const QString entry = QString("[%1] %2\n").arg(passage.source, passage.text);
+        const int tokens = tokenizer->countTokens(entry);
+        if (tokens > budget) {
+            continue;
+        }
+        context += entry;
+        budget -= tokens;
+    }
+    if (!context.isEmpty()) {
+        context = "Related passages from the course readings:\n" + context + "\n";
+    }
+    qDebug() << "Retrieved" << passages.size() << "passages," << context.size() << "characters kept, in"
+             << timer.elapsed() << "ms";
+
+    // Unless the index was swapped in the meantime
+    QMutexLocker locker(&m_impl->retrievalMutex);
+    if (m_impl->retrieval == index) {
+        m_impl->retrievalKey = key;
+        m_impl->retrievalContext = context;
+    }
+    return context;
+}
+
+// Every prompt starts with the document so the different artifact types share the
+// same cached KV prefix; only the trailing instructions differ.
 QString LLMProcessor::formatStudyGuidePrompt(const QString& input)
 {
-    return QString("Create a study guide from this text. Follow these instructions exactly:\n\n"
+    return QString("Text to analyze:\n%1\n\n"
+                  "%2"
+                  "Create a study guide from the text above. Follow these instructions exactly:\n\n"
                   "1. KEY TERMS AND DEFINITIONS:\n"
                   "   - Extract the most important technical terms and concepts\n"
                   "   - Write clear, complete definitions for each term\n"
@@ -403,23 +1884,30 @@ QString LLMProcessor::formatStudyGuidePrompt(const QString& input)
                   "   - Write 2-3 sentences summarizing the main points\n"
                   "   - Focus on the most important information\n"
                   "   - Keep it clear and concise\n\n"
-                  "Text to analyze:\n%1").arg(input);
+                  "Study Guide:").arg(input, retrievedContext(input));
 }
 
 QString LLMProcessor::formatQuizPrompt(const QString& input)
 {
-    return QString("Create a quiz with multiple choice questions based on this text:\n\n%1\n\n"
-                  "Quiz:").arg(input);
-        }
+    return QString("Text to analyze:\n%1\n\n"
+                  "Create a quiz with multiple choice questions based on the text above.\n"
+                  "Write each question as 'Q: question', then its choices as 'A)' to 'D)' "
+                  "on separate lines, then 'Answer: letter' on its own line.\n\n"
+                  "Quiz:\n").arg(input);
+}
 
 QString LLMProcessor::formatFlashcardsPrompt(const QString& input)
 {
-    return QString("Create flashcards (question on front, answer on back) based on this text:\n\n%1\n\n"
-                  "Flashcards:").arg(input);
+    return QString("Text to analyze:\n%1\n\n"
+                  "Create flashcards (question on front, answer on back) based on the text above.\n"
+                  "Write each card as 'Front: question' on one line and 'Back: answer' on the next.\n\n"
+                  "Flashcards:\n").arg(input);
 }
 
 QString LLMProcessor::formatEnumerationsPrompt(const QString& input)
 {
-    return QString("Create a list of key points and enumerations from this text:\n\n%1\n\n"
-                  "Key Points:").arg(input);
-} 
\ No newline at end of file
+    return QString("Text to analyze:\n%1\n\n"
+                  "Create a list of key points and enumerations from the text above.\n"
+                  "Write each point on its own line starting with '- '.\n\n"
+                  "Key Points:\n").arg(input);
+}
@@ -4,8 +4,80 @@
 #include <QObject>
 #include <QString>
 #include <QFuture>
+#include <QList>
+#include <QStringList>
+#include <functional>
 #include <memory>
 
+class RetrievalIndex;
+class TokenizerService;
+
+// Why the decode loop of a request ended
+enum class StopReason {
+    None,           // nothing was generated
+    EndOfText,
+    StopSequence,   // the text reached one of the task's stop sequences
+    Budget,         // the request's token budget ran out
+    Repetition,     // the same token three times in a row
+    EmptyTokens,    // too many tokens without text in a row
+    ContextFull,
+    Error,
+};
+
+// Bookkeeping of the most recent generation request
+struct GenerationStats {
+    int promptTokens = 0;
+    int reusedPromptTokens = 0;
+    int generatedTokens = 0;
+    int shiftedTokens = 0;   // tokens discarded by context shifting to stay within n_ctx
+    int tokenBudget = 0;     // tokens the request was allowed to generate
+    StopReason stopReason = StopReason::None;
+    QString stopSequence;    // the stop sequence that ended the response, if any
+};
+
+// Compute threads the model runs on. They belong to the processor rather than to Qt's
+// thread pools, and sleep between requests.
+struct InferenceThreadConfig {
+    int decodeThreads = 4;      // threads of single-token generation steps
+    int prefillThreads = 4;     // threads of prompt batches
+    QList<int> decodeCpus;      // cores to pin each pool to; empty keeps the OS affinity
+    QList<int> prefillCpus;
+    bool strictCpu = false;     // pin every thread to its own core of the list
+    int priority = 0;           // ggml_sched_priority: 0 normal .. 3 realtime
+    int decodePoll = 50;        // spinning between graphs, 0 (sleep) .. 100 (aggressive)
+    int prefillPoll = 0;
+};
+
+// How the model weights are kept in RAM. The weights are memory-mapped from the model
+// file; by default the OS pages them in while loading and may evict them under pressure.
+struct ModelResidencyPolicy {
+    enum class Numa {
+        Off,        // leave placement to the OS
+        Distribute, // spread threads and first-touch pages evenly over the nodes
+        Isolate,    // keep threads on the node the process started on
+    };
+
+    bool lockInMemory = false;       // mlock the weights so they are never paged out
+    bool hugePages = false;          // back the mapping with transparent huge pages
+    Numa numa = Numa::Off;           // fixed by the first initialize of the process
+    bool backgroundPrefetch = false; // map lazily and read the weights in on a worker thread
+};
+
+// How much of the mapped model is currently in RAM
+struct ModelResidency {
+    qint64 residentBytes = 0;
+    qint64 mappedBytes = 0;
+    bool locked = false;
+};
+
+// Generators of the processor, each of which can have its own model and LoRA adapter
+enum class ModelTask {
+    StudyGuide,
+    Quiz,
+    Flashcards,
+    Enumerations,
+};
+
 class LLMProcessor : public QObject
 {
     Q_OBJECT
@@ -18,7 +90,8 @@ public:
     bool initialize(const QString& modelPath);
     void cleanup();
 
-    // Text processing functions
+    // Text processing functions. Study guides of inputs over maxInputTokens() are
+    // generated part by part when the processor has a tokenizer.
     QString generateStudyGuide(const QString& inputText);
     QString generateQuiz(const QString& inputText);
     QString generateFlashcards(const QString& inputText);
@@ -30,13 +103,68 @@ public:
     QFuture<QString> generateFlashcardsAsync(const QString& input);
     QFuture<QString> generateEnumerationsAsync(const QString& input);
 
+    // Follow-up questions on the result of the last request. The conversation keeps its
+    // KV cache between turns, so each question only decodes the new message.
+    QString sendFollowUp(const QString& message);
+    QFuture<QString> sendFollowUpAsync(const QString& message);
+    bool hasConversation() const;
+
+    // A generation or follow-up request is queued or running
+    bool isBusy() const;
+
+    GenerationStats lastGenerationStats() const;
+
+    // Free the context after this long without requests; 0 keeps it for the process lifetime.
+    // The next request recreates it and restores the cached prompt and conversation.
+    void setIdleTimeout(int msecs);
+
+    // Takes effect from the next request; the pools are rebuilt on the worker thread
+    void setThreadConfig(const InferenceThreadConfig& config);
+    InferenceThreadConfig threadConfig() const;
+
+    // LoRA adapter applied to the base model while the task's requests run. Adapters are
+    // loaded once and swapped per request without touching the base weights; follow-ups
+    // keep the adapter of the request they follow. Requires an initialized model.
+    bool loadAdapter(ModelTask task, const QString& path, float scale = 1.0f);
+    void clearAdapter(ModelTask task);
+
+    // Tokens of input text that leave the context room for the instructions and the answer
+    static int maxInputTokens();
+
+    // Vocabulary-only tokenizer of the model file, shared with the rest of the app
+    void setTokenizer(std::shared_ptr<const TokenizerService> tokenizer);
+
+    // Study guide prompts quote the passages of the library closest to the input, as many
+    // as fit the room the context has left. nullptr disables retrieval.
+    void setRetrievalIndex(RetrievalIndex* index);
+
+    // Takes effect at the next initialize
+    void setResidencyPolicy(const ModelResidencyPolicy& policy);
+    ModelResidencyPolicy residencyPolicy() const;
+    // Zero mapped bytes if no model is loaded or the OS cannot tell
+    ModelResidency residency() const;
+
+    // Speculatively decode the prompt for the given input while the user is still typing.
+    // A later generation request only decodes the tokens that changed since then.
+    void prefillAsync(const QString& inputText);
+
 signals:
     void error(const QString& message);
     void statusUpdate(const QString& status);
+    // Text of the running generation request as it is produced, from the worker thread.
+    // The request's result is still the final, cleaned-up text.
+    void responseChunk(const QString& text);
 
 private:
     // Helper functions
-    QString processText(const QString& prompt);
+    QString processText(const QString& prompt, const QString& document, ModelTask task);
+    void prefillPrompt(const QString& prompt, quint64 serial);
+    QFuture<QString> runAsync(std::function<QString()> request);
+    void scheduleIdleTeardown();
+    void suspendContext();
+    QString generateStudyGuideInParts(const QString& inputText, const TokenizerService& tokenizer);
+    static QStringList splitIntoParts(const QString& text, const TokenizerService& tokenizer);
+    QString retrievedContext(const QString& input);
     QString formatStudyGuidePrompt(const QString& input);
     QString formatQuizPrompt(const QString& input);
     QString formatFlashcardsPrompt(const QString& input);
@@ -15,6 +15,7 @@
 #include <QCoreApplication>
 #include <QFuture>
 #include <QFutureWatcher>
+#include <QtConcurrent>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
@@ -26,14 +27,32 @@
 #include "quiz_page.h"
 #include "enumerations_page.h"
 #include <QTimer>
+#include <QSettings>
+#include <QFileInfo>
+
+namespace {
+
+// Imports up to this size go into the editor; longer ones are previewed page by page
+constexpr int kEditorImportChars = 200000;
+// Inputs are kept in the history up to this size
+constexpr int kHistoryInputChars = 100000;
+
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
-    , m_llmProcessor(new LLMProcessor(this))
+    , m_modelRegistry(new ModelRegistry(this))
     , m_studyGuideWatcher(new QFutureWatcher<QString>(this))
+    , m_followUpWatcher(new QFutureWatcher<QString>(this))
+    , m_importWatcher(new QFutureWatcher<ImportedDocument>(this))
+    , m_artifactWatcher(new QFutureWatcher<QString>(this))
+    , m_outputParser(new StructuredOutputParser(this))
+    , m_embedder(std::make_unique<TextEmbedder>())
+    , m_semanticCache(std::make_unique<SemanticCache>(m_embedder.get()))
+    , m_embeddingWatcher(new QFutureWatcher<std::vector<float>>(this))
+    , m_retrievalIndex(std::make_unique<RetrievalIndex>(m_embedder.get()))
     , isProcessing(false)
-    , resultsText(new QTextEdit(this))
     , currentInputText("")
 {
     qDebug() << "Starting TextMaster application...";
@@ -97,9 +116,7 @@ MainWindow::MainWindow(QWidget *parent)
     
     // Initialize LLM
     qDebug() << "Initializing LLM...";
-    if (initializeLLM()) {
-    statusBar->showMessage("Ready");
-    } else {
+    if (!initializeLLM()) {
         statusBar->showMessage("Failed to initialize LLM");
     }
     
@@ -108,6 +125,11 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    // Processors outlive the index as children of the registry
+    m_modelRegistry->setRetrievalIndex(nullptr);
+    m_libraryUpdate.waitForFinished();
+    m_importWatcher->waitForFinished();
+    homePage->setTokenCounter({}, 0);
     delete ui;
 }
 
@@ -134,6 +156,8 @@ void MainWindow::setupMenuBar()
     QAction *importAction = fileMenu->addAction("Import File");
     QAction *downloadAction = fileMenu->addAction("Download");
     QAction *copyAction = fileMenu->addAction("Copy to Clipboard");
+    fileMenu->addSeparator();
+    QAction *libraryAction = fileMenu->addAction("Set Course Library...");
     
     QMenu *helpMenu = menuBar->addMenu("Help");
     QAction *aboutAction = helpMenu->addAction("About");
@@ -141,6 +165,7 @@ void MainWindow::setupMenuBar()
     connect(importAction, &QAction::triggered, this, &MainWindow::onImportFileClicked);
     connect(downloadAction, &QAction::triggered, this, &MainWindow::onDownloadClicked);
     connect(copyAction, &QAction::triggered, this, &MainWindow::onCopyClicked);
+    connect(libraryAction, &QAction::triggered, this, &MainWindow::onSetLibraryClicked);
     connect(aboutAction, &QAction::triggered, this, &MainWindow::onAboutAction);
 }
 
@@ -177,18 +202,44 @@ void MainWindow::showHistoryPage()
 
 void MainWindow::onImportFileClicked()
 {
+    if (m_importWatcher->isRunning()) {
+        statusBar->showMessage("A file is still being imported");
+        return;
+    }
     QString fileName = QFileDialog::getOpenFileName(this, "Import Text File", "", "Text Files (*.txt);;All Files (*)");
-    if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&file);
-            QString content = in.readAll();
-            homePage->setInputText(content);
-            file.close();
-        } else {
-            QMessageBox::critical(this, "Error", "Could not open file: " + fileName);
-        }
+    if (fileName.isEmpty()) {
+        return;
+    }
+    
+    // Decoding a large file takes a while; the window stays responsive meanwhile
+    statusBar->showMessage("Importing " + QFileInfo(fileName).fileName() + "...");
+    m_importWatcher->setFuture(QtConcurrent::run([this, fileName]() {
+        return DocumentImporter::import(fileName, [this](qint64 done, qint64 total) {
+            const int percent = static_cast<int>(done * 100 / total);
+            QMetaObject::invokeMethod(this, [this, percent]() {
+                statusBar->showMessage(QString("Importing... %1%").arg(percent));
+            }, Qt::QueuedConnection);
+        });
+    }));
+}
+
+void MainWindow::onFileImported()
+{
+    const ImportedDocument document = m_importWatcher->result();
+    if (!document.isValid()) {
+        statusBar->clearMessage();
+        QMessageBox::critical(this, "Error", "Could not open file: " + document.path + "\n" + document.error);
+        return;
     }
+    
+    if (document.text.size() <= kEditorImportChars) {
+        homePage->setInputText(document.text);
+    } else {
+        homePage->setDocument(document);
+    }
+    showHomePage();
+    statusBar->showMessage(QString("Imported %1 (%2, %3 words)")
+        .arg(QFileInfo(document.path).fileName(), document.encoding).arg(document.words), 5000);
 }
 
 void MainWindow::onDownloadClicked()
@@ -198,7 +249,7 @@ void MainWindow::onDownloadClicked()
         QFile file(fileName);
         if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
             QTextStream out(&file);
-            out << resultsText->toPlainText();
+            out << resultsPage->getResults();
             file.close();
             statusBar->showMessage("File saved successfully", 3000);
     } else {
@@ -210,7 +261,7 @@ void MainWindow::onDownloadClicked()
 void MainWindow::onCopyClicked()
 {
     QClipboard *clipboard = QApplication::clipboard();
-    clipboard->setText(resultsText->toPlainText());
+    clipboard->setText(resultsPage->getResults());
     statusBar->showMessage("Copied to clipboard", 3000);
 }
 
@@ -226,7 +277,8 @@ void MainWindow::onHistoryItemClicked(QListWidgetItem* item)
 {
     int index = historyList->row(item);
     if (index >= 0 && index < processingHistory.size()) {
-        resultsText->setText(processingHistory[index].result);
+        resultsPage->setResults(processingHistory[index].result);
+        resultsPage->setFollowUpEnabled(false);
         showResultsPage();
     }
 }
@@ -238,16 +290,211 @@ void MainWindow::onAnalyzeTextClicked()
     }
     
     currentInputText = homePage->getInputText();
-    statusBar->showMessage("Generating study guide...");
     isProcessing = true;
+    m_pendingEmbedding.clear();
     
     // Show loading indicator
     QApplication::setOverrideCursor(Qt::WaitCursor);
     
-    QFuture<QString> future = m_llmProcessor->generateStudyGuideAsync(currentInputText);
+    const QString type = homePage->analysisType();
+    if (type == "quiz" || type == "flashcards" || type == "enumerations") {
+        startArtifact(type == "quiz" ? ModelTask::Quiz
+                      : type == "flashcards" ? ModelTask::Flashcards : ModelTask::Enumerations);
+        return;
+    }
+    
+    // Look for an earlier run on nearly the same text before paying for a generation.
+    // Documents generated in parts are not compared; embedding them would take long.
+    if (m_semanticCache->isEnabled() && homePage->tokenCount() <= homePage->tokenLimit()) {
+        statusBar->showMessage("Checking for similar documents...");
+        TextEmbedder* embedder = m_embedder.get();
+        const QString text = currentInputText;
+        m_embeddingWatcher->setFuture(QtConcurrent::run([embedder, text]() {
+            return embedder->embed(text);
+        }));
+        return;
+    }
+    startStudyGuide();
+}
+
+void MainWindow::onInputEmbedded()
+{
+    m_pendingEmbedding = m_embeddingWatcher->result();
+    const SemanticCache::Match match = m_semanticCache->lookup(m_pendingEmbedding);
+    qDebug() << "Closest earlier input: similarity" << match.similarity;
+    if (!match.key.isEmpty() && offerCachedResult(match)) {
+        m_pendingEmbedding.clear();
+        QApplication::restoreOverrideCursor();
+        isProcessing = false;
+        return;
+    }
+    startStudyGuide();
+}
+
+// Shows the saved study guide of a near-duplicate input if the user wants it
+bool MainWindow::offerCachedResult(const SemanticCache::Match& match)
+{
+    for (const ProcessingHistoryItem& item : processingHistory) {
+        if (item.timestamp.toString(Qt::ISODate) != match.key) {
+            continue;
+        }
+
+        QApplication::restoreOverrideCursor();
+        const auto answer = QMessageBox::question(this, "Similar text found",
+            QString("This text is %1% similar to one you analyzed on %2.\n\n"
+                    "Show the study guide generated then instead of generating a new one?")
+                .arg(qRound(match.similarity * 100))
+                .arg(item.timestamp.toString("yyyy-MM-dd hh:mm")));
+        if (answer != QMessageBox::Yes) {
+            QApplication::setOverrideCursor(Qt::WaitCursor);
+            return false;
+        }
+
+        resultsPage->setResults(item.result);
+        resultsPage->setFollowUpEnabled(false);
+        showResultsPage();
+        statusBar->showMessage("Showing the saved study guide of a similar text");
+        return true;
+    }
+    return false;
+}
+
+void MainWindow::startStudyGuide()
+{
+    statusBar->showMessage("Generating study guide...");
+    m_awaitingModel = true;
+    m_requestTask = ModelTask::StudyGuide;
+    m_modelRegistry->acquire(ModelTask::StudyGuide);
+}
+
+// Continues the request once the registry has its model loaded. The model of the
+// study guide is also loaded at startup, with no request waiting for it.
+void MainWindow::onProcessorReady(ModelTask task, LLMProcessor* processor)
+{
+    if (!m_awaitingModel || task != m_requestTask) {
+        if (processor && !isProcessing) {
+            statusBar->showMessage("Ready");
+        }
+        return;
+    }
+    m_awaitingModel = false;
+
+    if (!processor) {
+        QApplication::restoreOverrideCursor();
+        isProcessing = false;
+        statusBar->showMessage(task == ModelTask::StudyGuide ? "Failed to load a model for the study guide"
+                                                             : "Failed to load a model for this request");
+        return;
+    }
+    if (task == ModelTask::StudyGuide) {
+        runStudyGuide(processor);
+    } else {
+        runArtifact(task, processor);
+    }
+}
+
+void MainWindow::runStudyGuide(LLMProcessor* processor)
+{
+    m_conversationProcessor = processor;
+    statusBar->showMessage("Generating study guide...");
+
+    // The study guide shows up as it is written
+    m_streamTask = ModelTask::StudyGuide;
+    connect(processor, &LLMProcessor::responseChunk, this, &MainWindow::onResponseChunk, Qt::UniqueConnection);
+    resultsPage->beginStreaming();
+    resultsPage->setFollowUpEnabled(false);
+    showResultsPage();
+
+    QFuture<QString> future = processor->generateStudyGuideAsync(currentInputText);
     m_studyGuideWatcher->setFuture(future);
 }
 
+// Quizzes, flashcards and key points open on their page, which fills up as the items
+// are generated
+void MainWindow::startArtifact(ModelTask task)
+{
+    if (task == ModelTask::StudyGuide) {
+        startStudyGuide();
+        return;
+    }
+    m_awaitingModel = true;
+    m_requestTask = task;
+    m_modelRegistry->acquire(task);
+}
+
+void MainWindow::runArtifact(ModelTask task, LLMProcessor* processor)
+{
+    m_streamTask = task;
+    connect(processor, &LLMProcessor::responseChunk, this, &MainWindow::onResponseChunk, Qt::UniqueConnection);
+
+    QFuture<QString> future;
+    switch (task) {
+    case ModelTask::Quiz:
+        quizPage->clearQuestions();
+        m_outputParser->reset(StructuredOutputParser::Format::Quiz);
+        stackedWidget->setCurrentWidget(quizPage);
+        statusBar->showMessage("Generating quiz...");
+        future = processor->generateQuizAsync(currentInputText);
+        break;
+    case ModelTask::Flashcards:
+        flashcardsPage->clearFlashcards();
+        m_outputParser->reset(StructuredOutputParser::Format::Flashcards);
+        stackedWidget->setCurrentWidget(flashcardsPage);
+        statusBar->showMessage("Generating flashcards...");
+        future = processor->generateFlashcardsAsync(currentInputText);
+        break;
+    case ModelTask::StudyGuide:
+        break;
+    case ModelTask::Enumerations:
+        enumerationsPage->clearEnumerations();
+        m_outputParser->reset(StructuredOutputParser::Format::Enumerations);
+        stackedWidget->setCurrentWidget(enumerationsPage);
+        statusBar->showMessage("Generating key points...");
+        future = processor->generateEnumerationsAsync(currentInputText);
+        break;
+    }
+    m_artifactWatcher->setFuture(future);
+}
+
+void MainWindow::onResponseChunk(const QString& text)
+{
+    if (m_streamTask == ModelTask::StudyGuide) {
+        resultsPage->appendText(text);
+    } else {
+        m_outputParser->feed(text);
+    }
+}
+
+void MainWindow::onArtifactGenerated()
+{
+    QApplication::restoreOverrideCursor();
+    isProcessing = false;
+
+    const QString result = m_artifactWatcher->result();
+    m_outputParser->finish();
+    if (m_outputParser->itemCount() == 0 && !result.isEmpty()) {
+        // Nothing came through the stream; the final text may still parse
+        m_outputParser->reset(m_outputParser->format());
+        m_outputParser->feed(result);
+        m_outputParser->finish();
+    }
+
+    if (m_outputParser->itemCount() == 0) {
+        if (result.isEmpty()) {
+            statusBar->showMessage("Generation failed");
+            return;
+        }
+        // Not in a shape the page understands; show it as text instead
+        resultsPage->setResults(result);
+        resultsPage->setFollowUpEnabled(false);
+        showResultsPage();
+        statusBar->showMessage("Could not read items from the generated text");
+        return;
+    }
+    addToHistory(currentInputText, result);
+    statusBar->showMessage(QString("Generated %1 items").arg(m_outputParser->itemCount()));
+}
+
 bool MainWindow::validateInputText()
 {
     QString inputText = homePage->getInputText();
@@ -256,16 +503,22 @@ bool MainWindow::validateInputText()
         return false;
     }
     
-    // Count words
-    QRegularExpression wordRegex("\\b\\w+\\b");
-    QRegularExpressionMatchIterator i = wordRegex.globalMatch(inputText);
-    int wordCount = 0;
-    while (i.hasNext()) {
-        i.next();
-        wordCount++;
+    // Longer inputs are summarized part by part, which takes correspondingly longer.
+    // Without a tokenizer the word count stands in for the token count.
+    const int tokens = homePage->tokenCount();
+    if (tokens > homePage->tokenLimit() && homePage->analysisType() != "study_guide") {
+        QMessageBox::warning(this, "Error",
+            QString("Text is too long: %1 tokens, the model takes at most %2.").arg(tokens).arg(homePage->tokenLimit()));
+        return false;
     }
-    
-    if (wordCount > 1000) {
+    if (tokens > homePage->tokenLimit()) {
+        const int parts = (tokens + homePage->tokenLimit() - 1) / homePage->tokenLimit();
+        return QMessageBox::question(this, "Long Document",
+            QString("The text is %1 tokens, more than the model reads at once (%2).\n\n"
+                    "Generate the study guide in about %3 parts?")
+                .arg(tokens).arg(homePage->tokenLimit()).arg(parts)) == QMessageBox::Yes;
+    }
+    if (tokens < 0 && homePage->wordCount() > 1000) {
         QMessageBox::warning(this, "Error", "Text is too long. Please limit input to 1000 words.");
         return false;
     }
@@ -311,10 +564,25 @@ void MainWindow::onStudyGuideGenerated(const QString& result)
     }
 }
 
+void MainWindow::onFollowUpSubmitted(const QString& question)
+{
+    if (isProcessing || !m_conversationProcessor) {
+        resultsPage->setFollowUpEnabled(true);
+        return;
+    }
+
+    m_pendingFollowUp = question;
+    statusBar->showMessage("Answering follow-up question...");
+    isProcessing = true;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    m_followUpWatcher->setFuture(m_conversationProcessor->sendFollowUpAsync(question));
+}
+
 void MainWindow::addToHistory(const QString& input, const QString& result)
 {
     ProcessingHistoryItem item;
-    item.inputText = input;
+    item.inputText = input.left(kHistoryInputChars);
     item.result = result;
     item.timestamp = QDateTime::currentDateTime();
     
@@ -387,44 +655,216 @@ void MainWindow::saveHistory()
 
 bool MainWindow::initializeLLM()
 {
-    QString modelPath = QCoreApplication::applicationDirPath() + "/models/tinyllama-1.1b-chat-v1.0.Q4_K_M.gguf";
-    qDebug() << "Initializing LLM with model:" << modelPath;
+    QString modelDir = QCoreApplication::applicationDirPath() + "/models";
+    qDebug() << "Scanning for models in:" << modelDir;
     
-    if (!QFile::exists(modelPath)) {
+    if (m_modelRegistry->scan(modelDir) == 0) {
         QMessageBox::critical(this, "Error",
-            "Model file not found: " + modelPath + "\n\n"
-            "Please download the model from:\n"
+            "No model files found in: " + modelDir + "\n\n"
+            "Please download a model, for example from:\n"
             "https://huggingface.co/TheBloke/TinyLlama-1.1B-Chat-v1.0-GGUF\n"
             "and place it in the models directory.");
         return false;
     }
+    applyModelSettings();
+    for (ModelTask task : {ModelTask::StudyGuide, ModelTask::Quiz, ModelTask::Flashcards, ModelTask::Enumerations}) {
+        qDebug() << "Task" << static_cast<int>(task) << "runs on" << m_modelRegistry->taskModel(task);
+    }
+    
+    // The vocabulary loads in milliseconds, so the input shows its real token count
+    // while the weights are still loading
+    if (std::shared_ptr<const TokenizerService> tokenizer = m_modelRegistry->tokenizer(ModelTask::StudyGuide)) {
+        homePage->setTokenCounter([tokenizer](const QString& text) {
+            return tokenizer->countTokens(text);
+        }, LLMProcessor::maxInputTokens());
+    }
+    
+    // Near-duplicate detection and the course library need an embedding model next to
+    // the generation models
+    const QList<ModelInfo> embeddingModels = m_modelRegistry->embeddingModels();
+    if (!embeddingModels.isEmpty() && m_embedder->initialize(embeddingModels.first().path)) {
+        m_semanticCache->load("history.embeddings");
+        const QString library = QSettings().value("library/path").toString();
+        if (!library.isEmpty()) {
+            openLibrary(library);
+        }
+    }
     
-    return m_llmProcessor->initialize(modelPath);
+    // Load the study guide model up front; the others load on first use
+    m_modelRegistry->acquire(ModelTask::StudyGuide);
+    return true;
+}
+
+// Model limits, routing and runtime settings; keys that are not set keep the defaults
+void MainWindow::applyModelSettings()
+{
+    QSettings settings;
+
+    settings.beginGroup("models");
+    if (settings.contains("maxLoaded")) {
+        m_modelRegistry->setMaxLoaded(settings.value("maxLoaded").toInt());
+    }
+    if (settings.contains("memoryBudgetMiB")) {
+        m_modelRegistry->setMemoryBudget(settings.value("memoryBudgetMiB").toLongLong() * 1024 * 1024);
+    }
+    const QList<QPair<ModelTask, QString>> tasks = {
+        {ModelTask::StudyGuide, "studyGuide"}, {ModelTask::Quiz, "quiz"},
+        {ModelTask::Flashcards, "flashcards"}, {ModelTask::Enumerations, "enumerations"},
+    };
+    for (const auto& task : tasks) {
+        m_modelRegistry->setTaskModel(task.first, settings.value(task.second).toString());
+        m_modelRegistry->setTaskAdapter(task.first, settings.value(task.second + "Adapter").toString());
+    }
+    settings.endGroup();
+
+    settings.beginGroup("inference");
+    InferenceThreadConfig threads;
+    threads.decodeThreads = settings.value("decodeThreads", threads.decodeThreads).toInt();
+    threads.prefillThreads = settings.value("prefillThreads", threads.prefillThreads).toInt();
+    threads.strictCpu = settings.value("strictCpu", threads.strictCpu).toBool();
+    threads.priority = settings.value("priority", threads.priority).toInt();
+    threads.decodePoll = settings.value("decodePoll", threads.decodePoll).toInt();
+    threads.prefillPoll = settings.value("prefillPoll", threads.prefillPoll).toInt();
+    m_modelRegistry->setThreadConfig(threads);
+    if (settings.contains("idleTimeoutSec")) {
+        m_modelRegistry->setIdleTimeout(settings.value("idleTimeoutSec").toInt() * 1000);
+    }
+    settings.endGroup();
+
+    settings.beginGroup("residency");
+    ModelResidencyPolicy residency;
+    residency.lockInMemory = settings.value("lockInMemory", residency.lockInMemory).toBool();
+    residency.hugePages = settings.value("hugePages", residency.hugePages).toBool();
+    residency.backgroundPrefetch = settings.value("backgroundPrefetch", residency.backgroundPrefetch).toBool();
+    const QString numa = settings.value("numa").toString();
+    residency.numa = numa == "distribute" ? ModelResidencyPolicy::Numa::Distribute
+                   : numa == "isolate"    ? ModelResidencyPolicy::Numa::Isolate
+                                          : ModelResidencyPolicy::Numa::Off;
+    m_modelRegistry->setResidencyPolicy(residency);
+    settings.endGroup();
+}
+
+void MainWindow::onSetLibraryClicked()
+{
+    if (!m_embedder->isEnabled()) {
+        QMessageBox::information(this, "Course Library",
+            "Indexing a library needs an embedding model, such as a GGUF of "
+            "all-MiniLM-L6-v2 or nomic-embed-text, in the models directory.");
+        return;
+    }
+    if (m_libraryUpdate.isRunning()) {
+        statusBar->showMessage("The course library is still being indexed");
+        return;
+    }
+
+    const QString path = QFileDialog::getExistingDirectory(this, "Course Library",
+        QSettings().value("library/path", QDir::homePath()).toString());
+    if (path.isEmpty()) {
+        return;
+    }
+    QSettings().setValue("library/path", path);
+    openLibrary(path);
+}
+
+// Opens the index of the folder and brings it up to date in the background. Study
+// guides search whatever is indexed so far while the update runs.
+void MainWindow::openLibrary(const QString& path)
+{
+    if (!m_retrievalIndex->open(path)) {
+        statusBar->showMessage("Failed to open the course library index");
+        return;
+    }
+    m_modelRegistry->setRetrievalIndex(m_retrievalIndex.get());
+
+    RetrievalIndex* index = m_retrievalIndex.get();
+    m_libraryUpdate = QtConcurrent::run([this, index]() {
+        auto report = [this](const QString& message) {
+            QMetaObject::invokeMethod(this, [this, message]() {
+                statusBar->showMessage(message);
+            }, Qt::QueuedConnection);
+        };
+        const bool ok = index->update([&report](int done, int total) {
+            report(QString("Indexing course library: %1 of %2 files").arg(done).arg(total));
+        });
+        report(ok ? QString("Course library: %1 passages indexed").arg(index->passageCount())
+                  : QString("Failed to index the course library"));
+    });
 }
 
 void MainWindow::connectSignals()
 {
     // Connect LLM signals
-    connect(m_llmProcessor, &LLMProcessor::error, this, &MainWindow::handleLLMError);
-    connect(m_llmProcessor, &LLMProcessor::statusUpdate, this, &MainWindow::handleLLMStatus);
+    connect(m_modelRegistry, &ModelRegistry::error, this, &MainWindow::handleLLMError);
+    connect(m_modelRegistry, &ModelRegistry::statusUpdate, this, &MainWindow::handleLLMStatus);
+    connect(m_modelRegistry, &ModelRegistry::processorReady, this, &MainWindow::onProcessorReady);
+    connect(m_modelRegistry, &ModelRegistry::aboutToUnload, this, [this](LLMProcessor* processor) {
+        if (processor == m_conversationProcessor) {
+            m_conversationProcessor = nullptr;
+            resultsPage->setFollowUpEnabled(false);
+        }
+    });
     
     // Connect study guide watcher
     connect(m_studyGuideWatcher, &QFutureWatcher<QString>::finished, this, [this]() {
         QString result = m_studyGuideWatcher->result();
         if (!result.isEmpty()) {
-            resultsPage->setResults(result);
+            resultsPage->finishStreaming(result);
+            resultsPage->setFollowUpEnabled(m_conversationProcessor && m_conversationProcessor->hasConversation());
             addToHistory(currentInputText, result);
+            if (!m_pendingEmbedding.empty()) {
+                m_semanticCache->insert(processingHistory.first().timestamp.toString(Qt::ISODate), m_pendingEmbedding);
+                m_semanticCache->save("history.embeddings");
+                m_pendingEmbedding.clear();
+            }
             showResultsPage();
             statusBar->showMessage("Study guide generated successfully");
         } else {
+            resultsPage->clear();
+            showHomePage();
             statusBar->showMessage("Failed to generate study guide");
 }
         QApplication::restoreOverrideCursor();
         isProcessing = false;
     });
     
+    connect(m_embeddingWatcher, &QFutureWatcher<std::vector<float>>::finished, this, &MainWindow::onInputEmbedded);
+    connect(m_importWatcher, &QFutureWatcher<ImportedDocument>::finished, this, &MainWindow::onFileImported);
+    connect(m_artifactWatcher, &QFutureWatcher<QString>::finished, this, &MainWindow::onArtifactGenerated);
+    
+    // Generated items go to their pages as soon as they are complete
+    connect(m_outputParser, &StructuredOutputParser::questionParsed, quizPage, &QuizPage::addQuestion);
+    connect(m_outputParser, &StructuredOutputParser::flashcardParsed, flashcardsPage, &FlashcardsPage::addFlashcard);
+    connect(m_outputParser, &StructuredOutputParser::itemParsed, enumerationsPage, &EnumerationsPage::addEnumeration);
+    connect(quizPage, &QuizPage::backToHome, this, &MainWindow::showHomePage);
+    connect(flashcardsPage, &FlashcardsPage::backToHome, this, &MainWindow::showHomePage);
+    connect(enumerationsPage, &EnumerationsPage::backToHome, this, &MainWindow::showHomePage);
+    connect(resultsPage, &ResultsPage::backToHome, this, &MainWindow::showHomePage);
+    
+    // Connect follow-up conversation
+    connect(resultsPage, &ResultsPage::followUpSubmitted, this, &MainWindow::onFollowUpSubmitted);
+    connect(m_followUpWatcher, &QFutureWatcher<QString>::finished, this, [this]() {
+        QString answer = m_followUpWatcher->result();
+        if (!answer.isEmpty()) {
+            resultsPage->appendFollowUp(m_pendingFollowUp, answer);
+            statusBar->showMessage("Follow-up answered");
+        } else {
+            statusBar->showMessage("Failed to answer follow-up question");
+        }
+        resultsPage->setFollowUpEnabled(m_conversationProcessor && m_conversationProcessor->hasConversation());
+        QApplication::restoreOverrideCursor();
+        isProcessing = false;
+    });
+    
     // Connect home page signals
     connect(homePage, &HomePage::analyzeTextClicked, this, &MainWindow::onAnalyzeTextClicked);
+    connect(homePage, &HomePage::importFileClicked, this, &MainWindow::onImportFileClicked);
+    connect(homePage, &HomePage::inputIdle, this, [this](const QString& text) {
+        // Only warm a model that is already loaded; loading is left to the request
+        LLMProcessor* processor = m_modelRegistry->loaded(ModelTask::StudyGuide);
+        if (!isProcessing && processor) {
+            processor->prefillAsync(text);
+        }
+    });
     
     // Load history
     loadHistory();
@@ -4,7 +4,6 @@
 #include <QMainWindow>
 #include <QStackedWidget>
 #include <QListWidget>
-#include <QTextEdit>
 #include <QStatusBar>
 #include <QDateTime>
 #include <QFutureWatcher>
@@ -14,6 +13,14 @@
 #include "enumerations_page.h"
 #include "pages/results_page.h"
 #include "llm_processor.h"
+#include "model_registry.h"
+#include "semantic_cache.h"
+#include "text_embedder.h"
+#include "retrieval_index.h"
+#include "document_importer.h"
+#include "structured_output_parser.h"
+#include <memory>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -32,12 +39,19 @@ private slots:
     void showResultsPage();
     void showHistoryPage();
     void onImportFileClicked();
+    void onFileImported();
+    void onResponseChunk(const QString& text);
+    void onArtifactGenerated();
     void onDownloadClicked();
     void onCopyClicked();
     void onAboutAction();
     void onHistoryItemClicked(QListWidgetItem* item);
     void onAnalyzeTextClicked();
+    void onInputEmbedded();
+    void onProcessorReady(ModelTask task, LLMProcessor* processor);
+    void onSetLibraryClicked();
     void onStudyGuideGenerated(const QString& result);
+    void onFollowUpSubmitted(const QString& question);
     void handleLLMResponse(const QString& response);
     void handleLLMError(const QString& error);
     void handleLLMStatus(const QString& status);
@@ -54,6 +68,13 @@ private:
     void loadHistory();
     void saveHistory();
     bool initializeLLM();
+    void applyModelSettings();
+    void startStudyGuide();
+    void startArtifact(ModelTask task);
+    void runStudyGuide(LLMProcessor* processor);
+    void runArtifact(ModelTask task, LLMProcessor* processor);
+    bool offerCachedResult(const SemanticCache::Match& match);
+    void openLibrary(const QString& path);
     QString getMainStyleSheet();
     QString getHeaderStyleSheet();
     QString getHomePageStyleSheet();
@@ -70,11 +91,35 @@ private:
     QuizPage* quizPage;
     EnumerationsPage* enumerationsPage;
     QStatusBar* statusBar;
-    QTextEdit* resultsText;
 
-    // LLM Processing
-    LLMProcessor* m_llmProcessor;
+    // LLM Processing: one processor per loaded model, picked per task by the registry.
+    // Follow-up questions continue on the processor that produced the current result.
+    ModelRegistry* m_modelRegistry;
+    LLMProcessor* m_conversationProcessor = nullptr;
+    // A request is waiting for the registry to load the model of m_requestTask
+    bool m_awaitingModel = false;
+    ModelTask m_requestTask = ModelTask::StudyGuide;
+
+    // Embedding model shared by the near-duplicate check and the library index
+    std::unique_ptr<TextEmbedder> m_embedder;
+
+    // Near-duplicate inputs are offered the result of the earlier one. The embedding of
+    // the running request is kept to index its result once it is in the history.
+    std::unique_ptr<SemanticCache> m_semanticCache;
+    QFutureWatcher<std::vector<float>>* m_embeddingWatcher;
+    std::vector<float> m_pendingEmbedding;
+
+    // Folder of course readings that study guides quote from, indexed in the background
+    std::unique_ptr<RetrievalIndex> m_retrievalIndex;
+    QFuture<void> m_libraryUpdate;
     QFutureWatcher<QString>* m_studyGuideWatcher;
+    QFutureWatcher<QString>* m_followUpWatcher;
+    QFutureWatcher<ImportedDocument>* m_importWatcher;
+    // Quiz, flashcard and key point requests fill their pages while they stream
+    QFutureWatcher<QString>* m_artifactWatcher;
+    StructuredOutputParser* m_outputParser;
+    ModelTask m_streamTask = ModelTask::StudyGuide;
+    QString m_pendingFollowUp;
     bool isProcessing;
     QString currentInputText;
 
@@ -0,0 +1,516 @@
+#include "model_registry.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+#include "gguf.h"
+
+namespace {
+
+// n_ctx of the contexts LLMProcessor::initialize creates
+constexpr int kContextCells = 2048;
+
+constexpr ModelTask kTasks[] = {
+    ModelTask::StudyGuide, ModelTask::Quiz, ModelTask::Flashcards, ModelTask::Enumerations,
+};
+
+// How adapter file names refer to a task
+QString taskKey(ModelTask task)
+{
+    switch (task) {
+    case ModelTask::StudyGuide:   return "studyguide";
+    case ModelTask::Quiz:         return "quiz";
+    case ModelTask::Flashcards:   return "flashcards";
+    case ModelTask::Enumerations: return "enumerations";
+    }
+    return QString();
+}
+
+// Integer metadata of any width; arrays (per-layer values) yield their first element
+qint64 metadataInt(const gguf_context* ctx, const QString& key, qint64 fallback = 0)
+{
+    const int64_t id = gguf_find_key(ctx, key.toUtf8().constData());
+    if (id < 0) {
+        return fallback;
+    }
+    gguf_type type = gguf_get_kv_type(ctx, id);
+    const void* data = nullptr;
+    if (type == GGUF_TYPE_ARRAY) {
+        if (gguf_get_arr_n(ctx, id) == 0) {
+            return fallback;
+        }
+        type = gguf_get_arr_type(ctx, id);
+        data = gguf_get_arr_data(ctx, id);
+    } else {
+        data = gguf_get_val_data(ctx, id);
+    }
+    switch (type) {
+    case GGUF_TYPE_UINT8:  return *static_cast<const uint8_t*>(data);
+    case GGUF_TYPE_INT8:   return *static_cast<const int8_t*>(data);
+    case GGUF_TYPE_UINT16: return *static_cast<const uint16_t*>(data);
+    case GGUF_TYPE_INT16:  return *static_cast<const int16_t*>(data);
+    case GGUF_TYPE_UINT32: return *static_cast<const uint32_t*>(data);
+    case GGUF_TYPE_INT32:  return *static_cast<const int32_t*>(data);
+    case GGUF_TYPE_UINT64: return static_cast<qint64>(*static_cast<const uint64_t*>(data));
+    case GGUF_TYPE_INT64:  return *static_cast<const int64_t*>(data);
+    default:               return fallback;
+    }
+}
+
+QString metadataString(const gguf_context* ctx, const char* key)
+{
+    const int64_t id = gguf_find_key(ctx, key);
+    if (id < 0 || gguf_get_kv_type(ctx, id) != GGUF_TYPE_STRING) {
+        return QString();
+    }
+    return QString::fromUtf8(gguf_get_val_str(ctx, id));
+}
+
+bool readModelInfo(const QString& path, ModelInfo& info)
+{
+    // Header only: no_alloc skips reading the tensor data
+    gguf_init_params params = {
+        /* .no_alloc = */ true,
+        /* .ctx      = */ nullptr,
+    };
+    gguf_context* ctx = gguf_init_from_file(QDir::toNativeSeparators(path).toUtf8().constData(), params);
+    if (!ctx) {
+        return false;
+    }
+
+    const QFileInfo file(path);
+    info.path = path;
+    info.fileName = file.fileName();
+    info.fileSize = file.size();
+    info.architecture = metadataString(ctx, "general.architecture");
+    info.isAdapter = metadataString(ctx, "general.type") == "adapter";
+    info.name = metadataString(ctx, "general.name");
+    if (info.name.isEmpty()) {
+        info.name = file.completeBaseName();
+    }
+
+    const QString arch = info.architecture;
+    info.layers = metadataInt(ctx, arch + ".block_count");
+    info.embeddingLength = metadataInt(ctx, arch + ".embedding_length");
+    info.headCount = metadataInt(ctx, arch + ".attention.head_count");
+    info.headCountKv = metadataInt(ctx, arch + ".attention.head_count_kv", info.headCount);
+    info.trainContext = metadataInt(ctx, arch + ".context_length");
+    info.isEmbedding = gguf_find_key(ctx, (arch + ".pooling_type").toUtf8().constData()) >= 0;
+
+    info.weightBytes = 0;
+    for (int64_t i = 0; i < gguf_get_n_tensors(ctx); i++) {
+        info.weightBytes += gguf_get_tensor_size(ctx, i);
+    }
+
+    gguf_free(ctx);
+    return true;
+}
+
+} // namespace
+
+qint64 ModelInfo::estimatedBytes(int nCtx) const
+{
+    // K and V of every layer, F32 as LLMProcessor creates them
+    qint64 kvBytes = 0;
+    if (headCount > 0) {
+        const qint64 kvEmbedding = static_cast<qint64>(embeddingLength) * headCountKv / headCount;
+        kvBytes = 2LL * nCtx * layers * kvEmbedding * static_cast<qint64>(sizeof(float));
+    }
+    return weightBytes + kvBytes;
+}
+
+ModelRegistry::ModelRegistry(QObject* parent)
+    : QObject(parent)
+{
+}
+
+ModelRegistry::~ModelRegistry()
+{
+    // The processors are children and go with the registry, not while they load
+    for (Loading& loading : m_loading) {
+        loading.future.waitForFinished();
+    }
+}
+
+int ModelRegistry::scan(const QString& directory)
+{
+    m_models.clear();
+    m_adapters.clear();
+    m_embeddingModels.clear();
+
+    const QDir dir(directory);
+    const QStringList files = dir.entryList(QStringList() << "*.gguf", QDir::Files, QDir::Name);
+    for (const QString& fileName : files) {
+        ModelInfo info;
+        if (!readModelInfo(dir.filePath(fileName), info)) {
+            qDebug() << "Skipping model with unreadable GGUF header:" << fileName;
+            continue;
+        }
+        if (info.isAdapter) {
+            qDebug() << "Found adapter" << info.fileName << "(" << info.architecture << ","
+                     << info.weightBytes / (1024 * 1024) << "MiB )";
+            m_adapters.append(info);
+            continue;
+        }
+        if (info.isEmbedding) {
+            qDebug() << "Found embedding model" << info.fileName << "(" << info.architecture << ")";
+            m_embeddingModels.append(info);
+            continue;
+        }
+        qDebug() << "Found model" << info.fileName << "(" << info.name << "," << info.architecture << ","
+                 << info.layers << "layers," << info.weightBytes / (1024 * 1024) << "MiB of weights )";
+        m_models.append(info);
+    }
+    return m_models.size();
+}
+
+void ModelRegistry::setTaskModel(ModelTask task, const QString& fileName)
+{
+    if (fileName.isEmpty()) {
+        m_taskModels.remove(static_cast<int>(task));
+    } else {
+        m_taskModels.insert(static_cast<int>(task), fileName);
+    }
+}
+
+QString ModelRegistry::taskModel(ModelTask task) const
+{
+    const ModelInfo* info = route(task);
+    return info ? info->fileName : QString();
+}
+
+void ModelRegistry::setTaskAdapter(ModelTask task, const QString& fileName)
+{
+    if (fileName.isEmpty()) {
+        m_taskAdapters.remove(static_cast<int>(task));
+    } else {
+        m_taskAdapters.insert(static_cast<int>(task), fileName);
+    }
+}
+
+QString ModelRegistry::taskAdapter(ModelTask task) const
+{
+    const ModelInfo* model = route(task);
+    const ModelInfo* adapter = model ? routeAdapter(task, *model) : nullptr;
+    return adapter ? adapter->fileName : QString();
+}
+
+void ModelRegistry::setMaxLoaded(int count)
+{
+    m_maxLoaded = std::max(count, 1);
+    evictFor(0);
+}
+
+void ModelRegistry::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = std::max<qint64>(bytes, 0);
+    evictFor(0);
+}
+
+void ModelRegistry::setThreadConfig(const InferenceThreadConfig& config)
+{
+    m_threadConfig = config;
+    for (const Loaded& loaded : m_loaded) {
+        loaded.processor->setThreadConfig(config);
+    }
+    for (const Loading& loading : m_loading) {
+        loading.processor->setThreadConfig(config);
+    }
+}
+
+void ModelRegistry::setResidencyPolicy(const ModelResidencyPolicy& policy)
+{
+    m_residencyPolicy = policy;
+}
+
+void ModelRegistry::setIdleTimeout(int msecs)
+{
+    m_idleTimeoutMs = msecs;
+    if (msecs < 0) {
+        return;
+    }
+    for (const Loaded& loaded : m_loaded) {
+        loaded.processor->setIdleTimeout(msecs);
+    }
+    for (const Loading& loading : m_loading) {
+        loading.processor->setIdleTimeout(msecs);
+    }
+}
+
+std::shared_ptr<const TokenizerService> ModelRegistry::tokenizer(ModelTask task)
+{
+    const ModelInfo* info = route(task);
+    return info ? tokenizerFor(*info) : nullptr;
+}
+
+std::shared_ptr<const TokenizerService> ModelRegistry::tokenizerFor(const ModelInfo& model)
+{
+    const auto known = m_tokenizers.find(model.fileName);
+    if (known != m_tokenizers.end()) {
+        return known->second;
+    }
+    auto tokenizer = std::make_shared<TokenizerService>();
+    if (!tokenizer->initialize(model.path)) {
+        return nullptr;
+    }
+    m_tokenizers[model.fileName] = tokenizer;
+    return tokenizer;
+}
+
+void ModelRegistry::setRetrievalIndex(RetrievalIndex* index)
+{
+    m_retrievalIndex = index;
+    for (const Loaded& loaded : m_loaded) {
+        loaded.processor->setRetrievalIndex(index);
+    }
+    for (const Loading& loading : m_loading) {
+        loading.processor->setRetrievalIndex(index);
+    }
+}
+
+LLMProcessor* ModelRegistry::loaded(ModelTask task) const
+{
+    const ModelInfo* info = route(task);
+    if (!info) {
+        return nullptr;
+    }
+    for (const Loaded& loaded : m_loaded) {
+        if (loaded.fileName == info->fileName) {
+            return loaded.processor;
+        }
+    }
+    return nullptr;
+}
+
+bool ModelRegistry::isLoaded(const QString& fileName) const
+{
+    return std::any_of(m_loaded.begin(), m_loaded.end(), [&](const Loaded& loaded) {
+        return loaded.fileName == fileName;
+    });
+}
+
+const ModelInfo* ModelRegistry::find(const QString& fileName) const
+{
+    for (const ModelInfo& info : m_models) {
+        if (info.fileName == fileName) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+const ModelInfo* ModelRegistry::route(ModelTask task) const
+{
+    const auto explicitModel = m_taskModels.constFind(static_cast<int>(task));
+    if (explicitModel != m_taskModels.constEnd()) {
+        if (const ModelInfo* info = find(*explicitModel)) {
+            return info;
+        }
+        qDebug() << "Model" << *explicitModel << "routed to task" << static_cast<int>(task) << "was not found";
+    }
+    if (m_models.isEmpty()) {
+        return nullptr;
+    }
+
+    // Study guides want the most capable model that fits; the drills are fine on the cheapest
+    const ModelInfo* smallest = &m_models.first();
+    const ModelInfo* largestFitting = nullptr;
+    for (const ModelInfo& info : m_models) {
+        const qint64 bytes = info.estimatedBytes(kContextCells);
+        if (bytes < smallest->estimatedBytes(kContextCells)) {
+            smallest = &info;
+        }
+        if ((m_memoryBudget == 0 || bytes <= m_memoryBudget)
+            && (!largestFitting || bytes > largestFitting->estimatedBytes(kContextCells))) {
+            largestFitting = &info;
+        }
+    }
+    if (task == ModelTask::StudyGuide && largestFitting) {
+        return largestFitting;
+    }
+    return smallest;
+}
+
+const ModelInfo* ModelRegistry::routeAdapter(ModelTask task, const ModelInfo& model) const
+{
+    const auto explicitAdapter = m_taskAdapters.constFind(static_cast<int>(task));
+    for (const ModelInfo& adapter : m_adapters) {
+        if (adapter.architecture != model.architecture) {
+            continue;
+        }
+        if (explicitAdapter != m_taskAdapters.constEnd()) {
+            if (adapter.fileName == *explicitAdapter) {
+                return &adapter;
+            }
+            continue;
+        }
+        const QString name = adapter.fileName.toLower().remove('-').remove('_');
+        if (name.contains(taskKey(task))) {
+            return &adapter;
+        }
+    }
+    return nullptr;
+}
+
+// The adapters of every task routed to the model, which share its base weights
+QList<ModelRegistry::AdapterRoute> ModelRegistry::adapterRoutes(const ModelInfo& model) const
+{
+    QList<AdapterRoute> routes;
+    for (ModelTask task : kTasks) {
+        const ModelInfo* routed = route(task);
+        if (!routed || routed->fileName != model.fileName) {
+            continue;
+        }
+        if (const ModelInfo* adapter = routeAdapter(task, model)) {
+            routes.append(AdapterRoute{task, adapter->fileName, adapter->path, adapter->weightBytes});
+        }
+    }
+    return routes;
+}
+
+// Attaches the adapters to the processor; returns the bytes of the adapters loaded.
+// Runs on the loading thread, so it only touches the processor.
+qint64 ModelRegistry::loadAdapters(LLMProcessor* processor, const QList<AdapterRoute>& routes)
+{
+    QStringList loaded;
+    qint64 bytes = 0;
+    for (const AdapterRoute& route : routes) {
+        if (!processor->loadAdapter(route.task, route.path)) {
+            continue;
+        }
+        if (!loaded.contains(route.fileName)) {
+            loaded.append(route.fileName);
+            bytes += route.bytes;
+        }
+    }
+    return bytes;
+}
+
+void ModelRegistry::acquire(ModelTask task)
+{
+    const ModelInfo* info = route(task);
+    if (!info) {
+        emit error("No model available in the models directory");
+        emit processorReady(task, nullptr);
+        return;
+    }
+
+    for (int i = 0; i < m_loaded.size(); i++) {
+        if (m_loaded[i].fileName == info->fileName) {
+            m_loaded.move(i, 0);
+            emit processorReady(task, m_loaded.first().processor);
+            return;
+        }
+    }
+    for (Loading& loading : m_loading) {
+        if (loading.fileName == info->fileName) {
+            loading.tasks.append(task);
+            return;
+        }
+    }
+
+    const qint64 bytes = info->estimatedBytes(kContextCells);
+    evictFor(bytes);
+
+    emit statusUpdate(QString("Loading %1...").arg(info->name));
+    LLMProcessor* processor = new LLMProcessor(this);
+    connect(processor, &LLMProcessor::error, this, &ModelRegistry::error);
+    connect(processor, &LLMProcessor::statusUpdate, this, &ModelRegistry::statusUpdate);
+    processor->setResidencyPolicy(m_residencyPolicy);
+    processor->setThreadConfig(m_threadConfig);
+    if (m_idleTimeoutMs >= 0) {
+        processor->setIdleTimeout(m_idleTimeoutMs);
+    }
+    processor->setTokenizer(tokenizerFor(*info));
+    processor->setRetrievalIndex(m_retrievalIndex);
+
+    // Mapping the weights and creating the context take seconds; the window stays
+    // responsive meanwhile
+    const QString path = info->path;
+    const QList<AdapterRoute> adapters = adapterRoutes(*info);
+    const QString fileName = info->fileName;
+    QFuture<qint64> future = QtConcurrent::run([processor, path, adapters]() -> qint64 {
+        if (!processor->initialize(path)) {
+            return -1;
+        }
+        return loadAdapters(processor, adapters);
+    });
+    m_loading.append(Loading{fileName, processor, bytes, {task}, future});
+
+    auto* watcher = new QFutureWatcher<qint64>(this);
+    connect(watcher, &QFutureWatcher<qint64>::finished, this, [this, watcher, fileName]() {
+        watcher->deleteLater();
+        finishLoading(fileName);
+    });
+    watcher->setFuture(future);
+}
+
+void ModelRegistry::finishLoading(const QString& fileName)
+{
+    const auto it = std::find_if(m_loading.begin(), m_loading.end(), [&](const Loading& loading) {
+        return loading.fileName == fileName;
+    });
+    if (it == m_loading.end()) {
+        return;
+    }
+    const Loading loading = *it;
+    m_loading.erase(it);
+
+    const qint64 adapterBytes = loading.future.result();
+    LLMProcessor* processor = loading.processor;
+    if (adapterBytes < 0) {
+        delete processor;
+        processor = nullptr;
+    } else {
+        m_loaded.prepend(Loaded{fileName, processor, loading.bytes + adapterBytes});
+        qDebug() << "Loaded" << fileName << "-" << m_loaded.size() << "models loaded";
+    }
+    for (ModelTask task : loading.tasks) {
+        emit processorReady(task, processor);
+    }
+}
+
+// Unloads least recently used models until one more of `bytes` fits the limits. Models
+// with a request in flight are kept even if that leaves the registry over its budget;
+// models still loading count as loaded.
+void ModelRegistry::evictFor(qint64 bytes)
+{
+    auto loadedBytes = [this]() {
+        qint64 total = 0;
+        for (const Loaded& loaded : m_loaded) {
+            total += loaded.bytes;
+        }
+        for (const Loading& loading : m_loading) {
+            total += loading.bytes;
+        }
+        return total;
+    };
+    auto overLimit = [&]() {
+        const int incoming = bytes > 0 ? 1 : 0;
+        return m_loaded.size() + m_loading.size() + incoming > m_maxLoaded
+            || (m_memoryBudget > 0 && loadedBytes() + bytes > m_memoryBudget);
+    };
+
+    for (int i = m_loaded.size() - 1; i >= 0 && overLimit(); i--) {
+        if (m_loaded[i].processor->isBusy()) {
+            continue;
+        }
+        unload(i);
+    }
+    if (overLimit()) {
+        qDebug() << "Model registry is over its limits:" << m_loaded.size() << "models,"
+                 << loadedBytes() / (1024 * 1024) << "MiB loaded";
+    }
+}
+
+void ModelRegistry::unload(int index)
+{
+    const Loaded loaded = m_loaded.takeAt(index);
+    qDebug() << "Unloading model" << loaded.fileName;
+    emit aboutToUnload(loaded.processor);
+    delete loaded.processor;
+}
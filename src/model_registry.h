@@ -0,0 +1,149 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QFuture>
+#include <map>
+#include <memory>
+
+#include "llm_processor.h"
+#include "tokenizer_service.h"
+
+// What the GGUF header of a model file says about it, read without loading the weights
+struct ModelInfo {
+    QString path;
+    QString fileName;
+    QString name;            // general.name, or the file name
+    QString architecture;    // general.architecture
+    bool isAdapter = false;  // a LoRA adapter rather than a base model
+    bool isEmbedding = false; // an embedding model with a pooling head, not for generation
+    qint64 fileSize = 0;
+    qint64 weightBytes = 0;  // sum of the tensor data
+    int layers = 0;
+    int embeddingLength = 0;
+    int headCount = 0;
+    int headCountKv = 0;
+    int trainContext = 0;
+
+    // Weights plus an F32 KV cache of nCtx cells, the footprint of a loaded processor
+    qint64 estimatedBytes(int nCtx) const;
+};
+
+// The models found in a directory and the processors currently loaded for them.
+// Each task runs on the model routed to it; models are loaded on first use and the
+// least recently used ones are unloaded to stay within the count and memory limits.
+// Lives on the GUI thread; the weights load on worker threads.
+class ModelRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ModelRegistry(QObject* parent = nullptr);
+    ~ModelRegistry() override;
+
+    // Reads the headers of every *.gguf file in the directory; returns the number found
+    int scan(const QString& directory);
+    QList<ModelInfo> models() const { return m_models; }
+    QList<ModelInfo> adapters() const { return m_adapters; }
+    QList<ModelInfo> embeddingModels() const { return m_embeddingModels; }
+
+    // Route a task to a model file name of the scanned directory; an empty name restores
+    // the default: the largest model within the budget for study guides, the smallest
+    // for the other tasks
+    void setTaskModel(ModelTask task, const QString& fileName);
+    QString taskModel(ModelTask task) const;
+
+    // LoRA adapter applied to the task's requests on its model. An empty name restores the
+    // default: an adapter of the model's architecture whose file name mentions the task,
+    // such as "tinyllama-quiz-lora.gguf". Takes effect the next time the model loads.
+    void setTaskAdapter(ModelTask task, const QString& fileName);
+    QString taskAdapter(ModelTask task) const;
+
+    // Limits on loaded models; a budget of 0 bytes only limits the count
+    void setMaxLoaded(int count);
+    void setMemoryBudget(qint64 bytes);
+
+    // Settings of the processors, applied to the loaded ones and every one loaded later.
+    // The residency policy only affects models loaded after the change.
+    void setThreadConfig(const InferenceThreadConfig& config);
+    void setResidencyPolicy(const ModelResidencyPolicy& policy);
+    // A negative timeout keeps the processor default
+    void setIdleTimeout(int msecs);
+
+    // Library that loaded and future processors ground their study guides in
+    void setRetrievalIndex(RetrievalIndex* index);
+
+    // Gets the processor for the task ready, loading its model on a worker thread and
+    // unloading others as needed, and emits processorReady. A loaded model is ready
+    // before this returns.
+    void acquire(ModelTask task);
+    // The processor for the task if its model is already loaded, without loading or
+    // counting as a use
+    LLMProcessor* loaded(ModelTask task) const;
+    bool isLoaded(const QString& fileName) const;
+
+    // Tokenizer of the task's model, opened from its vocabulary alone on first use so
+    // counting does not wait for the weights. Safe to use from any thread; nullptr if
+    // no model is available.
+    std::shared_ptr<const TokenizerService> tokenizer(ModelTask task);
+
+signals:
+    void error(const QString& message);
+    void statusUpdate(const QString& status);
+    // Answers acquire; processor is nullptr if no model is available or it failed to load
+    void processorReady(ModelTask task, LLMProcessor* processor);
+    // Emitted before an evicted processor is deleted
+    void aboutToUnload(LLMProcessor* processor);
+
+private:
+    struct Loaded {
+        QString fileName;
+        LLMProcessor* processor = nullptr;
+        qint64 bytes = 0;
+    };
+    struct Loading {
+        QString fileName;
+        LLMProcessor* processor = nullptr;
+        qint64 bytes = 0;
+        QList<ModelTask> tasks;   // acquired while the model loads
+        QFuture<qint64> future;   // bytes of the adapters, -1 if the model failed to load
+    };
+    struct AdapterRoute {
+        ModelTask task;
+        QString fileName;
+        QString path;
+        qint64 bytes = 0;
+    };
+
+    const ModelInfo* find(const QString& fileName) const;
+    const ModelInfo* route(ModelTask task) const;
+    const ModelInfo* routeAdapter(ModelTask task, const ModelInfo& model) const;
+    QList<AdapterRoute> adapterRoutes(const ModelInfo& model) const;
+    static qint64 loadAdapters(LLMProcessor* processor, const QList<AdapterRoute>& routes);
+    void finishLoading(const QString& fileName);
+    std::shared_ptr<const TokenizerService> tokenizerFor(const ModelInfo& model);
+    void evictFor(qint64 bytes);
+    void unload(int index);
+
+    QList<ModelInfo> m_models;
+    QList<ModelInfo> m_adapters;
+    QList<ModelInfo> m_embeddingModels;
+    QHash<int, QString> m_taskModels;
+    QHash<int, QString> m_taskAdapters;
+    // Most recently used first
+    QList<Loaded> m_loaded;
+    QList<Loading> m_loading;
+    int m_maxLoaded = 2;
+    qint64 m_memoryBudget = 0;
+    RetrievalIndex* m_retrievalIndex = nullptr;
+    InferenceThreadConfig m_threadConfig;
+    ModelResidencyPolicy m_residencyPolicy;
+    int m_idleTimeoutMs = -1;
+    // By model file name; kept while the registry lives, a vocabulary is small
+    std::map<QString, std::shared_ptr<const TokenizerService>> m_tokenizers;
+};
+
+#endif // MODEL_REGISTRY_H
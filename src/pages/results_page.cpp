@@ -1,13 +1,63 @@
 #include "results_page.h"
 #include <QClipboard>
 #include <QApplication>
+#include <QScreen>
+#include <QScrollBar>
+#include <QRegularExpression>
+#include <QTextBlock>
+
+namespace {
+
+enum class LineKind {
+    Plain,
+    Heading,
+    Bullet,
+    Numbered,
+};
+
+// Markdown-ish structure of one generated line; `display` is the line without its markup
+LineKind classifyLine(const QString& line, QString& display)
+{
+    static const QRegularExpression bullet("^\\s*[-*\u2022]\\s+(.*)$");
+    static const QRegularExpression numbered("^\\s*\\d+[.)]\\s+(.*)$");
+    static const QRegularExpression markdownHeading("^#{1,6}\\s+(.*)$");
+    static const QRegularExpression boldLine("^\\*\\*(.+)\\*\\*:?$");
+    static const QRegularExpression partHeading("^Part \\d+ of \\d+$");
+
+    const QString trimmed = line.trimmed();
+    QRegularExpressionMatch match;
+    if ((match = markdownHeading.match(trimmed)).hasMatch() || (match = boldLine.match(trimmed)).hasMatch()) {
+        display = match.captured(1).trimmed();
+        return LineKind::Heading;
+    }
+    if ((match = bullet.match(line)).hasMatch()) {
+        display = match.captured(1);
+        return LineKind::Bullet;
+    }
+    if ((match = numbered.match(line)).hasMatch()) {
+        display = match.captured(1);
+        return LineKind::Numbered;
+    }
+    display = trimmed;
+    if (partHeading.match(trimmed).hasMatch() || (trimmed.endsWith(':') && trimmed.size() <= 80)) {
+        return LineKind::Heading;
+    }
+    return LineKind::Plain;
+}
+
+}
 
 ResultsPage::ResultsPage(QWidget* parent)
     : QWidget(parent)
     , m_resultsText(new QTextEdit(this))
+    , m_followUpInput(new QLineEdit(this))
+    , m_askButton(new QPushButton("Ask", this))
     , m_backButton(new QPushButton("Back to Home", this))
     , m_layout(new QVBoxLayout(this))
+    , m_renderTimer(new QTimer(this))
 {
+    m_renderTimer->setSingleShot(true);
+    connect(m_renderTimer, &QTimer::timeout, this, &ResultsPage::renderPending);
     setupUI();
     connectSignals();
 }
@@ -18,6 +68,15 @@ void ResultsPage::setupUI() {
     m_resultsText->setFont(QFont("Consolas", 10));
     m_resultsText->setLineWrapMode(QTextEdit::WidgetWidth);
     
+    // Configure follow-up question input
+    m_followUpInput->setPlaceholderText("Ask a follow-up question about this result...");
+    m_askButton->setFixedHeight(32);
+    setFollowUpEnabled(false);
+
+    QHBoxLayout* followUpLayout = new QHBoxLayout();
+    followUpLayout->addWidget(m_followUpInput, 1);
+    followUpLayout->addWidget(m_askButton);
+
     // Configure back button
     m_backButton->setFixedHeight(40);
     m_backButton->setStyleSheet(
@@ -35,6 +94,7 @@ void ResultsPage::setupUI() {
 
     // Setup layout
     m_layout->addWidget(m_resultsText, 1);
+    m_layout->addLayout(followUpLayout);
     m_layout->addWidget(m_backButton);
     m_layout->setContentsMargins(10, 10, 10, 10);
     m_layout->setSpacing(10);
@@ -44,16 +104,150 @@ void ResultsPage::setupUI() {
 
 void ResultsPage::connectSignals() {
     connect(m_backButton, &QPushButton::clicked, this, &ResultsPage::backToHome);
+    connect(m_askButton, &QPushButton::clicked, this, &ResultsPage::onAskClicked);
+    connect(m_followUpInput, &QLineEdit::returnPressed, this, &ResultsPage::onAskClicked);
+}
+
+void ResultsPage::onAskClicked() {
+    QString question = m_followUpInput->text().trimmed();
+    if (question.isEmpty()) {
+        return;
+    }
+    setFollowUpEnabled(false);
+    emit followUpSubmitted(question);
 }
 
 void ResultsPage::setResults(const QString& text) {
-    m_resultsText->setText(text);
+    clear();
+    feed(text + "\n");
+    renderPending();
 }
 
 QString ResultsPage::getResults() const {
-    return m_resultsText->toPlainText();
+    return m_text + m_pending;
 }
 
 void ResultsPage::clear() {
+    m_renderTimer->stop();
     m_resultsText->clear();
+    m_text.clear();
+    m_pending.clear();
+    m_openLine.clear();
+    m_streamStarted = false;
+    m_list = nullptr;
+}
+
+void ResultsPage::beginStreaming() {
+    clear();
+    // One render per display frame is as often as the result can be seen changing
+    const qreal refreshRate = screen() ? screen()->refreshRate() : 60.0;
+    m_renderTimer->setInterval(qMax(8, qRound(1000.0 / qMax(refreshRate, 1.0))));
+}
+
+void ResultsPage::appendText(const QString& text) {
+    feed(text);
+    if (!m_renderTimer->isActive()) {
+        m_renderTimer->start();
+    }
+}
+
+void ResultsPage::finishStreaming(const QString& finalText) {
+    m_renderTimer->stop();
+    if (getResults().trimmed() != finalText.trimmed()) {
+        setResults(finalText);
+        return;
+    }
+    feed("\n");
+    renderPending();
+}
+
+void ResultsPage::feed(const QString& text) {
+    QString piece = text;
+    if (!m_streamStarted) {
+        // Generations tend to open with whitespace that the final result trims
+        qsizetype start = 0;
+        while (start < piece.size() && piece[start].isSpace()) {
+            start++;
+        }
+        piece.remove(0, start);
+        m_streamStarted = !piece.isEmpty();
+    }
+    m_pending += piece;
+}
+
+// Renders the pending text at the end of the document: completed lines are formatted,
+// and the start of the next line is shown as it is
+void ResultsPage::renderPending() {
+    if (m_pending.isEmpty()) {
+        return;
+    }
+    QScrollBar* scrollBar = m_resultsText->verticalScrollBar();
+    const bool following = scrollBar->value() >= scrollBar->maximum() - 4;
+
+    QTextCursor cursor(m_resultsText->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.beginEditBlock();
+    qsizetype start = 0;
+    for (qsizetype end = m_pending.indexOf(u'\n'); end >= 0; end = m_pending.indexOf(u'\n', start)) {
+        m_openLine += QStringView(m_pending).mid(start, end - start);
+        renderLine(m_openLine);
+        m_openLine.clear();
+        start = end + 1;
+    }
+    const QString rest = m_pending.mid(start);
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(rest, QTextCharFormat());
+    m_openLine += rest;
+    cursor.endEditBlock();
+
+    m_text += m_pending;
+    m_pending.clear();
+    if (following) {
+        scrollBar->setValue(scrollBar->maximum());
+    }
+}
+
+// Replaces the plain rendering of the last line with its formatted one and opens the
+// block the next line goes into
+void ResultsPage::renderLine(const QString& line) {
+    QTextCursor cursor(m_resultsText->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.movePosition(QTextCursor::StartOfBlock, QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+
+    QString display;
+    const LineKind kind = line.trimmed().isEmpty() ? LineKind::Plain : classifyLine(line, display);
+    QTextCharFormat charFormat;
+    if (kind == LineKind::Bullet || kind == LineKind::Numbered) {
+        const QTextListFormat::Style style = kind == LineKind::Bullet ? QTextListFormat::ListDisc
+                                                                      : QTextListFormat::ListDecimal;
+        if (m_list && m_list->format().style() == style) {
+            m_list->add(cursor.block());
+        } else {
+            m_list = cursor.createList(style);
+        }
+    } else {
+        m_list = nullptr;
+        if (kind == LineKind::Heading) {
+            charFormat.setFontWeight(QFont::Bold);
+            charFormat.setFontPointSize(m_resultsText->font().pointSizeF() * 1.2);
+            QTextBlockFormat blockFormat;
+            blockFormat.setTopMargin(6);
+            cursor.setBlockFormat(blockFormat);
+        }
+    }
+    cursor.insertText(display, charFormat);
+    cursor.insertBlock(QTextBlockFormat(), QTextCharFormat());
+}
+
+void ResultsPage::appendFollowUp(const QString& question, const QString& answer) {
+    m_renderTimer->stop();
+    feed(QString("\n\nYou: %1\n\n%2\n").arg(question, answer));
+    renderPending();
+    m_followUpInput->clear();
+}
+
+void ResultsPage::setFollowUpEnabled(bool enabled) {
+    m_followUpInput->setEnabled(enabled);
+    m_askButton->setEnabled(enabled);
 } 
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include <QTextEdit>
 #include <QPushButton>
 #include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QLineEdit>
+#include <QTimer>
+#include <QTextList>
+#include <QTextCursor>
 
 class ResultsPage : public QWidget {
     Q_OBJECT
@@ -14,19 +19,52 @@ public:
     ~ResultsPage() override = default;
 
     void setResults(const QString& text);
+    // The text as generated, with its list markers and heading syntax
     QString getResults() const;
     void clear();
 
+    // Streaming: text arrives in pieces while it is generated. Pieces are collected and
+    // rendered at most once per display frame, appending at the end of the document, so
+    // the cost of a piece does not grow with what is already shown. The final text
+    // replaces the streamed one only if they differ.
+    void beginStreaming();
+    void appendText(const QString& text);
+    void finishStreaming(const QString& finalText);
+
+    // Conversation mode: follow-up questions about the current result
+    void appendFollowUp(const QString& question, const QString& answer);
+    void setFollowUpEnabled(bool enabled);
+
 signals:
     void backToHome();
+    void followUpSubmitted(const QString& question);
+
+private slots:
+    void onAskClicked();
 
 private:
     QTextEdit* m_resultsText;
+    QLineEdit* m_followUpInput;
+    QPushButton* m_askButton;
     QPushButton* m_backButton;
     QVBoxLayout* m_layout;
 
+    QTimer* m_renderTimer;
+
+    // Everything received, what is still to be rendered, and the unfinished last line,
+    // which is shown as plain text until its line break arrives
+    QString m_text;
+    QString m_pending;
+    QString m_openLine;
+    bool m_streamStarted = false;
+    // Blocks of the list being rendered, continued by the next item of the same kind
+    QTextList* m_list = nullptr;
+
     void setupUI();
     void connectSignals();
+    void feed(const QString& text);
+    void renderPending();
+    void renderLine(const QString& line);
 };
 
 #endif // RESULTS_PAGE_H 
\ No newline at end of file
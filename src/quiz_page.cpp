@@ -2,12 +2,14 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFrame>
+#include <QRegularExpression>
 
 QuizPage::QuizPage(QWidget *parent)
     : QWidget(parent)
     , currentIndex(0)
     , score(0)
     , totalQuestions(0)
+    , waitingForQuestion(false)
 {
     setupUI();
 }
@@ -61,16 +63,40 @@ void QuizPage::setQuestions(const QVector<QPair<QString, QString>>& questions)
     currentIndex = 0;
     score = 0;
     totalQuestions = questions.size();
+    waitingForQuestion = false;
+    submitButton->setEnabled(true);
+    answerInput->setEnabled(true);
     updateQuestionDisplay();
     updateScore();
 }
 
+void QuizPage::addQuestion(const QString& question, const QString& answer)
+{
+    quizQuestions.append(qMakePair(question, answer));
+    totalQuestions = quizQuestions.size();
+    if (quizQuestions.size() == 1) {
+        submitButton->setEnabled(true);
+        answerInput->setEnabled(true);
+        updateQuestionDisplay();
+    } else if (waitingForQuestion) {
+        // Keeps the feedback on the last answer visible while moving on
+        waitingForQuestion = false;
+        currentIndex++;
+        questionLabel->setText(quizQuestions[currentIndex].first);
+        answerInput->clear();
+        submitButton->setEnabled(true);
+        answerInput->setEnabled(true);
+    }
+    updateScore();
+}
+
 void QuizPage::clearQuestions()
 {
     quizQuestions.clear();
     currentIndex = 0;
     score = 0;
     totalQuestions = 0;
+    waitingForQuestion = false;
     questionLabel->setText("");
     answerInput->clear();
     feedbackLabel->setText("");
@@ -109,6 +135,12 @@ void QuizPage::onSubmitClicked()
     QString correctAnswer = quizQuestions[currentIndex].second;
     
     bool isCorrect = answer.compare(correctAnswer, Qt::CaseInsensitive) == 0;
+    if (!isCorrect) {
+        // Multiple choice answers such as "B) Paris" also take the letter alone
+        static const QRegularExpression choice("^([A-Da-d])(?:[).:]|\\s|$)");
+        const QRegularExpressionMatch match = choice.match(correctAnswer);
+        isCorrect = match.hasMatch() && answer.compare(match.captured(1), Qt::CaseInsensitive) == 0;
+    }
     if (isCorrect) {
         score++;
         feedbackLabel->setText("Correct!");
@@ -128,6 +160,7 @@ void QuizPage::onSubmitClicked()
     } else {
         submitButton->setEnabled(false);
         answerInput->setEnabled(false);
+        waitingForQuestion = true;
     }
     
     emit answerSubmitted(answer);
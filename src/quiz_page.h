@@ -16,6 +16,8 @@ public:
     ~QuizPage();
 
     void setQuestions(const QVector<QPair<QString, QString>>& questions);
+    // Adds a question while the quiz may already be in progress
+    void addQuestion(const QString& question, const QString& answer);
     void clearQuestions();
     QString getAnswer() const;
 
@@ -42,6 +44,8 @@ private:
     int currentIndex;
     int score;
     int totalQuestions;
+    // Every question so far is answered and more are still being generated
+    bool waitingForQuestion;
 };
 
 #endif // QUIZ_PAGE_H 
\ No newline at end of file
@@ -0,0 +1,98 @@
+#ifndef RETRIEVAL_INDEX_H
+#define RETRIEVAL_INDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QFile>
+#include <QMutex>
+#include <QDir>
+#include <functional>
+#include <vector>
+
+class TextEmbedder;
+
+struct RetrievedPassage {
+    QString source;   // file of the library, relative to its folder
+    QString text;
+    float score = 0.0f;
+};
+
+// Embedded passages of a folder of course readings, for grounding prompts in more than
+// the pasted text. Files are cut into passages of a few sentences, embedded, and kept
+// in an on-disk index that is memory-mapped for searching:
+//
+//   vectors.bin  header, then one quantized vector per passage (Q8_0, or F32 if the
+//                embedding size is not a multiple of the quantization block)
+//   chunks.bin   per passage: file id and the location of its text
+//   texts.bin    the passage texts
+//   files.json   the indexed files with size, modification time and id
+//
+// Updates only embed new and changed files and append to the index; the passages of
+// changed and removed files are dropped by retiring their file id, and the index is
+// rewritten once most of it is dead. Search and update may run on different threads.
+class RetrievalIndex
+{
+public:
+    explicit RetrievalIndex(TextEmbedder* embedder);
+    ~RetrievalIndex();
+
+    RetrievalIndex(const RetrievalIndex&) = delete;
+    RetrievalIndex& operator=(const RetrievalIndex&) = delete;
+
+    // Opens the index of the folder, kept under the cache directory per embedding model
+    bool open(const QString& libraryPath);
+    bool isOpen() const;
+    QString libraryPath() const;
+
+    // Brings the index in line with the folder; reports files done out of files to embed
+    bool update(const std::function<void(int, int)>& progress = {});
+    int passageCount() const;
+
+    // The passages closest to the query, best first
+    QList<RetrievedPassage> search(const QString& query, int topK);
+    QList<RetrievedPassage> search(const std::vector<float>& query, int topK) const;
+
+private:
+    struct FileEntry {
+        QString path;
+        qint64 size = 0;
+        qint64 modified = 0;
+        quint32 id = 0;
+        int passages = 0;
+    };
+
+    bool loadFiles();
+    bool saveFiles() const;
+    bool createStorage();
+    void map();
+    void unmap();
+    bool append(quint32 fileId, const QStringList& passages, const std::vector<std::vector<float>>& vectors);
+    bool compact();
+    static QStringList splitPassages(const QString& text);
+
+    TextEmbedder* m_embedder;
+    mutable QMutex m_mutex;
+    QString m_libraryPath;
+    QDir m_dir;
+
+    int m_type = 0;       // ggml_type of the stored vectors
+    size_t m_rowSize = 0;
+
+    QList<FileEntry> m_files;
+    quint32 m_nextFileId = 1;
+    // Indexed by file id; passages of retired ids are skipped
+    std::vector<bool> m_liveFiles;
+    qint64 m_livePassages = 0;
+
+    QFile m_vectorFile;
+    QFile m_chunkFile;
+    QFile m_textFile;
+    const uchar* m_vectors = nullptr;
+    const uchar* m_chunks = nullptr;
+    const uchar* m_texts = nullptr;
+    qint64 m_textSize = 0;
+    qint64 m_passages = 0;
+};
+
+#endif // RETRIEVAL_INDEX_H
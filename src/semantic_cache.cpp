@@ -0,0 +1,108 @@
+#include "semantic_cache.h"
+#include "text_embedder.h"
+#include <QDebug>
+#include <QFile>
+#include <QDataStream>
+
+#include "ggml-cpu.h"
+
+namespace {
+
+constexpr quint32 kFileMagic = 0x53454d43; // "SEMC"
+constexpr quint32 kFileVersion = 1;
+
+}
+
+SemanticCache::SemanticCache(TextEmbedder* embedder)
+    : m_embedder(embedder)
+{
+}
+
+bool SemanticCache::isEnabled() const
+{
+    return m_embedder && m_embedder->isEnabled();
+}
+
+// Vectors are unit length, so the dot product is the cosine similarity. The flat scan
+// goes through ggml's SIMD dot product, which keeps it well under a millisecond for
+// thousands of entries.
+SemanticCache::Match SemanticCache::lookup(const std::vector<float>& embedding) const
+{
+    Match best;
+    const int dimensions = m_embedder->dimensions();
+    if (embedding.size() != static_cast<size_t>(dimensions)) {
+        return best;
+    }
+
+    const ggml_vec_dot_t dot = ggml_get_type_traits_cpu(GGML_TYPE_F32)->vec_dot;
+    int bestIndex = -1;
+    for (int i = 0; i < m_keys.size(); i++) {
+        float similarity = 0.0f;
+        dot(dimensions, &similarity, 0, m_vectors.data() + static_cast<size_t>(i) * dimensions, 0,
+            embedding.data(), 0, 1);
+        if (similarity > best.similarity) {
+            best.similarity = similarity;
+            bestIndex = i;
+        }
+    }
+    if (bestIndex >= 0 && best.similarity >= m_threshold) {
+        best.key = m_keys[bestIndex];
+    }
+    return best;
+}
+
+void SemanticCache::insert(const QString& key, const std::vector<float>& embedding)
+{
+    if (embedding.size() != static_cast<size_t>(m_embedder->dimensions())) {
+        return;
+    }
+    m_keys.append(key);
+    m_vectors.insert(m_vectors.end(), embedding.begin(), embedding.end());
+}
+
+bool SemanticCache::load(const QString& path)
+{
+    QFile file(path);
+    if (!isEnabled() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString fingerprint;
+    qint32 dimensions = 0;
+    QStringList keys;
+    in >> magic >> version >> fingerprint >> dimensions >> keys;
+    if (magic != kFileMagic || version != kFileVersion || fingerprint != m_embedder->fingerprint()
+        || dimensions != m_embedder->dimensions() || in.status() != QDataStream::Ok) {
+        qDebug() << "Discarding semantic cache of another embedding model:" << path;
+        return false;
+    }
+
+    std::vector<float> vectors(static_cast<size_t>(keys.size()) * dimensions);
+    const qint64 bytes = static_cast<qint64>(vectors.size() * sizeof(float));
+    if (in.readRawData(reinterpret_cast<char*>(vectors.data()), bytes) != bytes) {
+        qDebug() << "Semantic cache is truncated:" << path;
+        return false;
+    }
+
+    m_keys = keys;
+    m_vectors = std::move(vectors);
+    qDebug() << "Loaded" << m_keys.size() << "semantic cache entries";
+    return true;
+}
+
+bool SemanticCache::save(const QString& path) const
+{
+    QFile file(path);
+    if (!isEnabled() || !file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream out(&file);
+    out << kFileMagic << kFileVersion << m_embedder->fingerprint() << static_cast<qint32>(m_embedder->dimensions())
+        << m_keys;
+    const qint64 bytes = static_cast<qint64>(m_vectors.size() * sizeof(float));
+    return out.writeRawData(reinterpret_cast<const char*>(m_vectors.data()), bytes) == bytes;
+}
@@ -0,0 +1,46 @@
+#ifndef SEMANTIC_CACHE_H
+#define SEMANTIC_CACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+class TextEmbedder;
+
+// Near-duplicate detection for generation requests. Inputs that only differ in whitespace,
+// typos or a trailing sentence embed close together, so the vectors of earlier inputs
+// are scanned for the most similar one, and a match above the threshold lets the caller
+// offer that input's saved result instead of generating again.
+class SemanticCache
+{
+public:
+    explicit SemanticCache(TextEmbedder* embedder);
+
+    bool isEnabled() const;
+
+    // Cosine similarity at which two inputs count as the same document
+    void setThreshold(float threshold) { m_threshold = threshold; }
+    float threshold() const { return m_threshold; }
+
+    struct Match {
+        QString key;             // empty if nothing reached the threshold
+        float similarity = 0.0f;
+    };
+    Match lookup(const std::vector<float>& embedding) const;
+    void insert(const QString& key, const std::vector<float>& embedding);
+    int size() const { return m_keys.size(); }
+
+    // Vectors are only kept for the embedding model they were computed with
+    bool load(const QString& path);
+    bool save(const QString& path) const;
+
+private:
+    TextEmbedder* m_embedder;
+    float m_threshold = 0.95f;
+
+    // Flat index: the vector of m_keys[i] starts at m_vectors[i * dimensions]
+    QStringList m_keys;
+    std::vector<float> m_vectors;
+};
+
+#endif // SEMANTIC_CACHE_H
@@ -0,0 +1,114 @@
+#include "stop_matcher.h"
+
+#include <algorithm>
+
+namespace {
+
+unsigned char foldCase(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+}
+
+StopMatcher::StopMatcher(const std::vector<Sequence>& sequences)
+    : m_sequences(sequences)
+    , m_sameText(sequences.size(), -1)
+    , m_counts(sequences.size(), 0)
+{
+    for (const Sequence& sequence : m_sequences) {
+        for (const unsigned char c : sequence.text) {
+            if (m_symbol[foldCase(c)] == 0) {
+                m_symbol[foldCase(c)] = m_symbols++;
+            }
+        }
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+        m_symbol[c] = m_symbol[foldCase(c)];
+    }
+
+    auto addState = [this](int depth) {
+        m_next.resize(m_next.size() + m_symbols, -1);
+        m_depth.push_back(depth);
+        m_match.push_back(-1);
+        m_matchLink.push_back(-1);
+        return static_cast<int>(m_depth.size()) - 1;
+    };
+
+    // Trie of the sequences
+    addState(0);
+    for (int index = 0; index < static_cast<int>(m_sequences.size()); index++) {
+        const std::string& text = m_sequences[index].text;
+        if (text.empty()) {
+            continue;
+        }
+        int state = 0;
+        for (const unsigned char c : text) {
+            const size_t edge = static_cast<size_t>(state) * m_symbols + m_symbol[c];
+            if (m_next[edge] < 0) {
+                const int added = addState(m_depth[state] + 1);
+                m_next[edge] = added;
+            }
+            state = m_next[edge];
+        }
+        // Sequences that only differ in case end in the same state and are chained
+        int* last = &m_match[state];
+        while (*last >= 0) {
+            last = &m_sameText[*last];
+        }
+        *last = index;
+    }
+
+    // Breadth first, every missing transition is taken over from the state of the longest
+    // proper suffix, which turns the trie into a complete automaton
+    std::vector<int> suffix(m_depth.size(), 0);
+    std::vector<int> queue;
+    queue.reserve(m_depth.size());
+    for (int symbol = 0; symbol < m_symbols; symbol++) {
+        int& next = m_next[symbol];
+        if (next < 0) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); head++) {
+        const int state = queue[head];
+        const int link = suffix[state];
+        m_matchLink[state] = m_match[link] >= 0 ? link : m_matchLink[link];
+        for (int symbol = 0; symbol < m_symbols; symbol++) {
+            int& next = m_next[static_cast<size_t>(state) * m_symbols + symbol];
+            const int fallback = m_next[static_cast<size_t>(link) * m_symbols + symbol];
+            if (next < 0) {
+                next = fallback;
+            } else {
+                suffix[next] = fallback;
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+void StopMatcher::reset()
+{
+    std::fill(m_counts.begin(), m_counts.end(), 0);
+    m_state = 0;
+}
+
+int StopMatcher::feed(const char* text, size_t length, size_t& consumed)
+{
+    for (size_t i = 0; i < length; i++) {
+        m_state = m_next[static_cast<size_t>(m_state) * m_symbols + m_symbol[static_cast<unsigned char>(text[i])]];
+        int state = m_match[m_state] >= 0 ? m_state : m_matchLink[m_state];
+        for (; state >= 0; state = m_matchLink[state]) {
+            for (int index = m_match[state]; index >= 0; index = m_sameText[index]) {
+                if (++m_counts[index] >= m_sequences[index].occurrences) {
+                    consumed = i + 1;
+                    return index;
+                }
+            }
+        }
+    }
+    consumed = length;
+    return -1;
+}
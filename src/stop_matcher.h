@@ -0,0 +1,57 @@
+#ifndef STOP_MATCHER_H
+#define STOP_MATCHER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Stop sequences of a generation request, matched over the response text as it streams in.
+// The sequences are compiled into one Aho-Corasick automaton, so each byte costs a single
+// table lookup however many sequences there are. ASCII case is ignored. A sequence can
+// stop at a later occurrence, for headings that belong in the answer once but mean the
+// model started over when they come back.
+class StopMatcher
+{
+public:
+    struct Sequence {
+        std::string text;
+        int occurrences = 1;
+    };
+
+    explicit StopMatcher(const std::vector<Sequence>& sequences);
+
+    // Forgets the text fed so far
+    void reset();
+
+    // Feeds response text. Returns the index of the sequence that ends the response, or -1.
+    // `consumed` is set to the bytes of `text` up to the end of the match, or all of them.
+    int feed(const char* text, size_t length, size_t& consumed);
+
+    // Bytes at the end of the text so far that could still turn out to start a sequence
+    int pendingBytes() const { return m_depth[m_state]; }
+
+    const std::string& sequence(int index) const { return m_sequences[index].text; }
+
+private:
+    std::vector<Sequence> m_sequences;
+
+    // Bytes map to symbols of the automaton; 0 stands for every byte no sequence contains
+    std::array<uint16_t, 256> m_symbol{};
+    int m_symbols = 1;
+
+    // Per state: the transitions (state * m_symbols + symbol), the length of the text it
+    // stands for, the first sequence ending there and the next shorter state that ends one
+    std::vector<int> m_next;
+    std::vector<int> m_depth;
+    std::vector<int> m_match;
+    std::vector<int> m_matchLink;
+    // Per sequence: the next one with the same text, or -1
+    std::vector<int> m_sameText;
+
+    std::vector<int> m_counts;
+    int m_state = 0;
+};
+
+#endif // STOP_MATCHER_H
@@ -0,0 +1,141 @@
+#include "structured_output_parser.h"
+#include <QRegularExpression>
+
+namespace {
+
+// "Key: rest" with one of the given keys; leading numbering or markdown emphasis is
+// allowed before the key
+bool matchKey(const QString& line, const QRegularExpression& keys, QString& rest)
+{
+    const QRegularExpressionMatch match = keys.match(line);
+    if (!match.hasMatch()) {
+        return false;
+    }
+    rest = match.captured(1).trimmed();
+    return true;
+}
+
+QRegularExpression keyPattern(const char* alternatives)
+{
+    return QRegularExpression(QString("^\\s*(?:\\d+[.)]\\s*)?\\**(?:%1)\\**\\s*:\\**\\s*(.*)$").arg(alternatives),
+                              QRegularExpression::CaseInsensitiveOption);
+}
+
+}
+
+StructuredOutputParser::StructuredOutputParser(QObject* parent)
+    : QObject(parent)
+{
+}
+
+void StructuredOutputParser::reset(Format format)
+{
+    m_format = format;
+    m_line.clear();
+    m_open.clear();
+    m_items = 0;
+}
+
+void StructuredOutputParser::feed(const QString& text)
+{
+    qsizetype start = 0;
+    for (qsizetype end = text.indexOf(u'\n'); end >= 0; end = text.indexOf(u'\n', start)) {
+        m_line += QStringView(text).mid(start, end - start);
+        parseLine(m_line);
+        m_line.clear();
+        start = end + 1;
+    }
+    m_line += QStringView(text).mid(start);
+}
+
+void StructuredOutputParser::finish()
+{
+    if (!m_line.isEmpty()) {
+        parseLine(m_line);
+        m_line.clear();
+    }
+    m_open.clear();
+}
+
+void StructuredOutputParser::parseLine(const QString& line)
+{
+    const QString trimmed = line.trimmed();
+    if (trimmed.isEmpty()) {
+        return;
+    }
+    switch (m_format) {
+    case Format::Quiz:
+        parseQuizLine(trimmed);
+        break;
+    case Format::Flashcards:
+        parseFlashcardLine(trimmed);
+        break;
+    case Format::Enumerations:
+        parseEnumerationLine(trimmed);
+        break;
+    }
+}
+
+void StructuredOutputParser::parseQuizLine(const QString& line)
+{
+    static const QRegularExpression questionKey = keyPattern("q\\d*|question(?:\\s*\\d+)?");
+    static const QRegularExpression answerKey = keyPattern("a|answer|correct answer");
+    static const QRegularExpression numbered("^\\s*\\d+[.)]\\s+(.*)$");
+
+    QString rest;
+    if (matchKey(line, answerKey, rest)) {
+        if (!m_open.isEmpty() && !rest.isEmpty()) {
+            emit questionParsed(m_open.join('\n'), rest);
+            m_items++;
+        }
+        m_open.clear();
+    } else if (matchKey(line, questionKey, rest)) {
+        m_open = QStringList{rest};
+    } else if (m_open.isEmpty()) {
+        // A numbered line opens a question when no "Q:" key is used
+        const QRegularExpressionMatch match = numbered.match(line);
+        if (match.hasMatch()) {
+            m_open = QStringList{match.captured(1).trimmed()};
+        }
+    } else {
+        // Choices and continuation lines of the open question
+        m_open.append(line);
+    }
+}
+
+void StructuredOutputParser::parseFlashcardLine(const QString& line)
+{
+    static const QRegularExpression frontKey = keyPattern("front|term|q|question|card\\s*\\d*");
+    static const QRegularExpression backKey = keyPattern("back|definition|a|answer");
+    static const QRegularExpression definitionLine("^\\s*(?:[-*\\x{2022}]|\\d+[.)])?\\s*\\**([^:*]{1,80}?)\\**\\s*(?::|\\s-\\s)\\s*(.+)$");
+
+    QString rest;
+    if (matchKey(line, backKey, rest)) {
+        if (!m_open.isEmpty() && !rest.isEmpty()) {
+            emit flashcardParsed(m_open.join('\n'), rest);
+            m_items++;
+        }
+        m_open.clear();
+    } else if (matchKey(line, frontKey, rest)) {
+        m_open = QStringList{rest};
+    } else if (!m_open.isEmpty()) {
+        m_open.append(line);
+    } else {
+        const QRegularExpressionMatch match = definitionLine.match(line);
+        if (match.hasMatch()) {
+            emit flashcardParsed(match.captured(1).trimmed(), match.captured(2).trimmed());
+            m_items++;
+        }
+    }
+}
+
+void StructuredOutputParser::parseEnumerationLine(const QString& line)
+{
+    static const QRegularExpression listItem("^\\s*(?:[-*\\x{2022}]|\\d+[.)])\\s+(.*)$");
+
+    const QRegularExpressionMatch match = listItem.match(line);
+    if (match.hasMatch() && !match.captured(1).trimmed().isEmpty()) {
+        emit itemParsed(match.captured(1).trimmed());
+        m_items++;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef STRUCTURED_OUTPUT_PARSER_H
+#define STRUCTURED_OUTPUT_PARSER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+// Turns generated quiz, flashcard and key point text into items while it streams in.
+// Text is pushed in pieces of any size; an item is emitted as soon as the line that
+// completes it has arrived, so its page can show it while the rest is still generated.
+//
+// Recognized lines, case-insensitive:
+//   quiz        "Q:" / "Question:" (or a numbered line) opens a question, later lines
+//               without a key, such as the choices, belong to it, and "A:" /
+//               "Answer:" closes it
+//   flashcards  "Front:" / "Term:" / "Q:" opens a card, "Back:" / "Definition:" / "A:"
+//               closes it; a single "Term: definition" or "Term - definition" line
+//               is a card by itself
+//   key points  every bulleted or numbered line is an item
+class StructuredOutputParser : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Format {
+        Quiz,
+        Flashcards,
+        Enumerations,
+    };
+
+    explicit StructuredOutputParser(QObject* parent = nullptr);
+
+    // Starts over for a new generation
+    void reset(Format format);
+    Format format() const { return m_format; }
+    int itemCount() const { return m_items; }
+
+public slots:
+    void feed(const QString& text);
+    // The stream ended: the last line counts as complete
+    void finish();
+
+signals:
+    void questionParsed(const QString& question, const QString& answer);
+    void flashcardParsed(const QString& front, const QString& back);
+    void itemParsed(const QString& item);
+
+private:
+    void parseLine(const QString& line);
+    void parseQuizLine(const QString& line);
+    void parseFlashcardLine(const QString& line);
+    void parseEnumerationLine(const QString& line);
+
+    Format m_format = Format::Quiz;
+    QString m_line;        // received text after the last line break
+    QStringList m_open;    // lines of the question or card front waiting for its answer
+    int m_items = 0;
+};
+
+#endif // STRUCTURED_OUTPUT_PARSER_H
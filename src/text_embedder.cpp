@@ -0,0 +1,212 @@
+#include "text_embedder.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Tokens embedded per pass; longer inputs are embedded in windows and averaged
+constexpr int kMaxWindow = 512;
+// Tokens and sequences packed into one decode when embedding many short texts
+constexpr int kBatchTokens = 1024;
+constexpr int kMaxSequences = 16;
+
+}
+
+TextEmbedder::~TextEmbedder()
+{
+    if (m_context) {
+        llama_batch_free(m_batch);
+        llama_free(m_context);
+    }
+    if (m_model) {
+        llama_model_free(m_model);
+    }
+}
+
+bool TextEmbedder::initialize(const QString& modelPath)
+{
+    llama_model_params modelParams = llama_model_default_params();
+    modelParams.n_gpu_layers = 0;
+    m_model = llama_model_load_from_file(QDir::toNativeSeparators(modelPath).toStdString().c_str(), modelParams);
+    if (!m_model) {
+        qDebug() << "Failed to load embedding model" << modelPath;
+        return false;
+    }
+
+    m_window = std::min(llama_model_n_ctx_train(m_model), kMaxWindow);
+    m_batchTokens = std::max(m_window, kBatchTokens);
+
+    llama_context_params contextParams = llama_context_default_params();
+    contextParams.n_ctx = m_batchTokens;
+    contextParams.n_batch = m_batchTokens;
+    contextParams.n_ubatch = m_batchTokens;  // non-causal models see a sequence in one ubatch
+    contextParams.n_seq_max = kMaxSequences;
+    contextParams.n_threads = 2;
+    contextParams.n_threads_batch = 2;
+    contextParams.embeddings = true;
+    m_context = llama_init_from_model(m_model, contextParams);
+
+    // Models without a pooling head of their own are mean-pooled
+    if (m_context && llama_pooling_type(m_context) == LLAMA_POOLING_TYPE_NONE) {
+        llama_free(m_context);
+        contextParams.pooling_type = LLAMA_POOLING_TYPE_MEAN;
+        m_context = llama_init_from_model(m_model, contextParams);
+    }
+    if (!m_context) {
+        qDebug() << "Failed to create embedding context";
+        llama_model_free(m_model);
+        m_model = nullptr;
+        return false;
+    }
+
+    m_batch = llama_batch_init(m_batchTokens, 0, 1);
+    m_encoderOnly = llama_model_has_encoder(m_model) && !llama_model_has_decoder(m_model);
+
+    const QFileInfo info(modelPath);
+    m_fingerprint = QString("%1:%2").arg(info.fileName()).arg(info.size());
+    m_dimensions = llama_model_n_embd(m_model);
+    qDebug() << "Embedding model" << info.fileName() << "with" << m_dimensions << "dimensions";
+    return true;
+}
+
+std::vector<llama_token> TextEmbedder::tokenize(const QString& text) const
+{
+    // Whitespace differences should not move the vector at all
+    const std::string normalized = text.simplified().toStdString();
+    const llama_vocab* vocab = llama_model_get_vocab(m_model);
+    std::vector<llama_token> tokens(normalized.length() + 2);
+    const int n_tokens = llama_tokenize(vocab, normalized.c_str(), normalized.length(), tokens.data(),
+                                        tokens.size(), true, false);
+    tokens.resize(std::max(n_tokens, 0));
+    return tokens;
+}
+
+void TextEmbedder::addSequence(const llama_token* tokens, int count)
+{
+    for (int i = 0; i < count; i++) {
+        const int at = m_batch.n_tokens++;
+        m_batch.token[at] = tokens[i];
+        m_batch.pos[at] = i;
+        m_batch.n_seq_id[at] = 1;
+        m_batch.seq_id[at][0] = m_sequences;
+        m_batch.logits[at] = true;
+    }
+    m_sequences++;
+}
+
+bool TextEmbedder::decodePending(std::vector<std::vector<float>>& out)
+{
+    llama_kv_self_clear(m_context);
+    const int status = m_encoderOnly ? llama_encode(m_context, m_batch) : llama_decode(m_context, m_batch);
+
+    bool ok = status == 0;
+    for (int seq = 0; seq < m_sequences; seq++) {
+        const float* pooled = ok ? llama_get_embeddings_seq(m_context, seq) : nullptr;
+        if (!pooled) {
+            ok = false;
+            out.emplace_back();
+            continue;
+        }
+        out.emplace_back(pooled, pooled + m_dimensions);
+    }
+    m_batch.n_tokens = 0;
+    m_sequences = 0;
+    return ok;
+}
+
+void TextEmbedder::normalize(std::vector<float>& vector)
+{
+    double norm = 0.0;
+    for (float v : vector) {
+        norm += static_cast<double>(v) * v;
+    }
+    if (norm <= 0.0) {
+        vector.clear();
+        return;
+    }
+    const float scale = static_cast<float>(1.0 / std::sqrt(norm));
+    for (float& v : vector) {
+        v *= scale;
+    }
+}
+
+std::vector<float> TextEmbedder::embed(const QString& text)
+{
+    if (!isEnabled()) {
+        return {};
+    }
+    const std::vector<llama_token> tokens = tokenize(text);
+    if (tokens.empty()) {
+        return {};
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    // Token-weighted mean of the pooled embeddings of each window
+    std::vector<float> sum(m_dimensions, 0.0f);
+    const int n_tokens = tokens.size();
+    for (int start = 0; start < n_tokens; start += m_window) {
+        const int count = std::min(m_window, n_tokens - start);
+        addSequence(tokens.data() + start, count);
+
+        std::vector<std::vector<float>> pooled;
+        if (!decodePending(pooled)) {
+            qDebug() << "Failed to embed tokens" << start << "to" << start + count;
+            return {};
+        }
+        for (int d = 0; d < m_dimensions; d++) {
+            sum[d] += pooled[0][d] * count;
+        }
+    }
+
+    normalize(sum);
+    return sum;
+}
+
+std::vector<std::vector<float>> TextEmbedder::embedBatch(const QStringList& texts)
+{
+    std::vector<std::vector<float>> result;
+    if (!isEnabled()) {
+        result.resize(texts.size());
+        return result;
+    }
+
+    std::vector<std::vector<llama_token>> tokenized;
+    tokenized.reserve(texts.size());
+    for (const QString& text : texts) {
+        std::vector<llama_token> tokens = tokenize(text);
+        tokens.resize(std::min<size_t>(tokens.size(), m_window));
+        tokenized.push_back(std::move(tokens));
+    }
+
+    QMutexLocker locker(&m_mutex);
+    result.reserve(texts.size());
+    for (size_t i = 0; i < tokenized.size(); i++) {
+        const int count = tokenized[i].size();
+        if (m_sequences > 0 && (m_sequences == kMaxSequences || m_batch.n_tokens + count > m_batchTokens)) {
+            decodePending(result);
+        }
+        if (count == 0) {
+            // Keeps the results aligned with the texts
+            if (m_sequences > 0) {
+                decodePending(result);
+            }
+            result.emplace_back();
+            continue;
+        }
+        addSequence(tokenized[i].data(), count);
+    }
+    if (m_sequences > 0) {
+        decodePending(result);
+    }
+
+    for (std::vector<float>& vector : result) {
+        normalize(vector);
+    }
+    return result;
+}
@@ -0,0 +1,61 @@
+#ifndef TEXT_EMBEDDER_H
+#define TEXT_EMBEDDER_H
+
+#include <QString>
+#include <QStringList>
+#include <QMutex>
+#include <vector>
+
+#include "llama.h"
+
+// A small embedding model turning text into unit-length pooled vectors, so the dot
+// product of two embeddings is their cosine similarity. Shared by the near-duplicate
+// cache and the retrieval index; all methods are thread-safe once initialized.
+class TextEmbedder
+{
+public:
+    TextEmbedder() = default;
+    ~TextEmbedder();
+
+    TextEmbedder(const TextEmbedder&) = delete;
+    TextEmbedder& operator=(const TextEmbedder&) = delete;
+
+    // Loads the embedding model; the embedder stays disabled if this fails
+    bool initialize(const QString& modelPath);
+    bool isEnabled() const { return m_context != nullptr; }
+
+    int dimensions() const { return m_dimensions; }
+    // Identifies the model, so stored vectors are only compared with their own kind
+    QString fingerprint() const { return m_fingerprint; }
+    // Tokens embedded in one pass
+    int window() const { return m_window; }
+
+    // Embedding of the whole text: texts longer than the window are embedded in windows
+    // and averaged. Empty on failure.
+    std::vector<float> embed(const QString& text);
+
+    // One embedding per text, packing several texts into each decode. Texts are truncated
+    // to the window; failed ones come back empty.
+    std::vector<std::vector<float>> embedBatch(const QStringList& texts);
+
+private:
+    std::vector<llama_token> tokenize(const QString& text) const;
+    void addSequence(const llama_token* tokens, int count);
+    // Decodes the pending batch and appends the pooled vector of each of its sequences
+    bool decodePending(std::vector<std::vector<float>>& out);
+    static void normalize(std::vector<float>& vector);
+
+    llama_model* m_model = nullptr;
+    llama_context* m_context = nullptr;
+    llama_batch m_batch = {};
+    int m_sequences = 0;
+    bool m_encoderOnly = false;
+    QMutex m_mutex;
+
+    QString m_fingerprint;
+    int m_dimensions = 0;
+    int m_window = 0;
+    int m_batchTokens = 0;
+};
+
+#endif // TEXT_EMBEDDER_H
@@ -0,0 +1,266 @@
+#include "tokenizer_service.h"
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <atomic>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+// Texts shorter than this are tokenized in one call
+constexpr size_t kMinSplitBytes = 4096;
+// Paragraphs longer than this are cut at line breaks as well
+constexpr size_t kMaxSegmentBytes = 16384;
+// Pieces missing from the cache are tokenized on the calling thread below this much text
+constexpr size_t kParallelBytes = 64 * 1024;
+constexpr qsizetype kSegmentCacheBytes = 32 * 1024 * 1024;
+
+// Whether the characters before `end` are whole. A lead byte claims the bytes after it
+// whether or not they continue it, and tokenizing would swallow the line break at `end`.
+bool endsCharacters(const std::string& text, size_t end)
+{
+    for (size_t back = 1; back <= 3 && back <= end; back++) {
+        const unsigned char c = text[end - back];
+        const size_t claimed = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        if (claimed > back) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Cuts the text into (offset, length) pieces that end after a run of line breaks: at
+// every blank line, and in paragraphs longer than kMaxSegmentBytes also at the first
+// line break past that length
+std::vector<std::pair<size_t, size_t>> splitSegments(const std::string& text)
+{
+    std::vector<std::pair<size_t, size_t>> segments;
+    size_t start = 0;
+    size_t pos = text.find('\n');
+    while (pos != std::string::npos) {
+        const size_t end = text.find_first_not_of('\n', pos);
+        if (end == std::string::npos) {
+            break;
+        }
+        const bool paragraph = end - pos >= 2;
+        if ((paragraph || end - start > kMaxSegmentBytes) && endsCharacters(text, pos)) {
+            segments.emplace_back(start, end - start);
+            start = end;
+        }
+        pos = text.find('\n', end);
+    }
+    segments.emplace_back(start, text.size() - start);
+    return segments;
+}
+
+}
+
+TokenizerService::TokenizerService()
+    : m_segmentCache(kSegmentCacheBytes)
+{
+}
+
+TokenizerService::~TokenizerService()
+{
+    if (m_model) {
+        llama_model_free(m_model);
+    }
+}
+
+bool TokenizerService::initialize(const QString& modelPath)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    llama_model_params params = llama_model_default_params();
+    params.vocab_only = true;
+    m_model = llama_model_load_from_file(QDir::toNativeSeparators(modelPath).toStdString().c_str(), params);
+    if (!m_model) {
+        qDebug() << "Failed to load the vocabulary of" << modelPath;
+        return false;
+    }
+    m_modelPath = modelPath;
+
+    // Only SentencePiece vocabularies tokenize the text as a whole; the others split it
+    // with a regex first, and their splits can cross line breaks. Tokens that strip the
+    // whitespace next to them could reach across one too.
+    const llama_vocab* vocabulary = vocab();
+    m_splitsAtNewlines = llama_vocab_type(vocabulary) == LLAMA_VOCAB_TYPE_SPM;
+    for (llama_token id = 0; m_splitsAtNewlines && id < llama_vocab_n_tokens(vocabulary); id++) {
+        const llama_token_attr attr = llama_vocab_get_attr(vocabulary, id);
+        if (attr & (LLAMA_TOKEN_ATTR_LSTRIP | LLAMA_TOKEN_ATTR_RSTRIP)) {
+            m_splitsAtNewlines = false;
+        } else if (!(attr & LLAMA_TOKEN_ATTR_BYTE)) {
+            const std::string_view text(llama_vocab_get_text(vocabulary, id));
+            m_splitsAtNewlines = text.find('\n') == std::string_view::npos
+                                 || text.find_first_not_of('\n') == std::string_view::npos;
+        }
+    }
+    m_newlineTokens = tokenizeText("\n", 1, false, false);
+    m_splitsAtNewlines = m_splitsAtNewlines && !m_newlineTokens.empty();
+
+    qDebug() << "Loaded vocabulary of" << modelPath << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
+const llama_vocab* TokenizerService::vocab() const
+{
+    return m_model ? llama_model_get_vocab(m_model) : nullptr;
+}
+
+// Pieces come from the cache where possible, and the rest are tokenized on Qt's global
+// pool. The calling thread takes part in the work, so this may run on a pool thread too.
+std::vector<llama_token> TokenizerService::tokenize(const std::string& text, bool addSpecial, bool parseSpecial) const
+{
+    if (!m_model) {
+        return {};
+    }
+    // An end-of-sequence token would have to go after the last piece only
+    if (!m_splitsAtNewlines || text.size() < kMinSplitBytes || (addSpecial && llama_vocab_get_add_eos(vocab()))) {
+        return tokenizeText(text.data(), text.size(), addSpecial, parseSpecial);
+    }
+    const std::vector<std::pair<size_t, size_t>> segments = splitSegments(text);
+    if (segments.size() == 1) {
+        return tokenizeText(text.data(), text.size(), addSpecial, parseSpecial);
+    }
+
+    // Whether a piece comes first changes its tokens, as do the flags
+    auto keyOf = [&](size_t index) {
+        const char flags = (index == 0 ? 1 : 0) | (index == 0 && addSpecial ? 2 : 0) | (parseSpecial ? 4 : 0);
+        QByteArray key(1, flags);
+        key.append(text.data() + segments[index].first, segments[index].second);
+        return key;
+    };
+
+    std::vector<std::vector<llama_token>> parts(segments.size());
+    QList<int> missing;
+    size_t missingBytes = 0;
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (const std::vector<llama_token>* cached = m_segmentCache.object(keyOf(i))) {
+                parts[i] = *cached;
+            } else {
+                missing.append(static_cast<int>(i));
+                missingBytes += segments[i].second;
+            }
+        }
+    }
+
+    std::atomic<bool> failed{false};
+    auto tokenizeMissing = [&](int index) {
+        if (!tokenizeSegment(text, segments[index].first, segments[index].second, index == 0, addSpecial,
+                             parseSpecial, parts[index])) {
+            failed = true;
+        }
+    };
+    if (missing.size() > 1 && missingBytes >= kParallelBytes) {
+        QtConcurrent::blockingMap(missing, tokenizeMissing);
+    } else {
+        for (int index : missing) {
+            tokenizeMissing(index);
+        }
+    }
+    if (failed) {
+        qDebug() << "Tokenizing in pieces failed, tokenizing the text in one call";
+        return tokenizeText(text.data(), text.size(), addSpecial, parseSpecial);
+    }
+
+    std::vector<llama_token> tokens;
+    size_t total = 0;
+    for (const std::vector<llama_token>& part : parts) {
+        total += part.size();
+    }
+    tokens.reserve(total);
+    for (const std::vector<llama_token>& part : parts) {
+        tokens.insert(tokens.end(), part.begin(), part.end());
+    }
+
+    QMutexLocker locker(&m_cacheMutex);
+    for (int index : missing) {
+        const QByteArray key = keyOf(index);
+        const qsizetype cost = key.size() + static_cast<qsizetype>(parts[index].size() * sizeof(llama_token));
+        m_segmentCache.insert(key, new std::vector<llama_token>(std::move(parts[index])), cost);
+    }
+    return tokens;
+}
+
+// The first piece is tokenized as the start of the text. Later ones are tokenized behind
+// a line break, which stands in for the one that ends the piece before, and its tokens
+// are dropped. False if the line break did not come out as its own tokens.
+bool TokenizerService::tokenizeSegment(const std::string& text, size_t offset, size_t length, bool first,
+                                       bool addSpecial, bool parseSpecial, std::vector<llama_token>& tokens) const
+{
+    if (first) {
+        tokens = tokenizeText(text.data() + offset, length, addSpecial, parseSpecial);
+        return !tokens.empty();
+    }
+    std::string glued;
+    glued.reserve(length + 1);
+    glued += '\n';
+    glued.append(text, offset, length);
+    tokens = tokenizeText(glued.data(), glued.size(), false, parseSpecial);
+    if (tokens.size() <= m_newlineTokens.size()
+        || !std::equal(m_newlineTokens.begin(), m_newlineTokens.end(), tokens.begin())) {
+        return false;
+    }
+    tokens.erase(tokens.begin(), tokens.begin() + m_newlineTokens.size());
+    return true;
+}
+
+std::vector<llama_token> TokenizerService::tokenizeText(const char* text, size_t length, bool addSpecial,
+                                                        bool parseSpecial) const
+{
+    std::vector<llama_token> tokens(length + 2);
+    int n_tokens = llama_tokenize(vocab(), text, length, tokens.data(), tokens.size(), addSpecial, parseSpecial);
+    if (n_tokens < 0) {
+        // Invalid UTF-8 can come out as more tokens than bytes
+        tokens.resize(-n_tokens);
+        n_tokens = llama_tokenize(vocab(), text, length, tokens.data(), tokens.size(), addSpecial, parseSpecial);
+    }
+    if (n_tokens < 0) {
+        return {};
+    }
+    tokens.resize(n_tokens);
+    return tokens;
+}
+
+int TokenizerService::countTokens(const QString& text, bool addSpecial) const
+{
+    if (!m_model) {
+        return 0;
+    }
+    const std::string utf8 = text.toStdString();
+    if (m_splitsAtNewlines && utf8.size() >= kMinSplitBytes) {
+        return static_cast<int>(tokenize(utf8, addSpecial).size());
+    }
+    // With no room for tokens the count comes back negated
+    return -llama_tokenize(vocab(), utf8.c_str(), utf8.length(), nullptr, 0, addSpecial, false);
+}
+
+std::string TokenizerService::detokenize(const llama_token* tokens, size_t count) const
+{
+    std::string text;
+    if (!m_model) {
+        return text;
+    }
+    // Pieces are written straight into the text; a negative length is the room a longer
+    // piece needs
+    constexpr int kPieceBytes = 64;
+    for (size_t i = 0; i < count; i++) {
+        const size_t offset = text.size();
+        text.resize(offset + kPieceBytes);
+        int length = llama_token_to_piece(vocab(), tokens[i], text.data() + offset, kPieceBytes, 0, false);
+        if (length < 0) {
+            text.resize(offset - length);
+            length = llama_token_to_piece(vocab(), tokens[i], text.data() + offset, -length, 0, false);
+        }
+        text.resize(offset + std::max(length, 0));
+    }
+    return text;
+}
@@ -0,0 +1,63 @@
+#ifndef TOKENIZER_SERVICE_H
+#define TOKENIZER_SERVICE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <string>
+#include <vector>
+
+#include "llama.h"
+
+// The tokenizer of a model file, opened with only its vocabulary. That takes milliseconds
+// rather than the seconds the weights do, so token counts and prompt budgets are
+// available before the model is loaded. Tokenizing only reads the vocabulary, so once
+// initialized one instance is shared by any number of threads.
+//
+// Long texts are tokenized paragraph by paragraph, on several threads, and the tokens of
+// recent paragraphs are remembered. Counting an edited document again, or building the
+// prompt of another task from it, only tokenizes the paragraphs that changed. Texts are
+// only split where the vocabulary cannot merge tokens across the break, so the result
+// is always that of a single llama_tokenize call.
+class TokenizerService
+{
+public:
+    TokenizerService();
+    ~TokenizerService();
+
+    TokenizerService(const TokenizerService&) = delete;
+    TokenizerService& operator=(const TokenizerService&) = delete;
+
+    bool initialize(const QString& modelPath);
+    bool isReady() const { return m_model != nullptr; }
+    QString modelPath() const { return m_modelPath; }
+    const llama_vocab* vocab() const;
+
+    // Empty on failure
+    std::vector<llama_token> tokenize(const std::string& text, bool addSpecial, bool parseSpecial = false) const;
+    // 0 if the service is not ready
+    int countTokens(const QString& text, bool addSpecial = false) const;
+    std::string detokenize(const llama_token* tokens, size_t count) const;
+
+private:
+    std::vector<llama_token> tokenizeText(const char* text, size_t length, bool addSpecial, bool parseSpecial) const;
+    bool tokenizeSegment(const std::string& text, size_t offset, size_t length, bool first, bool addSpecial,
+                         bool parseSpecial, std::vector<llama_token>& tokens) const;
+
+    llama_model* m_model = nullptr;
+    QString m_modelPath;
+
+    // Whether no token of the vocabulary spans a line break together with other text, so
+    // a text can be tokenized in pieces that end after line breaks
+    bool m_splitsAtNewlines = false;
+    // Tokens of a lone line break. A piece after the first is tokenized behind one, which
+    // stands in for the end of the piece before it, and these tokens are dropped.
+    std::vector<llama_token> m_newlineTokens;
+
+    // Tokens of recently tokenized pieces, keyed by their text; the cost is in bytes
+    mutable QMutex m_cacheMutex;
+    mutable QCache<QByteArray, std::vector<llama_token>> m_segmentCache;
+};
+
+#endif // TOKENIZER_SERVICE_H
@@ -0,0 +1,56 @@
+#include "document_importer.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+
+// The encoding of files without a byte order mark is guessed from their first megabyte
+constexpr int kSniffBytes = 1024 * 1024;
+
+class TestDocumentImporter : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString writeFile(const QByteArray& bytes)
+    {
+        const QString path = m_dir.filePath(QString("file%1.txt").arg(m_files++));
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size()) {
+            return QString();
+        }
+        return path;
+    }
+
+    QTemporaryDir m_dir;
+    int m_files = 0;
+
+private slots:
+    void utf8SampleEndingInsideCharacter()
+    {
+        // "é" is two bytes, and the first one is the last byte of the sample
+        QByteArray bytes(kSniffBytes - 1, 'a');
+        bytes += "\xC3\xA9 tail";
+        const QString path = writeFile(bytes);
+        QVERIFY(!path.isEmpty());
+
+        const ImportedDocument document = DocumentImporter::import(path);
+        QVERIFY(document.isValid());
+        QCOMPARE(document.encoding, QString("UTF-8"));
+        QVERIFY(document.text.endsWith(QString::fromUtf8("\xC3\xA9 tail")));
+        QCOMPARE(document.text.size(), kSniffBytes - 1 + 6);
+    }
+
+    void latin1Fallback()
+    {
+        const QString path = writeFile(QByteArray("caf\xE9 au lait"));
+        QVERIFY(!path.isEmpty());
+
+        const ImportedDocument document = DocumentImporter::import(path);
+        QVERIFY(document.isValid());
+        QCOMPARE(document.text, QString::fromUtf8("caf\xC3\xA9 au lait"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestDocumentImporter)
+#include "test_document_importer.moc"
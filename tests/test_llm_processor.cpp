@@ -0,0 +1,50 @@
+#include "llm_processor.h"
+
+#include <QtTest>
+
+// Runs against the model in TEXTMASTER_TEST_MODEL and is skipped without one
+class TestLLMProcessor : public QObject
+{
+    Q_OBJECT
+
+private:
+    LLMProcessor m_processor;
+
+private slots:
+    void initTestCase()
+    {
+        const QString modelPath = qEnvironmentVariable("TEXTMASTER_TEST_MODEL");
+        if (modelPath.isEmpty()) {
+            QSKIP("Set TEXTMASTER_TEST_MODEL to a GGUF model to run the model tests");
+        }
+        QVERIFY(m_processor.initialize(modelPath));
+    }
+
+    void conversationSurvivesIdleTeardown()
+    {
+        // Well over a third of the context, so the prompt and the conversation forked
+        // from it only fit back into the recreated context if they share their cells
+        QStringList sentences;
+        for (int i = 0; i < 60; i++) {
+            sentences << QString("Fact %1: the river crosses valley number %1 before it reaches the sea.").arg(i);
+        }
+        const QString document = sentences.join(' ');
+
+        const QString quiz = m_processor.generateQuiz(document);
+        QVERIFY(!quiz.isEmpty());
+        QVERIFY(m_processor.hasConversation());
+        QVERIFY(m_processor.lastGenerationStats().promptTokens > 2048 / 3);
+
+        // Let the idle timer free the context and snapshot both sequences
+        m_processor.setIdleTimeout(10);
+        QTest::qWait(1000);
+        QVERIFY(m_processor.hasConversation());
+
+        const QString answer = m_processor.sendFollowUp("Which valley comes first?");
+        QVERIFY(!answer.isEmpty());
+        QVERIFY(m_processor.hasConversation());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestLLMProcessor)
+#include "test_llm_processor.moc"